@@ -0,0 +1,172 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * batch.c
+ * apply many quota changes in one process
+ *
+ * Every record is a quotatool command line without the program name,
+ * e.g. "-u alice -b -q 50M -l 100M /home". Blank lines and lines
+ * starting with '#' are skipped. Filesystems are resolved and their
+ * quota format probed once, the first time a record mentions them.
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quotatool.h"
+#include "batch.h"
+#include "output.h"
+#include "parse.h"
+#include "run.h"
+#include "system.h"
+
+#define WHITESPACE " \t\r\n"
+
+
+/*
+ * batch_split
+ * split a record into words, in place. Words may be quoted with
+ * single or double quotes to protect whitespace ("1 week").
+ * argv[0] is set to PROGNAME so the result can go straight to
+ * parse_commandline(). Returns argc, or -1 on a syntax error.
+ */
+int batch_split (char *line, char **argv, int max_args) {
+  char *cp, *word;
+  char quote;
+  int argc;
+
+  argv[0] = (char *) PROGNAME;
+  argc = 1;
+
+  cp = line;
+  while ( 1 ) {
+    while ( *cp && strchr(WHITESPACE, *cp) ) cp++;
+    if ( ! *cp || (argc == 1 && *cp == '#') ) {
+      break;
+    }
+
+    if ( argc >= max_args - 1 ) {
+      output_error ("Too many words (max %d)", max_args - 2);
+      return -1;
+    }
+
+    /* copy the word onto itself, dropping the quotes */
+    word = cp;
+    argv[argc++] = word;
+    quote = '\0';
+    while ( *cp && (quote || ! strchr(WHITESPACE, *cp)) ) {
+      if ( quote && *cp == quote ) {
+	quote = '\0';
+      }
+      else if ( ! quote && (*cp == '"' || *cp == '\'') ) {
+	quote = *cp;
+      }
+      else {
+	*word++ = *cp;
+      }
+      cp++;
+    }
+    if ( quote ) {
+      output_error ("Unterminated quote");
+      return -1;
+    }
+    if ( *cp ) cp++;
+    *word = '\0';
+  }
+
+  argv[argc] = NULL;
+  return argc;
+}
+
+
+
+/*
+ * batch_run
+ * read records from defaults->batch_file and run each of them.
+ * -n and -R from the real command line apply to every record.
+ * Returns 0 if all records succeeded, else the code of the first failure.
+ */
+int batch_run (argdata_t *defaults) {
+  FILE *in;
+  char line[BATCH_LINE_MAX];
+  char *argv[BATCH_ARGS_MAX];
+  argdata_t *data;
+  int argc, lineno, status, retval;
+  int ok, failed;
+
+  if ( ! strcmp(defaults->batch_file, "-") ) {
+    in = stdin;
+  }
+  else if ( ! (in = fopen(defaults->batch_file, "r")) ) {
+    output_error ("Failed opening %s for reading: %s", defaults->batch_file,
+		  strerror(errno));
+    return ERR_ARG;
+  }
+
+  /* resolve user and group names from one pass over each database */
+  system_idcache_enable ();
+  parse_records = PARSE_BATCH;
+
+  lineno = ok = failed = retval = 0;
+  while ( fgets(line, sizeof(line), in) ) {
+    lineno++;
+
+    if ( ! strchr(line, '\n') && ! feof(in) ) {
+      output_error ("line %d: longer than %d characters", lineno, BATCH_LINE_MAX - 2);
+      /* skip the rest of it */
+      while ( fgets(line, sizeof(line), in) && ! strchr(line, '\n') );
+      status = ERR_PARSE;
+    }
+    else if ( (argc = batch_split(line, argv, BATCH_ARGS_MAX)) < 0 ) {
+      output_error ("line %d: cannot split record", lineno);
+      status = ERR_PARSE;
+    }
+    else if ( argc == 1 ) {
+      continue;
+    }
+    else if ( ! (data = parse_commandline(argc, argv)) ) {
+      status = ERR_PARSE;
+    }
+    else if ( data->batch_file || data->serve_socket ) {
+      output_error ("line %d: --batch and --serve cannot be used in a batch", lineno);
+      parse_free (data);
+      status = ERR_PARSE;
+    }
+    else {
+      data->noaction   |= defaults->noaction;
+      data->raise_only |= defaults->raise_only;
+      status = run_argdata (data);
+      parse_free (data);
+    }
+
+    if ( status ) {
+      output_error ("line %d: failed (exit code %d)", lineno, status);
+      failed++;
+      if ( ! retval ) retval = status;
+    }
+    else {
+      output_info ("line %d: ok", lineno);
+      ok++;
+    }
+  }
+
+  parse_records = 0;
+
+  if ( ferror(in) ) {
+    output_error ("Failed reading %s: %s", defaults->batch_file, strerror(errno));
+    if ( ! retval ) retval = ERR_SYS;
+  }
+  if ( in != stdin ) {
+    fclose (in);
+  }
+
+  output_notice ("batch: %d records, %d ok, %d failed", ok + failed, ok, failed);
+  return retval;
+}
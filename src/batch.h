@@ -0,0 +1,25 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * batch.h
+ * apply many quota changes in one process
+ */
+#ifndef INCLUDE_QUOTATOOL_BATCH
+#define INCLUDE_QUOTATOOL_BATCH 1
+
+#include <config.h>
+
+#include "parse.h"
+
+/* maximum length of one batch record and number of words in it */
+#define BATCH_LINE_MAX   4096
+#define BATCH_ARGS_MAX   64
+
+int   batch_split   (char *line, char **argv, int max_args);
+int   batch_run     (argdata_t *defaults);
+
+#endif /* INCLUDE_QUOTATOOL_BATCH */
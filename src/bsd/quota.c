@@ -20,57 +20,129 @@
 #include "system.h"
 #include "quota.h"
 #include "quotatool.h"
+#include "stats.h"
 
-quota_t *quota_new (int q_type, int id, char *fs_spec)
+/* all open filesystems */
+static quota_fs_t *open_filesystems = NULL;
+
+/*
+ * quota_ctl
+ * quotactl() for myquota's filesystem and type, counted for --stats
+ * under name
+ */
+static int quota_ctl (quota_t *myquota, int cmd, const char *name, int id, void *addr)
 {
-  quota_t *myquota;
+  u_int64_t start;
+  int retval, saved_errno;
+
+  start = stats_now ();
+  retval = quotactl (myquota->_qfile, QCMD(cmd, myquota->_id_type), id, (caddr_t) addr);
+  saved_errno = errno;
+  stats_quotactl (name, start);
+  errno = saved_errno;
+  return retval;
+}
+
+quota_fs_t *quota_fs_open (char *fs_spec)
+{
+  quota_fs_t *myfs;
   fs_t *fs;
-  char *qfile;
+  u_int64_t start;
 
-  if (q_type > MAXQUOTAS) {
-    output_error ("Unknown quota type: %d", q_type);
-    return 0;
+  start = stats_now ();
+  fs = system_getfs (fs_spec);
+  stats_phase (STATS_MOUNTS, start);
+  if ( ! fs ) {
+    return NULL;
   }
 
-  --q_type;                    /* see defs in quota.h */
-
-  myquota = (quota_t *) calloc (1, sizeof(quota_t));
-  if (! myquota) {
-    output_error ("Insufficient memory");
-    exit (ERR_MEM);
+  /* already open, maybe under another name (device vs mount point) */
+  for (myfs = open_filesystems; myfs; myfs = myfs->_next) {
+    if ( ! strcmp(myfs->_mnt.mount_pt, fs->mount_pt) ) {
+      free (fs);
+      return myfs;
+    }
   }
 
-  fs = system_getfs (fs_spec);
-  if ( ! fs ) {
-    free (myquota);
+  myfs = (quota_fs_t *) calloc (1, sizeof(quota_fs_t));
+  if (! myfs) {
+    output_error ("Insufficient memory");
+    free (fs);
+    errno = ENOMEM;
     return NULL;
   }
+  memcpy (&myfs->_mnt, fs, sizeof(fs_t));
+  free (fs);
 
   /* Pass the mount point directly to quotactl(). The kernel uses
    * namei() to resolve any path to its mount point, so the old
    * approach of appending "/quota.user" was unnecessary. Using the
    * mount point directly is simpler and matches what edquota(8) does. */
-  qfile = strdup(fs->mount_pt);
-  if (! qfile) {
-    output_error ("Insufficient memory");
-    free (myquota);
-    free (fs);
-    exit (ERR_MEM);
+  myfs->_qfile = myfs->_mnt.mount_pt;
+  output_debug ("qfile is \"%s\"\n", myfs->_qfile);
+
+  myfs->_next = open_filesystems;
+  open_filesystems = myfs;
+  return myfs;
+}
+
+void quota_fs_close (quota_fs_t *myfs)
+{
+  quota_fs_t **link;
+
+  for (link = &open_filesystems; *link; link = &(*link)->_next) {
+    if (*link == myfs) {
+      *link = myfs->_next;
+      break;
+    }
+  }
+  free (myfs);
+}
+
+void quota_fs_close_stale (void)
+{
+  quota_fs_t *myfs, *next;
+
+  for (myfs = open_filesystems; myfs; myfs = next) {
+    next = myfs->_next;
+    if (! system_mount_current (&myfs->_mnt))
+      quota_fs_close (myfs);
+  }
+}
+
+/* nothing kept open on BSD, quotactl() takes the mount point */
+void quota_fs_unpin_all (void)
+{
+}
+
+quota_t *quota_new (quota_fs_t *myfs, int q_type, int id)
+{
+  quota_t *myquota;
+
+  if (q_type > MAXQUOTAS) {
+    output_error ("Unknown quota type: %d", q_type);
+    return 0;
   }
 
-  output_debug ("qfile is \"%s\"\n", qfile);
+  --q_type;                    /* see defs in quota.h */
+
+  myquota = (quota_t *) calloc (1, sizeof(quota_t));
+  if (! myquota) {
+    output_error ("Insufficient memory");
+    errno = ENOMEM;
+    return NULL;
+  }
 
   myquota->_id = id;
   myquota->_id_type = q_type;
-  myquota->_qfile = qfile;
+  myquota->_qfile = myfs->_qfile;
+  myquota->_fs = myfs;
 
-  free (fs);
   return myquota;
 }
 
 inline void quota_delete (quota_t *myquota) {
 
-  free (myquota->_qfile);
   free (myquota);
 }
 
@@ -81,8 +153,7 @@ int quota_get (quota_t *myquota)
 
   output_debug ("fetching quotas: device='%s',id='%d'",
                myquota->_qfile, myquota->_id);
-  retval = quotactl (myquota->_qfile, QCMD(Q_GETQUOTA, myquota->_id_type),
-                   myquota->_id, (caddr_t) &sysquota);
+  retval = quota_ctl (myquota, Q_GETQUOTA, "Q_GETQUOTA", myquota->_id, &sysquota);
   if ( retval < 0 ) {
     output_error ("Failed fetching quotas: %s", strerror (errno));
     return 0;
@@ -108,12 +179,38 @@ int quota_get (quota_t *myquota)
   return 1;
 }
 
+/* quota_get() already has them, from the same Q_GETQUOTA */
+int quota_get_grace (quota_t *myquota)
+{
+  (void) myquota;
+  return 1;
+}
+
+void quota_forget_grace (void)
+{
+}
+
+void quota_info_stats (int *issued, int *avoided)
+{
+  *issued = *avoided = 0;
+}
+
+int quota_get_next (quota_t *myquota)
+{
+  /* FreeBSD and OpenBSD have no Q_GETNEXTQUOTA */
+  output_error ("Listing all ids is not supported on this platform (%s)",
+               myquota->_qfile);
+  errno = EOPNOTSUPP;
+  return -1;
+}
+
 int quota_set (quota_t *myquota){
   struct dqblk sysquota;
   int retval;
 
   if ( geteuid() != 0 ) {
     output_error ("Only root can set quotas");
+    errno = EPERM;
     return 0;
   }
 
@@ -129,8 +226,7 @@ int quota_set (quota_t *myquota){
   sysquota.dqb_itime      = myquota->inode_grace;
 
   /* make the syscall */
-  retval = quotactl (myquota->_qfile, QCMD(Q_SETQUOTA, myquota->_id_type),
-                       myquota->_id, (caddr_t) &sysquota);
+  retval = quota_ctl (myquota, Q_SETQUOTA, "Q_SETQUOTA", myquota->_id, &sysquota);
   if ( retval < 0 ) {
     output_error ("Failed setting quota: %s", strerror (errno));
     return 0;
@@ -145,8 +241,7 @@ int quota_set (quota_t *myquota){
     memset(&grace_dq, 0, sizeof(grace_dq));
 
     /* Read uid 0's current quota to preserve existing fields */
-    retval = quotactl(myquota->_qfile, QCMD(Q_GETQUOTA, myquota->_id_type),
-                      0, (caddr_t) &grace_dq);
+    retval = quota_ctl(myquota, Q_GETQUOTA, "Q_GETQUOTA", 0, &grace_dq);
     if (retval < 0) {
       output_error("Failed reading global grace period: %s", strerror(errno));
       return 0;
@@ -161,8 +256,7 @@ int quota_set (quota_t *myquota){
       grace_dq.dqb_itime = myquota->inode_grace;
     }
 
-    retval = quotactl(myquota->_qfile, QCMD(Q_SETQUOTA, myquota->_id_type),
-                      0, (caddr_t) &grace_dq);
+    retval = quota_ctl(myquota, Q_SETQUOTA, "Q_SETQUOTA", 0, &grace_dq);
     if (retval < 0) {
       output_error("Failed setting global grace period: %s", strerror(errno));
       return 0;
@@ -179,6 +273,20 @@ int quota_set (quota_t *myquota){
   return 1;
 }
 
+/* No Q_SYNC on BSD, see quota_set() */
+void quota_sync_mode (int mode) {
+  (void) mode;
+}
+
+int quota_fs_sync (quota_fs_t *myfs) {
+  (void) myfs;
+  return 1;
+}
+
+int quota_sync_all (void) {
+  return 1;
+}
+
 int quota_reset_grace(quota_t *myquota, int grace_type) {
    quota_t temp_quota;
 
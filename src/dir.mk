@@ -7,6 +7,7 @@ dir        :=   $(dir)/src
 
 dirs       +=   $(dir)
 srcs       +=   $(wildcard $(dir)/*.c)
+libsrcs    +=   $(addprefix $(dir)/,libquotatool.c output.c parse.c record.c stats.c system.c)
 inc        +=   -I$(dir)
 auto       +=   $(wildcard $(dir)/*.in)
 libs       +=
@@ -0,0 +1,234 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * discover.c
+ * -a: find the filesystems that have quotas on
+ *
+ * The mount table says which filesystems were mounted with quota
+ * options (system_getquotafs()), only the kernel knows whether quotas
+ * are on now. Each candidate is first statvfs()ed in a thread of its
+ * own, so a dead NFS server or a stuck device blocks that thread and
+ * not the run: whatever hasn't answered when the timeout is up is left
+ * out, its thread abandoned until the process ends. The others are
+ * opened one by one, since the handle registry isn't thread safe, and
+ * a Q_GETQUOTA of id 0 per quota type, again one thread per filesystem
+ * and again with the timeout, tells which of them have quotas on.
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/statvfs.h>
+
+#include "quotatool.h"
+#include "discover.h"
+#include "output.h"
+#include "quota.h"
+#include "system.h"
+
+struct _discover_round_t;
+
+struct _discover_job_t {
+  char *mount_pt;
+  int answered;			/* statvfs() returned, under the round's lock */
+  quota_fs_t *fs;		/* NULL if left out */
+  const int *q_types;
+  int type_count;
+  int probed;			/* quota_get() returned, under the round's lock */
+  int active;			/* quotas of one of q_types are on, set with probed */
+  struct _discover_round_t *round;
+};
+
+/* the jobs of one discover_quotafs(); not freed while threads
+ * that didn't answer in time may still write to it */
+struct _discover_round_t {
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  int pending;			/* statvfs()s not returned */
+  int probing;			/* quota_get()s not returned */
+  struct _discover_job_t *jobs;
+};
+
+static const int discover_all_types[] = {
+  QUOTA_USER, QUOTA_GROUP,
+#ifdef QUOTA_PROJECT
+  QUOTA_PROJECT,
+#endif
+};
+
+
+
+/* does the filesystem answer at all. An error is an answer too,
+ * the quotactl()s will tell what it is worth */
+static void *discover_stat (void *arg) {
+  struct _discover_job_t *job = (struct _discover_job_t *) arg;
+  struct statvfs st;
+
+  statvfs (job->mount_pt, &st);
+  pthread_mutex_lock (&job->round->lock);
+  job->answered = 1;
+  job->round->pending--;
+  pthread_cond_signal (&job->round->done);
+  pthread_mutex_unlock (&job->round->lock);
+  return NULL;
+}
+
+/* are quotas of one of its types on. Whatever fails is quietly left
+ * out, messages are captured (and dropped) for this thread only */
+static void *discover_quota (void *arg) {
+  struct _discover_job_t *job = (struct _discover_job_t *) arg;
+  output_capture_t quiet = { NULL, 0 };
+  quota_t *quota;
+  int active, i;
+
+  output_capture (&quiet);
+  active = 0;
+  for (i = 0; i < job->type_count && ! active; i++) {
+    if ( (quota = quota_new(job->fs, job->q_types[i], 0)) ) {
+      active = quota_get (quota);
+      quota_delete (quota);
+    }
+  }
+  output_capture (NULL);
+  pthread_mutex_lock (&job->round->lock);
+  job->active = active;
+  job->probed = 1;
+  job->round->probing--;
+  pthread_cond_signal (&job->round->done);
+  pthread_mutex_unlock (&job->round->lock);
+  return NULL;
+}
+
+/* wait until count of the round is 0 or timeout seconds
+ * have passed, with the round's lock held */
+static void discover_wait (struct _discover_round_t *round, int *count, int timeout) {
+  struct timespec deadline;
+
+  clock_gettime (CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout;
+  while ( *count > 0 ) {
+    if ( pthread_cond_timedwait(&round->done, &round->lock, &deadline) == ETIMEDOUT ) {
+      break;
+    }
+  }
+}
+
+
+
+char **discover_quotafs (const int *q_types, int type_count, int timeout, int *count) {
+  struct _discover_round_t *round;
+  struct _discover_job_t *jobs;
+  pthread_t thread;
+  char **candidates, **list;
+  int candidate_count, abandoned, found, i, j;
+
+  *count = 0;
+  candidates = system_getquotafs (&candidate_count);
+  if ( ! candidate_count ) {
+    free (candidates);
+    return NULL;
+  }
+  if ( ! type_count ) {
+    q_types = discover_all_types;
+    type_count = (int) (sizeof(discover_all_types) / sizeof(discover_all_types[0]));
+  }
+
+  round = (struct _discover_round_t *) calloc (1, sizeof(struct _discover_round_t));
+  jobs = (struct _discover_job_t *) calloc (candidate_count, sizeof(struct _discover_job_t));
+  list = (char **) calloc (candidate_count + 1, sizeof(char *));
+  if ( ! round || ! jobs || ! list ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  pthread_mutex_init (&round->lock, NULL);
+  pthread_cond_init (&round->done, NULL);
+  round->jobs = jobs;
+
+  /* 1: who answers, all at once, for at most timeout seconds */
+  for (i = 0; i < candidate_count; i++) {
+    jobs[i].mount_pt = candidates[i];
+    jobs[i].q_types = q_types;
+    jobs[i].type_count = type_count;
+    jobs[i].round = round;
+    pthread_mutex_lock (&round->lock);
+    round->pending++;
+    pthread_mutex_unlock (&round->lock);
+    if ( pthread_create(&thread, NULL, discover_stat, &jobs[i]) ) {
+      discover_stat (&jobs[i]);
+    }
+    else {
+      pthread_detach (thread);
+    }
+  }
+  pthread_mutex_lock (&round->lock);
+  discover_wait (round, &round->pending, timeout);
+  abandoned = round->pending;
+  for (i = 0; i < candidate_count; i++) {
+    if ( ! jobs[i].answered ) {
+      output_notice ("%s: no answer within %d seconds, left out", jobs[i].mount_pt, timeout);
+    }
+    else {
+      /* 2: open those that answered, one by one */
+      jobs[i].fs = quota_fs_open (jobs[i].mount_pt);
+      for (j = 0; jobs[i].fs && j < i; j++) {
+	if ( jobs[j].fs == jobs[i].fs ) {
+	  jobs[i].fs = NULL;
+	}
+      }
+    }
+  }
+  pthread_mutex_unlock (&round->lock);
+
+  /* 3: which have quotas on, all at once, for at most timeout seconds */
+  for (i = 0; i < candidate_count; i++) {
+    if ( ! jobs[i].fs ) {
+      continue;
+    }
+    pthread_mutex_lock (&round->lock);
+    round->probing++;
+    pthread_mutex_unlock (&round->lock);
+    if ( pthread_create(&thread, NULL, discover_quota, &jobs[i]) ) {
+      discover_quota (&jobs[i]);
+    }
+    else {
+      pthread_detach (thread);
+    }
+  }
+  pthread_mutex_lock (&round->lock);
+  discover_wait (round, &round->probing, timeout);
+  abandoned += round->probing;
+  found = 0;
+  for (i = 0; i < candidate_count; i++) {
+    if ( ! jobs[i].fs ) {
+      continue;
+    }
+    if ( ! jobs[i].probed ) {
+      output_notice ("%s: no quota answer within %d seconds, left out", jobs[i].mount_pt, timeout);
+    }
+    else if ( jobs[i].active ) {
+      list[found++] = jobs[i].mount_pt;
+    }
+    else {
+      output_info ("%s: no quotas on, left out", jobs[i].mount_pt);
+    }
+  }
+  pthread_mutex_unlock (&round->lock);
+  output_info ("%d of %d filesystems mounted with quotas have them on", found, candidate_count);
+
+  /* the strings live on, in list and in abandoned jobs */
+  free (candidates);
+  if ( ! abandoned ) {
+    pthread_mutex_destroy (&round->lock);
+    pthread_cond_destroy (&round->done);
+    free (jobs);
+    free (round);
+  }
+  *count = found;
+  return list;
+}
@@ -0,0 +1,25 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * discover.h
+ * -a: find the filesystems that have quotas on
+ */
+#ifndef INCLUDE_QUOTATOOL_DISCOVER
+#define INCLUDE_QUOTATOOL_DISCOVER 1
+
+#include <config.h>
+
+/* seconds a filesystem may take to answer, --probe-timeout */
+#define DISCOVER_TIMEOUT  5
+
+/* mount points of the filesystems mounted with quota options that
+ * answer within timeout seconds and have quotas of one of the
+ * type_count q_types on (any type if type_count is 0). NULL
+ * terminated, free() it; count is set to its length */
+char **discover_quotafs (const int *q_types, int type_count, int timeout, int *count);
+
+#endif /* INCLUDE_QUOTATOOL_DISCOVER */
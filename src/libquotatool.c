@@ -0,0 +1,509 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * libquotatool.c
+ * the library API, on top of quota.c, system.c and parse.c
+ *
+ * quota_fs_open() and the mount table aren't thread safe, one lock
+ * covers opening and closing. Everything else on a filesystem only
+ * touches its own quota_fs_t, so each filesystem has a lock of its
+ * own and calls on different filesystems run side by side, like the
+ * workers in run.c. Messages the core would print are captured per
+ * thread with output_capture() and handed back in the qt_error.
+ */
+#include <config.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libquotatool.h"
+#include "output.h"
+#include "parse.h"
+#include "quota.h"
+#include "quotatool.h"
+#include "system.h"
+
+#ifndef ENOTSUP
+#define ENOTSUP EOPNOTSUPP
+#endif
+
+#define QT_STR(x)   #x
+#define QT_XSTR(x)  QT_STR(x)
+
+/* the other way round from BLOCKS_TO_KB() */
+#define QT_KB_TO_BLOCKS(kb) DIV_UP((u_int64_t) (kb) * 1024, BLOCK_SIZE)
+
+/* quota_fs_open() hands out one quota_fs_t per filesystem,
+ * so does qt_fs_open(): opened twice, closed twice */
+struct _qt_fs {
+  quota_fs_t *fs;
+  int refs;
+  pthread_mutex_t lock;		/* one call at a time on fs */
+  struct _qt_fs *next;
+};
+
+static struct _qt_fs *qt_open_list = NULL;
+static pthread_mutex_t qt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* one call into the core, capturing what it says */
+typedef struct {
+  qt_error *err;
+  char message[QT_MESSAGE_MAX];
+  output_capture_t capture;
+} qt_call_t;
+
+
+
+static void qt_begin (qt_call_t *call, qt_error *err) {
+  call->err = err;
+  call->capture.buf = call->message;
+  call->capture.size = sizeof(call->message);
+  output_capture (&call->capture);
+  errno = 0;
+}
+
+/*
+ * qt_end
+ * stop capturing, fill in call->err and return code
+ */
+static int qt_end (qt_call_t *call, int code, int sys_errno) {
+  output_capture (NULL);
+  if ( call->err ) {
+    call->err->code = code;
+    call->err->sys_errno = code == QT_OK ? 0 : sys_errno;
+    snprintf (call->err->message, sizeof(call->err->message), "%s",
+	      code == QT_OK ? "" : call->message[0] ? call->message : qt_strerror(code));
+  }
+  return code;
+}
+
+/*
+ * qt_fail
+ * qt_end() for a core call that failed with errno e,
+ * fallback is the code when e doesn't say more
+ */
+static int qt_fail (qt_call_t *call, int e, int fallback) {
+  int code;
+
+  switch ( e ) {
+  case EPERM:
+  case EACCES:
+    code = QT_ERR_PERM;
+    break;
+  case ENOMEM:
+    code = QT_ERR_MEM;
+    break;
+  case ENOSYS:
+  case ENOTSUP:
+  case ESRCH:			/* quotas are off */
+    code = QT_ERR_NOTSUP;
+    break;
+  case EROFS:
+    code = QT_ERR_NOFS;
+    break;
+  default:
+    code = fallback;
+  }
+  return qt_end (call, code, e);
+}
+
+/* QT_USER etc. as QUOTA_USER etc., 0 if this platform has no such quotas */
+static int qt_type (int type) {
+  switch ( type ) {
+  case QT_USER:
+    return QUOTA_USER;
+  case QT_GROUP:
+    return QUOTA_GROUP;
+#ifdef QUOTA_PROJECT
+  case QT_PROJECT:
+    return QUOTA_PROJECT;
+#endif
+  }
+  return 0;
+}
+
+static void qt_copy_quota (const quota_t *quota, qt_quota *out) {
+  out->block_used = DIV_UP(quota->diskspace_used, 1024);
+  out->block_soft = BLOCKS_TO_KB(quota->block_soft);
+  out->block_hard = BLOCKS_TO_KB(quota->block_hard);
+  out->inode_used = quota->inode_used;
+  out->inode_soft = quota->inode_soft;
+  out->inode_hard = quota->inode_hard;
+#if ANY_BSD
+  /* stale timers stay behind under the limits, see run_dump_line() */
+  out->block_expires = (quota->block_soft && BYTES_TO_BLOCKS(quota->diskspace_used) >= quota->block_soft)
+    || (quota->block_hard && BYTES_TO_BLOCKS(quota->diskspace_used) >= quota->block_hard)
+    ? quota->block_time : 0;
+  out->inode_expires = (quota->inode_soft && quota->inode_used >= quota->inode_soft)
+    || (quota->inode_hard && quota->inode_used >= quota->inode_hard)
+    ? quota->inode_time : 0;
+#else
+  out->block_expires = quota->block_time;
+  out->inode_expires = quota->inode_time;
+#endif /* ANY_BSD */
+}
+
+/*
+ * qt_start
+ * check the arguments shared by the per-id calls, lock fs and make
+ * a quota_t for id. Returns QT_OK, or the code qt_end() returned
+ */
+static int qt_start (qt_call_t *call, qt_fs *fs, int type, unsigned int id, quota_t **quota) {
+  int q_type, e;
+
+  if ( ! fs ) {
+    return qt_end (call, QT_ERR_ARG, 0);
+  }
+  if ( ! (q_type = qt_type(type)) ) {
+    output_error ("Unknown quota type: %d", type);
+    return qt_end (call, QT_ERR_ARG, 0);
+  }
+  pthread_mutex_lock (&fs->lock);
+  if ( ! (*quota = quota_new(fs->fs, q_type, (int) id)) ) {
+    e = errno;
+    pthread_mutex_unlock (&fs->lock);
+    return qt_fail (call, e, QT_ERR_NOTSUP);
+  }
+  return QT_OK;
+}
+
+/* quota_delete() and unlock what qt_start() locked */
+static void qt_finish (qt_fs *fs, quota_t *quota) {
+  quota_delete (quota);
+  pthread_mutex_unlock (&fs->lock);
+}
+
+
+
+int qt_fs_open (const char *fs_spec, qt_fs **fs, qt_error *err) {
+  qt_call_t call;
+  quota_fs_t *myfs;
+  struct _qt_fs *ent;
+  int e;
+
+  qt_begin (&call, err);
+  if ( ! fs_spec || ! fs ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+
+  pthread_mutex_lock (&qt_lock);
+  if ( ! (myfs = quota_fs_open((char *) fs_spec)) ) {
+    e = errno;
+    pthread_mutex_unlock (&qt_lock);
+    return qt_fail (&call, e, QT_ERR_NOFS);
+  }
+  for (ent = qt_open_list; ent && ent->fs != myfs; ent = ent->next);
+  if ( ent ) {
+    ent->refs++;
+  }
+  else if ( (ent = (struct _qt_fs *) calloc (1, sizeof(struct _qt_fs))) ) {
+    ent->fs = myfs;
+    ent->refs = 1;
+    pthread_mutex_init (&ent->lock, NULL);
+    ent->next = qt_open_list;
+    qt_open_list = ent;
+  }
+  else {
+    quota_fs_close (myfs);
+    pthread_mutex_unlock (&qt_lock);
+    output_error ("Insufficient memory");
+    return qt_end (&call, QT_ERR_MEM, ENOMEM);
+  }
+  pthread_mutex_unlock (&qt_lock);
+
+  *fs = ent;
+  return qt_end (&call, QT_OK, 0);
+}
+
+int qt_fs_close (qt_fs *fs, qt_error *err) {
+  struct _qt_fs **link;
+  qt_call_t call;
+  int synced, e;
+
+  qt_begin (&call, err);
+  if ( ! fs ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+
+  pthread_mutex_lock (&qt_lock);
+  if ( --fs->refs > 0 ) {
+    pthread_mutex_unlock (&qt_lock);
+    return qt_end (&call, QT_OK, 0);
+  }
+  for (link = &qt_open_list; *link; link = &(*link)->next) {
+    if ( *link == fs ) {
+      *link = fs->next;
+      break;
+    }
+  }
+  synced = quota_fs_sync (fs->fs);
+  e = errno;
+  quota_fs_close (fs->fs);
+  pthread_mutex_unlock (&qt_lock);
+
+  pthread_mutex_destroy (&fs->lock);
+  free (fs);
+  return synced ? qt_end (&call, QT_OK, 0) : qt_fail (&call, e, QT_ERR_SYS);
+}
+
+const char *qt_fs_mount_point (const qt_fs *fs) {
+  return fs->fs->_mnt.mount_pt;
+}
+
+const char *qt_fs_device (const qt_fs *fs) {
+  return fs->fs->_mnt.device;
+}
+
+
+
+int qt_get (qt_fs *fs, int type, unsigned int id, qt_quota *out, qt_error *err) {
+  qt_call_t call;
+  quota_t *quota;
+  int code, e;
+
+  qt_begin (&call, err);
+  if ( ! out ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  if ( (code = qt_start(&call, fs, type, id, &quota)) != QT_OK ) {
+    return code;
+  }
+  if ( ! quota_get(quota) ) {
+    e = errno;
+    qt_finish (fs, quota);
+    return qt_fail (&call, e, QT_ERR_SYS);
+  }
+  qt_copy_quota (quota, out);
+  qt_finish (fs, quota);
+  return qt_end (&call, QT_OK, 0);
+}
+
+int qt_set (qt_fs *fs, int type, unsigned int id, const qt_quota *limits,
+	    int what, qt_error *err) {
+  qt_call_t call;
+  quota_t *quota;
+  int code, e;
+
+  qt_begin (&call, err);
+  if ( ! limits || ! what || (what & ~(QT_BLOCKS | QT_INODES)) ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  if ( (code = qt_start(&call, fs, type, id, &quota)) != QT_OK ) {
+    return code;
+  }
+  /* the old formats write usage back too, it has to be current */
+  if ( ! quota_get(quota) ) {
+    e = errno;
+    qt_finish (fs, quota);
+    return qt_fail (&call, e, QT_ERR_SYS);
+  }
+  if ( what & QT_BLOCKS ) {
+    quota->block_soft = QT_KB_TO_BLOCKS(limits->block_soft);
+    quota->block_hard = QT_KB_TO_BLOCKS(limits->block_hard);
+  }
+  if ( what & QT_INODES ) {
+    quota->inode_soft = limits->inode_soft;
+    quota->inode_hard = limits->inode_hard;
+  }
+  if ( ! quota_set(quota) ) {
+    e = errno;
+    qt_finish (fs, quota);
+    return qt_fail (&call, e, QT_ERR_SYS);
+  }
+  qt_finish (fs, quota);
+  return qt_end (&call, QT_OK, 0);
+}
+
+/*
+ * qt_next
+ * like run_dump_all(): walk the kernel's list of ids,
+ * skipping records with neither usage nor limits
+ */
+int qt_next (qt_fs *fs, int type, unsigned int *id, qt_quota *out, qt_error *err) {
+  qt_call_t call;
+  quota_t *quota;
+  int found, code, e;
+
+  qt_begin (&call, err);
+  if ( ! id || ! out ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  if ( (code = qt_start(&call, fs, type, *id, &quota)) != QT_OK ) {
+    return code;
+  }
+  while ( (found = quota_get_next(quota)) > 0 ) {
+    if ( quota->diskspace_used || quota->block_soft || quota->block_hard
+	 || quota->inode_used || quota->inode_soft || quota->inode_hard ) {
+      break;
+    }
+    /* the highest possible id, don't wrap around to 0 */
+    if ( (unsigned int) quota->_id == (unsigned int) -1 ) {
+      found = 0;
+      break;
+    }
+    quota->_id++;
+  }
+  if ( found < 0 ) {
+    e = errno;
+    qt_finish (fs, quota);
+    return qt_fail (&call, e, QT_ERR_SYS);
+  }
+  if ( found ) {
+    *id = (unsigned int) quota->_id;
+    qt_copy_quota (quota, out);
+  }
+  qt_finish (fs, quota);
+  return qt_end (&call, found ? QT_OK : QT_END, 0);
+}
+
+int qt_reset_grace (qt_fs *fs, int type, unsigned int id, int what, qt_error *err) {
+  qt_call_t call;
+  quota_t *quota;
+  int code, e;
+
+  qt_begin (&call, err);
+  if ( what != QT_BLOCKS && what != QT_INODES ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  if ( (code = qt_start(&call, fs, type, id, &quota)) != QT_OK ) {
+    return code;
+  }
+  if ( ! quota_get(quota) || ! quota_get_grace(quota)
+       || ! quota_reset_grace(quota, what == QT_BLOCKS ? GRACE_BLOCK : GRACE_INODE) ) {
+    e = errno;
+    qt_finish (fs, quota);
+    return qt_fail (&call, e, QT_ERR_SYS);
+  }
+  qt_finish (fs, quota);
+  return qt_end (&call, QT_OK, 0);
+}
+
+int qt_get_grace (qt_fs *fs, int type, long long *block_grace, long long *inode_grace,
+		  qt_error *err) {
+  qt_call_t call;
+  quota_t *quota;
+  int code, e;
+
+  qt_begin (&call, err);
+  if ( (code = qt_start(&call, fs, type, 0, &quota)) != QT_OK ) {
+    return code;
+  }
+  /* the old format keeps them in each id's record, take root's */
+  if ( ! quota_get(quota) || ! quota_get_grace(quota) ) {
+    e = errno;
+    qt_finish (fs, quota);
+    return qt_fail (&call, e, QT_ERR_SYS);
+  }
+  if ( block_grace ) {
+    *block_grace = quota->block_grace;
+  }
+  if ( inode_grace ) {
+    *inode_grace = quota->inode_grace;
+  }
+  qt_finish (fs, quota);
+  return qt_end (&call, QT_OK, 0);
+}
+
+int qt_sync (qt_fs *fs, qt_error *err) {
+  qt_call_t call;
+  int synced, e;
+
+  qt_begin (&call, err);
+  if ( ! fs ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  pthread_mutex_lock (&fs->lock);
+  synced = quota_fs_sync (fs->fs);
+  e = errno;
+  pthread_mutex_unlock (&fs->lock);
+  return synced ? qt_end (&call, QT_OK, 0) : qt_fail (&call, e, QT_ERR_SYS);
+}
+
+
+
+/*
+ * qt_parse_limit
+ * parse_size() with the block limits in KiB. parse_size() takes
+ * a string without a number as "no change", here it's an error
+ */
+int qt_parse_limit (const char *string, int what, unsigned long long current,
+		    unsigned long long *value, qt_error *err) {
+  qt_call_t call;
+  const char *cp;
+  u_int64_t size;
+
+  qt_begin (&call, err);
+  if ( ! string || ! value || (what != QT_BLOCKS && what != QT_INODES) ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  cp = (*string == '+' || *string == '-') ? string + 1 : string;
+  if ( ! isdigit((unsigned char) *cp) && *cp != '.' ) {
+    output_error ("Invalid size: %s", string);
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+
+  if ( what == QT_BLOCKS ) {
+    size = parse_size (QT_KB_TO_BLOCKS(current), (char *) string, PARSE_BLOCKS);
+  }
+  else {
+    size = parse_size (current, (char *) string, PARSE_INODES);
+  }
+  if ( size == (u_int64_t) -1 ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  *value = what == QT_BLOCKS ? BLOCKS_TO_KB(size) : size;
+  return qt_end (&call, QT_OK, 0);
+}
+
+int qt_parse_time (const char *string, long long current, long long *seconds,
+		   qt_error *err) {
+  qt_call_t call;
+  time_t span;
+
+  qt_begin (&call, err);
+  if ( ! string || ! seconds ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  span = parse_timespan ((time_t) current, (char *) string);
+  if ( span == (time_t) -1 ) {
+    return qt_end (&call, QT_ERR_ARG, 0);
+  }
+  *seconds = span;
+  return qt_end (&call, QT_OK, 0);
+}
+
+
+
+const char *qt_strerror (int code) {
+  switch ( code ) {
+  case QT_OK:
+    return "Success";
+  case QT_END:
+    return "No more ids";
+  case QT_ERR_ARG:
+    return "Invalid argument";
+  case QT_ERR_SYS:
+    return "System call failed";
+  case QT_ERR_MEM:
+    return "Insufficient memory";
+  case QT_ERR_PERM:
+    return "Permission denied";
+  case QT_ERR_NOTSUP:
+    return "Quotas not enabled or not supported";
+  case QT_ERR_NOFS:
+    return "No such filesystem";
+  }
+  return "Unknown error";
+}
+
+const char *qt_version (void) {
+  return QT_XSTR(MAJOR_VERSION) "." QT_XSTR(MINOR_VERSION) "." PATCHLEVEL;
+}
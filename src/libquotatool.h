@@ -0,0 +1,118 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * libquotatool.h
+ * quotatool's quota core as a library, for programs that
+ * manage quotas without running the quotatool binary
+ *
+ * Nothing here prints: every call returns QT_OK or a QT_ERR_ code and,
+ * if err isn't NULL, fills it in with the code, the errno behind it and
+ * a message. Handles on different filesystems may be used from different
+ * threads at once, calls on the same filesystem are serialized. Block
+ * amounts are KiB, times are seconds.
+ *
+ * The core this is built from still exit()s in two cases, and so ends
+ * the calling program: out of memory while indexing the mount table,
+ * the user and group names or the projects (status 4), and a
+ * QUOTATOOL_FAKE seed file that can't be read (status 2).
+ *
+ * Link with -lquotatool -lpthread. In a build configured with
+ * --enable-fake-quota, QUOTATOOL_FAKE works here too, see quotatool(8).
+ */
+#ifndef INCLUDE_LIBQUOTATOOL
+#define INCLUDE_LIBQUOTATOOL 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped when the API changes incompatibly, like the soname */
+#define QT_API_VERSION  1
+
+/* return codes; 2 to 4 are the quotatool exit codes of the same name */
+#define QT_OK           0
+#define QT_END         -1   /* qt_next(): no more ids */
+#define QT_ERR_ARG      2   /* bad argument */
+#define QT_ERR_SYS      3   /* quotactl() or another system call failed */
+#define QT_ERR_MEM      4   /* out of memory */
+#define QT_ERR_PERM     5   /* not allowed, e.g. setting quotas as non-root */
+#define QT_ERR_NOTSUP   6   /* quotas of that type are off or unsupported here */
+#define QT_ERR_NOFS     7   /* no such filesystem, or mounted read-only */
+
+/* quota types */
+#define QT_USER         1
+#define QT_GROUP        2
+#define QT_PROJECT      3
+
+/* which limits qt_set() and qt_parse_limit() are about */
+#define QT_BLOCKS       1
+#define QT_INODES       2
+
+#define QT_MESSAGE_MAX  256
+
+typedef struct {
+  int code;                     /* the QT_ERR_ code returned */
+  int sys_errno;                /* errno behind it, 0 if none */
+  char message[QT_MESSAGE_MAX]; /* what quotatool would have printed */
+} qt_error;
+
+typedef struct {
+  unsigned long long block_used;  /* KiB */
+  unsigned long long block_soft;  /* KiB, 0 = no limit */
+  unsigned long long block_hard;  /* KiB, 0 = no limit */
+  unsigned long long inode_used;
+  unsigned long long inode_soft;
+  unsigned long long inode_hard;
+  long long block_expires;        /* when the block grace period ends, 0 = not running */
+  long long inode_expires;        /* same for inodes */
+} qt_quota;
+
+/* an open filesystem */
+typedef struct _qt_fs qt_fs;
+
+/* fs_spec is a mount point, a device or any path on the filesystem.
+ * Opening a filesystem again gives the same handle, close it as often */
+int  qt_fs_open  (const char *fs_spec, qt_fs **fs, qt_error *err);
+/* Q_SYNC what qt_set() changed, then free the handle */
+int  qt_fs_close (qt_fs *fs, qt_error *err);
+const char *qt_fs_mount_point (const qt_fs *fs);
+const char *qt_fs_device (const qt_fs *fs);
+
+/* usage and limits of id; an id without a quota gets all zeros */
+int  qt_get (qt_fs *fs, int type, unsigned int id, qt_quota *quota, qt_error *err);
+/* set the block and/or inode limits of id (what: QT_BLOCKS | QT_INODES)
+ * from quota, the other fields are ignored. Needs root */
+int  qt_set (qt_fs *fs, int type, unsigned int id, const qt_quota *quota,
+	     int what, qt_error *err);
+/* the first id >= *id with usage or limits, stored in *id. Returns QT_END
+ * after the last one; to go on, ask again from *id + 1 */
+int  qt_next (qt_fs *fs, int type, unsigned int *id, qt_quota *quota, qt_error *err);
+/* restart the block or inode (what) grace period of id, like -r */
+int  qt_reset_grace (qt_fs *fs, int type, unsigned int id, int what, qt_error *err);
+/* the filesystem's grace periods for type, in seconds (either may be NULL) */
+int  qt_get_grace (qt_fs *fs, int type, long long *block_grace, long long *inode_grace,
+		   qt_error *err);
+/* write out the quota changes so far, qt_fs_close() does it anyway */
+int  qt_sync (qt_fs *fs, qt_error *err);
+
+/* quotatool's -q/-l and -t syntax: "10M", "+1G", "2days"... relative
+ * to current. Block limits are KiB (what: QT_BLOCKS or QT_INODES) */
+int  qt_parse_limit (const char *string, int what, unsigned long long current,
+		     unsigned long long *value, qt_error *err);
+int  qt_parse_time (const char *string, long long current, long long *seconds,
+		    qt_error *err);
+
+/* a short description of a return code */
+const char *qt_strerror (int code);
+/* the library version, "major.minor.patchlevel" */
+const char *qt_version (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_LIBQUOTATOOL */
@@ -13,6 +13,7 @@ auto       +=   $(wildcard $(dir)/*.in)
 ifeq "$(build_platform)" "$(thisdir)"
 
 srcs       +=   $(wildcard $(dir)/*.c)
+libsrcs    +=   $(wildcard $(dir)/*.c)
 inc        +=   -I$(dir)
 libs       +=   
 subdirs    :=   
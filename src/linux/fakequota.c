@@ -0,0 +1,845 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * fakequota.c
+ * an in-memory stand-in for the kernel's quotactl(), for tests and
+ * benchmarks without root, loop devices or quota-enabled filesystems
+ *
+ * With QUOTATOOL_FAKE=seedfile, the mount table is the fake mounts of
+ * the seed file and every quotactl() goes to a hash table per mount and
+ * quota type instead of the kernel. All four command sets quotatool
+ * speaks are there: generic (with Q_GETNEXTQUOTA), vfsv0, old and XFS,
+ * each in its own units, and grace timers start and stop the way the
+ * kernel does it. Nothing is written back, changes last as long as the
+ * process (a --batch or --serve run).
+ *
+ * The seed file, one statement per line, '#' starts a comment:
+ *
+ *   mount MOUNTPOINT FSTYPE FORMAT [OPTIONS [DEVICE]]
+ *     FORMAT vfsold, vfsv0, vfsv1 or kernel: the generic interface,
+ *     told apart by Q_GETFMT; v0: the 2.4 interface; old: the 2.2 one;
+ *     xfs. The quota options in OPTIONS say which types are on, the
+ *     default is rw,usrquota,grpquota,prjquota, without prjquota for
+ *     vfsold, v0 and old: they have no project quotas. DEVICE defaults
+ *     to MOUNTPOINT.
+ *   grace TYPE FILESYSTEM BLOCK_GRACE INODE_GRACE
+ *     grace periods in seconds, a week if not given
+ *   latency MICROSECONDS [COMMAND]
+ *     time every quotactl(), or only COMMAND (Q_GETQUOTA etc), takes;
+ *     QUOTATOOL_FAKE_LATENCY sets it for all commands too
+ *   TYPE ID FILESYSTEM BLOCK_USED BLOCK_SOFT BLOCK_HARD BLOCK_GRACE
+ *        INODE_USED INODE_SOFT INODE_HARD INODE_GRACE
+ *     a quota: TYPE user, group or project, blocks in KB, grace in
+ *     seconds left. These are the fields of -D --output csv: a line
+ *     without blanks is split at commas, its header line is skipped,
+ *     so a dump of a real filesystem seeds a fake one.
+ *
+ * FILESYSTEM is the mount point or device of an earlier mount line.
+ */
+#include <config.h>
+
+#if ENABLE_FAKE_QUOTA
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/sysmacros.h>	/* makedev() */
+
+#include "output.h"
+#include "quota.h"
+#include "quotatool.h"
+#include "fakequota.h"
+
+#define FAKE_GRACE        (7 * 24 * 60 * 60)
+#define FAKE_LATENCY_MAX  16
+#define FAKE_LINE_MAX     (2 * PATH_MAX + 512)
+
+/* mount options without OPTIONS: the quota types the format has */
+#define FAKE_OPTS         "rw,usrquota,grpquota,prjquota"
+#define FAKE_OPTS_NO_PRJ  "rw,usrquota,grpquota"
+
+/* the FORMAT of a mount line */
+static const struct {
+  const char *name;
+  int format;			/* QF_* */
+  int iface;			/* IFACE_*, 0 for XFS */
+  int getfmt;			/* Q_GETFMT answer */
+  const char *opts;		/* default mount options */
+} fake_formats[] = {
+  { "vfsold", QF_VFSOLD, IFACE_GENERIC, 1, FAKE_OPTS_NO_PRJ },
+  { "vfsv0",  QF_VFSV0,  IFACE_GENERIC, 2, FAKE_OPTS },
+  { "vfsv1",  QF_VFSV1,  IFACE_GENERIC, 4, FAKE_OPTS },
+  { "kernel", QF_KERNEL, IFACE_GENERIC, 5, FAKE_OPTS },
+  { "v0",     QF_VFSV0,  IFACE_VFSV0,   0, FAKE_OPTS_NO_PRJ },
+  { "old",    QF_VFSOLD, IFACE_VFSOLD,  0, FAKE_OPTS_NO_PRJ },
+  { "xfs",    QF_XFS,    0,             0, FAKE_OPTS },
+  { NULL,     0,         0,             0, NULL }
+};
+
+/* mount options that turn on each quota type */
+static const char *const fake_type_opts[MAXQUOTAS][8] = {
+  { "usrquota", "usrjquota", "quota", "uquota", "uqnoenforce", "userquota", "qnoenforce", NULL },
+  { "grpquota", "grpjquota", "gquota", "gqnoenforce", "groupquota", NULL },
+  { "prjquota", "pquota", "pqnoenforce", NULL }
+};
+
+static const char *const fake_type_names[MAXQUOTAS] = { "user", "group", "project" };
+
+typedef struct {
+  u_int32_t id;
+  u_int64_t bhard, bsoft;	/* 1K blocks */
+  u_int64_t space;		/* bytes */
+  u_int64_t ihard, isoft, inodes;
+  time_t btime, itime;		/* when grace runs out, 0 if not running */
+} fake_dquot_t;
+
+/* the quotas of one type on one filesystem */
+typedef struct {
+  int enabled;
+  time_t bgrace, igrace;
+  fake_dquot_t *dq;
+  size_t count, allocated;
+  u_int32_t *hash;		/* index + 1 into dq, 0 is a free slot */
+  size_t hash_size;		/* a power of two, over twice count */
+  u_int64_t *order;		/* id << 32 | index, sorted, for GETNEXT */
+  size_t ordered;		/* entries in order, count when it is current */
+} fake_table_t;
+
+typedef struct {
+  fake_mount_t mnt;
+  int format;			/* index into fake_formats */
+  fake_table_t table[MAXQUOTAS];
+} fake_fs_t;
+
+static fake_fs_t *fake_fs = NULL;
+static int fake_fs_count = 0;
+
+/* quotactl() takes this long: per command, and all others */
+static struct {
+  int cmd;
+  unsigned long us;
+} fake_latency[FAKE_LATENCY_MAX];
+static int fake_latency_count = 0;
+static unsigned long fake_latency_default = 0;
+
+static int fake_state = 0;
+static pthread_once_t fake_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fake_quota_load (void);
+
+
+
+int fake_quota_active (void) {
+  pthread_once (&fake_once, fake_quota_load);
+  return fake_state;
+}
+
+const fake_mount_t *fake_quota_mount (int i) {
+  if ( ! fake_quota_active() || i < 0 || i >= fake_fs_count ) {
+    return NULL;
+  }
+  return &fake_fs[i].mnt;
+}
+
+static fake_fs_t *fake_quota_fs (const char *spec) {
+  int i;
+
+  for (i = 0; i < fake_fs_count; i++) {
+    if ( ! strcmp(fake_fs[i].mnt.mount_pt, spec) || ! strcmp(fake_fs[i].mnt.source, spec) ) {
+      return &fake_fs[i];
+    }
+  }
+  return NULL;
+}
+
+
+
+/*
+ * fake_find
+ * the quota of id, NULL if there is none
+ */
+static fake_dquot_t *fake_find (fake_table_t *t, u_int32_t id) {
+  size_t h;
+
+  if ( ! t->hash_size ) {
+    return NULL;
+  }
+  for (h = (id * 2654435761u) & (t->hash_size - 1); t->hash[h];
+       h = (h + 1) & (t->hash_size - 1)) {
+    if ( t->dq[t->hash[h] - 1].id == id ) {
+      return &t->dq[t->hash[h] - 1];
+    }
+  }
+  return NULL;
+}
+
+static void fake_hash_put (fake_table_t *t, size_t i) {
+  size_t h;
+
+  for (h = (t->dq[i].id * 2654435761u) & (t->hash_size - 1); t->hash[h];
+       h = (h + 1) & (t->hash_size - 1));
+  t->hash[h] = (u_int32_t) i + 1;
+}
+
+/*
+ * fake_get
+ * the quota of id, a new empty one if there is none
+ */
+static fake_dquot_t *fake_get (fake_table_t *t, u_int32_t id) {
+  fake_dquot_t *dq;
+  size_t i;
+
+  if ( (dq = fake_find(t, id)) ) {
+    return dq;
+  }
+  if ( t->count == t->allocated ) {
+    t->allocated = t->allocated ? t->allocated * 2 : 64;
+    t->dq = (fake_dquot_t *) realloc (t->dq, t->allocated * sizeof(fake_dquot_t));
+    if ( ! t->dq ) {
+      output_error ("Insufficient memory");
+      exit (ERR_MEM);
+    }
+  }
+  if ( 2 * (t->count + 1) > t->hash_size ) {
+    free (t->hash);
+    t->hash_size = t->hash_size ? t->hash_size * 2 : 128;
+    t->hash = (u_int32_t *) calloc (t->hash_size, sizeof(u_int32_t));
+    if ( ! t->hash ) {
+      output_error ("Insufficient memory");
+      exit (ERR_MEM);
+    }
+    for (i = 0; i < t->count; i++) {
+      fake_hash_put (t, i);
+    }
+  }
+  dq = &t->dq[t->count];
+  memset (dq, 0, sizeof(fake_dquot_t));
+  dq->id = id;
+  fake_hash_put (t, t->count++);
+  return dq;
+}
+
+static int fake_empty (const fake_dquot_t *dq) {
+  return ! (dq->bhard || dq->bsoft || dq->space || dq->ihard || dq->isoft || dq->inodes);
+}
+
+static int fake_order_cmp (const void *a, const void *b) {
+  u_int64_t x = *(const u_int64_t *) a, y = *(const u_int64_t *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/*
+ * fake_next
+ * the quota with the lowest id >= id that has usage or limits,
+ * like the kernel's list of ids for Q_GETNEXTQUOTA
+ */
+static fake_dquot_t *fake_next (fake_table_t *t, u_int32_t id) {
+  size_t lo, hi, mid, i;
+
+  if ( t->ordered != t->count ) {
+    t->order = (u_int64_t *) realloc (t->order, (t->count + 1) * sizeof(u_int64_t));
+    if ( ! t->order ) {
+      output_error ("Insufficient memory");
+      exit (ERR_MEM);
+    }
+    for (i = 0; i < t->count; i++) {
+      t->order[i] = (u_int64_t) t->dq[i].id << 32 | i;
+    }
+    qsort (t->order, t->count, sizeof(u_int64_t), fake_order_cmp);
+    t->ordered = t->count;
+  }
+  lo = 0;
+  hi = t->count;
+  while ( lo < hi ) {
+    mid = lo + (hi - lo) / 2;
+    if ( (u_int32_t) (t->order[mid] >> 32) < id ) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  for ( ; lo < t->count; lo++) {
+    if ( ! fake_empty(&t->dq[t->order[lo] & 0xffffffff]) ) {
+      return &t->dq[t->order[lo] & 0xffffffff];
+    }
+  }
+  return NULL;
+}
+
+
+
+/*
+ * fake_timers
+ * start or stop the grace timers after limits or usage changed.
+ * restart: the kernel's dquot_set_dqblk() starts a new grace period
+ * for a quota over its soft limit on every change, XFS only starts
+ * one that isn't running yet.
+ */
+static void fake_timers (fake_table_t *t, fake_dquot_t *dq, int restart, int keep_btime, int keep_itime) {
+  time_t now = time (NULL);
+
+  if ( ! dq->bsoft || dq->space <= dq->bsoft * 1024 ) {
+    dq->btime = 0;
+  }
+  else if ( ! keep_btime && (restart || ! dq->btime) ) {
+    dq->btime = now + t->bgrace;
+  }
+  if ( ! dq->isoft || dq->inodes <= dq->isoft ) {
+    dq->itime = 0;
+  }
+  else if ( ! keep_itime && (restart || ! dq->itime) ) {
+    dq->itime = now + t->igrace;
+  }
+}
+
+
+
+static int fake_generic (fake_fs_t *fs, fake_table_t *t, unsigned int subcmd, u_int32_t id, void *addr) {
+  struct if_dqblk *d = (struct if_dqblk *) addr;
+  struct if_nextdqblk *n = (struct if_nextdqblk *) addr;
+  struct if_dqinfo *info = (struct if_dqinfo *) addr;
+  fake_dquot_t *dq, empty;
+
+  switch ( subcmd ) {
+  case Q_SYNC:
+    return 0;
+
+  case Q_GETFMT:
+    *(u_int32_t *) addr = (u_int32_t) fake_formats[fs->format].getfmt;
+    return 0;
+
+  case Q_GETINFO:
+    memset (info, 0, sizeof(struct if_dqinfo));
+    info->dqi_bgrace = (u_int64_t) t->bgrace;
+    info->dqi_igrace = (u_int64_t) t->igrace;
+    info->dqi_valid  = IIF_ALL;
+    return 0;
+
+  case Q_SETINFO:
+    if ( info->dqi_valid & IIF_BGRACE ) t->bgrace = (time_t) info->dqi_bgrace;
+    if ( info->dqi_valid & IIF_IGRACE ) t->igrace = (time_t) info->dqi_igrace;
+    return 0;
+
+  case Q_GETQUOTA:
+    if ( ! (dq = fake_find(t, id)) ) {
+      memset (&empty, 0, sizeof(empty));
+      dq = &empty;
+    }
+    d->dqb_bhardlimit = dq->bhard;
+    d->dqb_bsoftlimit = dq->bsoft;
+    d->dqb_curspace   = dq->space;
+    d->dqb_ihardlimit = dq->ihard;
+    d->dqb_isoftlimit = dq->isoft;
+    d->dqb_curinodes  = dq->inodes;
+    d->dqb_btime      = (u_int64_t) dq->btime;
+    d->dqb_itime      = (u_int64_t) dq->itime;
+    d->dqb_valid      = QIF_ALL;
+    return 0;
+
+  case Q_GETNEXTQUOTA:
+    if ( ! (dq = fake_next(t, id)) ) {
+      errno = ENOENT;
+      return -1;
+    }
+    n->dqb_bhardlimit = dq->bhard;
+    n->dqb_bsoftlimit = dq->bsoft;
+    n->dqb_curspace   = dq->space;
+    n->dqb_ihardlimit = dq->ihard;
+    n->dqb_isoftlimit = dq->isoft;
+    n->dqb_curinodes  = dq->inodes;
+    n->dqb_btime      = (u_int64_t) dq->btime;
+    n->dqb_itime      = (u_int64_t) dq->itime;
+    n->dqb_valid      = QIF_ALL;
+    n->dqb_id         = dq->id;
+    return 0;
+
+  case Q_SETQUOTA:
+    dq = fake_get (t, id);
+    if ( d->dqb_valid & QIF_BLIMITS ) {
+      dq->bhard = d->dqb_bhardlimit;
+      dq->bsoft = d->dqb_bsoftlimit;
+    }
+    if ( d->dqb_valid & QIF_SPACE )   dq->space  = d->dqb_curspace;
+    if ( d->dqb_valid & QIF_ILIMITS ) {
+      dq->ihard = d->dqb_ihardlimit;
+      dq->isoft = d->dqb_isoftlimit;
+    }
+    if ( d->dqb_valid & QIF_INODES )  dq->inodes = d->dqb_curinodes;
+    if ( d->dqb_valid & QIF_BTIME )   dq->btime  = (time_t) d->dqb_btime;
+    if ( d->dqb_valid & QIF_ITIME )   dq->itime  = (time_t) d->dqb_itime;
+    fake_timers (t, dq, 1, d->dqb_valid & QIF_BTIME, d->dqb_valid & QIF_ITIME);
+    return 0;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+static int fake_v0 (fake_table_t *t, unsigned int subcmd, u_int32_t id, void *addr) {
+  struct v0_kern_dqblk *d = (struct v0_kern_dqblk *) addr;
+  struct v0_kern_dqinfo *info = (struct v0_kern_dqinfo *) addr;
+  fake_dquot_t *dq, empty;
+
+  switch ( subcmd ) {
+  case Q_6_5_SYNC:
+    return 0;
+
+  case Q_V0_GETINFO:
+    memset (info, 0, sizeof(struct v0_kern_dqinfo));
+    info->dqi_bgrace = (unsigned int) t->bgrace;
+    info->dqi_igrace = (unsigned int) t->igrace;
+    return 0;
+
+  case Q_V0_SETINFO:
+  case Q_V0_SETGRACE:
+    t->bgrace = info->dqi_bgrace;
+    t->igrace = info->dqi_igrace;
+    return 0;
+
+  case Q_V0_GETQUOTA:
+    if ( ! (dq = fake_find(t, id)) ) {
+      memset (&empty, 0, sizeof(empty));
+      dq = &empty;
+    }
+    d->dqb_bhardlimit = (unsigned int) dq->bhard;
+    d->dqb_bsoftlimit = (unsigned int) dq->bsoft;
+    d->dqb_curspace   = dq->space;
+    d->dqb_ihardlimit = (unsigned int) dq->ihard;
+    d->dqb_isoftlimit = (unsigned int) dq->isoft;
+    d->dqb_curinodes  = (unsigned int) dq->inodes;
+    d->dqb_btime      = dq->btime;
+    d->dqb_itime      = dq->itime;
+    return 0;
+
+  case Q_V0_SETQUOTA:
+    /* limits and usage, like Q_SETQUOTA with QIF_LIMITS | QIF_USAGE */
+    dq = fake_get (t, id);
+    dq->bhard  = d->dqb_bhardlimit;
+    dq->bsoft  = d->dqb_bsoftlimit;
+    dq->space  = d->dqb_curspace;
+    dq->ihard  = d->dqb_ihardlimit;
+    dq->isoft  = d->dqb_isoftlimit;
+    dq->inodes = d->dqb_curinodes;
+    fake_timers (t, dq, 1, 0, 0);
+    return 0;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+/* the 2.2 interface: usage in blocks, and root's times are the grace periods */
+static int fake_old (fake_table_t *t, unsigned int subcmd, u_int32_t id, void *addr) {
+  struct old_kern_dqblk *d = (struct old_kern_dqblk *) addr;
+  fake_dquot_t *dq, empty;
+
+  switch ( subcmd ) {
+  case Q_6_5_SYNC:
+    return 0;
+
+  case Q_OLD_GETQUOTA:
+    if ( ! (dq = fake_find(t, id)) ) {
+      memset (&empty, 0, sizeof(empty));
+      dq = &empty;
+    }
+    d->dqb_bhardlimit = (u_int32_t) dq->bhard;
+    d->dqb_bsoftlimit = (u_int32_t) dq->bsoft;
+    d->dqb_curblocks  = (u_int32_t) ((dq->space + 1023) / 1024);
+    d->dqb_ihardlimit = (u_int32_t) dq->ihard;
+    d->dqb_isoftlimit = (u_int32_t) dq->isoft;
+    d->dqb_curinodes  = (u_int32_t) dq->inodes;
+    d->dqb_btime      = id ? dq->btime : t->bgrace;
+    d->dqb_itime      = id ? dq->itime : t->igrace;
+    return 0;
+
+  case Q_OLD_SETQUOTA:
+    dq = fake_get (t, id);
+    dq->bhard  = d->dqb_bhardlimit;
+    dq->bsoft  = d->dqb_bsoftlimit;
+    dq->space  = (u_int64_t) d->dqb_curblocks * 1024;
+    dq->ihard  = d->dqb_ihardlimit;
+    dq->isoft  = d->dqb_isoftlimit;
+    dq->inodes = d->dqb_curinodes;
+    if ( ! id ) {
+      if ( d->dqb_btime ) t->bgrace = d->dqb_btime;
+      if ( d->dqb_itime ) t->igrace = d->dqb_itime;
+    }
+    fake_timers (t, dq, 1, 0, 0);
+    return 0;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+/* XFS: 512 byte basic blocks, ENOENT for ids without a quota, and
+ * root's timers are the grace periods */
+static int fake_xfs (fake_table_t *t, int q_type, unsigned int subcmd, u_int32_t id, void *addr) {
+  fs_disk_quota_t *d = (fs_disk_quota_t *) addr;
+  fs_quota_stat_t *qstat = (fs_quota_stat_t *) addr;
+  fake_dquot_t *dq;
+
+  switch ( subcmd ) {
+  case Q_SYNC:
+    return 0;
+
+  case Q_XGETQSTAT:
+    memset (qstat, 0, sizeof(fs_quota_stat_t));
+    qstat->qs_version = FS_QSTAT_VERSION;
+    qstat->qs_flags = q_type == USRQUOTA ? XFS_QUOTA_UDQ_ACCT | XFS_QUOTA_UDQ_ENFD
+      : q_type == GRPQUOTA ? XFS_QUOTA_GDQ_ACCT | XFS_QUOTA_GDQ_ENFD : 0;
+    qstat->qs_incoredqs = (__u32) t->count;
+    qstat->qs_btimelimit = (__s32) t->bgrace;
+    qstat->qs_itimelimit = (__s32) t->igrace;
+    return 0;
+
+  case Q_XGETQUOTA:
+  case Q_XGETNEXTQUOTA:
+    /* root's quota is always there, it has the grace periods */
+    if ( subcmd == Q_XGETQUOTA ) {
+      dq = id ? fake_find (t, id) : fake_get (t, id);
+    }
+    else {
+      dq = fake_next (t, id);
+    }
+    if ( ! dq || (id && fake_empty(dq)) ) {
+      errno = ENOENT;
+      return -1;
+    }
+    memset (d, 0, sizeof(fs_disk_quota_t));
+    d->d_version = FS_DQUOT_VERSION;
+    d->d_id = dq->id;
+    d->d_blk_hardlimit = dq->bhard * 2;
+    d->d_blk_softlimit = dq->bsoft * 2;
+    d->d_bcount        = (dq->space + 511) / 512;
+    d->d_ino_hardlimit = dq->ihard;
+    d->d_ino_softlimit = dq->isoft;
+    d->d_icount        = dq->inodes;
+    d->d_btimer = (__s32) (dq->id ? dq->btime : t->bgrace);
+    d->d_itimer = (__s32) (dq->id ? dq->itime : t->igrace);
+    return 0;
+
+  case Q_XSETQLIM:
+    dq = fake_get (t, id);
+    if ( d->d_fieldmask & FS_DQ_BHARD ) dq->bhard = d->d_blk_hardlimit / 2;
+    if ( d->d_fieldmask & FS_DQ_BSOFT ) dq->bsoft = d->d_blk_softlimit / 2;
+    if ( d->d_fieldmask & FS_DQ_IHARD ) dq->ihard = d->d_ino_hardlimit;
+    if ( d->d_fieldmask & FS_DQ_ISOFT ) dq->isoft = d->d_ino_softlimit;
+    if ( ! id ) {
+      if ( d->d_fieldmask & FS_DQ_BTIMER ) t->bgrace = d->d_btimer;
+      if ( d->d_fieldmask & FS_DQ_ITIMER ) t->igrace = d->d_itimer;
+      return 0;
+    }
+    if ( d->d_fieldmask & FS_DQ_BTIMER ) dq->btime = d->d_btimer;
+    if ( d->d_fieldmask & FS_DQ_ITIMER ) dq->itime = d->d_itimer;
+    fake_timers (t, dq, 0, 0, 0);
+    return 0;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+
+
+int fake_quotactl (struct _quota_fs_t *myfs, int cmd, int id, void *addr) {
+  unsigned int subcmd = (unsigned int) cmd >> SUBCMDSHIFT;
+  int q_type = cmd & SUBCMDMASK;
+  unsigned long us = fake_latency_default;
+  struct timespec delay;
+  fake_fs_t *fs;
+  fake_table_t *t;
+  int i, retval;
+
+  for (i = 0; i < fake_latency_count; i++) {
+    if ( fake_latency[i].cmd == (int) subcmd ) {
+      us = fake_latency[i].us;
+      break;
+    }
+  }
+  /* outside the lock, workers on other filesystems wait at the same time */
+  if ( us ) {
+    delay.tv_sec = us / 1000000;
+    delay.tv_nsec = (long) (us % 1000000) * 1000;
+    while ( nanosleep(&delay, &delay) < 0 && errno == EINTR );
+  }
+
+  pthread_mutex_lock (&fake_lock);
+  fs = fake_quota_fs (myfs->_mnt.mount_pt);
+  if ( ! fs ) {
+    errno = ENODEV;
+    retval = -1;
+  }
+  else if ( q_type >= MAXQUOTAS ) {
+    errno = EINVAL;
+    retval = -1;
+  }
+  else if ( ! (t = &fs->table[q_type])->enabled ) {
+    errno = ESRCH;		/* quotas are off */
+    retval = -1;
+  }
+  else switch ( fake_formats[fs->format].iface ) {
+  case IFACE_GENERIC:
+    retval = fake_generic (fs, t, subcmd, (u_int32_t) id, addr);
+    break;
+  case IFACE_VFSV0:
+    retval = fake_v0 (t, subcmd, (u_int32_t) id, addr);
+    break;
+  case IFACE_VFSOLD:
+    retval = fake_old (t, subcmd, (u_int32_t) id, addr);
+    break;
+  default:
+    retval = fake_xfs (t, q_type, subcmd, (u_int32_t) id, addr);
+    break;
+  }
+  pthread_mutex_unlock (&fake_lock);
+  return retval;
+}
+
+int fake_quota_format (struct _quota_fs_t *myfs, int q_type, int *quota_format, int *kernel_iface) {
+  fake_fs_t *fs;
+
+  (void) q_type;
+  fs = fake_quota_fs (myfs->_mnt.mount_pt);
+  if ( ! fs || fake_formats[fs->format].iface == IFACE_GENERIC ) {
+    return 0;
+  }
+  *quota_format |= (1 << fake_formats[fs->format].format);
+  *kernel_iface = fake_formats[fs->format].iface;
+  return 1;
+}
+
+
+
+/*
+ * the seed file
+ */
+
+static const char *fake_file;
+static int fake_line;
+
+static void fake_fail (const char *what, const char *word) {
+  output_error ("%s, line %d: %s '%s'", fake_file, fake_line, what, word ? word : "");
+  exit (ERR_ARG);
+}
+
+static u_int64_t fake_number (const char *word) {
+  unsigned long long value;
+  char *end;
+
+  if ( ! word ) {
+    fake_fail ("missing number", NULL);
+  }
+  errno = 0;
+  value = strtoull (word, &end, 10);
+  if ( *end || end == word || errno || *word == '-' ) {
+    fake_fail ("bad number", word);
+  }
+  return (u_int64_t) value;
+}
+
+static int fake_type (const char *word) {
+  int i;
+
+  for (i = 0; i < MAXQUOTAS; i++) {
+    if ( ! strcmp(word, fake_type_names[i]) ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static char *fake_strdup (const char *str) {
+  char *copy = strdup (str);
+
+  if ( ! copy ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  return copy;
+}
+
+static int fake_hasopt (const char *opts, const char *opt) {
+  size_t len = strlen (opt);
+  const char *cp;
+
+  for (cp = opts; cp; cp = strchr(cp, ',')) {
+    if ( *cp == ',' ) cp++;
+    if ( ! strncmp(cp, opt, len) && (cp[len] == ',' || cp[len] == '=' || cp[len] == '\0') ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void fake_add_mount (char **word, int words) {
+  fake_fs_t *fs;
+  int i, j;
+
+  if ( words < 4 ) {
+    fake_fail ("mount needs a mount point, a type and a format", word[0]);
+  }
+  for (i = 0; fake_formats[i].name && strcmp(fake_formats[i].name, word[3]); i++);
+  if ( ! fake_formats[i].name ) {
+    fake_fail ("unknown quota format", word[3]);
+  }
+  if ( fake_quota_fs(word[1]) ) {
+    fake_fail ("mounted twice", word[1]);
+  }
+
+  fake_fs = (fake_fs_t *) realloc (fake_fs, (fake_fs_count + 1) * sizeof(fake_fs_t));
+  if ( ! fake_fs ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  fs = &fake_fs[fake_fs_count];
+  memset (fs, 0, sizeof(fake_fs_t));
+  fs->format = i;
+  fs->mnt.mount_pt = fake_strdup (word[1]);
+  fs->mnt.fstype   = fake_strdup (word[2]);
+  fs->mnt.opts     = fake_strdup (words > 4 ? word[4] : fake_formats[fs->format].opts);
+  fs->mnt.source   = fake_strdup (words > 5 ? word[5] : word[1]);
+  fs->mnt.dev      = makedev (0, 0x100 + fake_fs_count);
+  for (i = 0; i < MAXQUOTAS; i++) {
+    fs->table[i].bgrace = fs->table[i].igrace = FAKE_GRACE;
+    for (j = 0; fake_type_opts[i][j]; j++) {
+      if ( fake_hasopt(fs->mnt.opts, fake_type_opts[i][j]) ) {
+	fs->table[i].enabled = 1;
+      }
+    }
+  }
+  fake_fs_count++;
+}
+
+static void fake_add_quota (int q_type, char **word, int words) {
+  fake_dquot_t *dq;
+  fake_table_t *t;
+  fake_fs_t *fs;
+  u_int64_t grace;
+  time_t now = time (NULL);
+
+  if ( words != 11 ) {
+    fake_fail ("a quota needs 11 fields, has", word[words - 1]);
+  }
+  if ( ! (fs = fake_quota_fs(word[2])) ) {
+    fake_fail ("no mount line for", word[2]);
+  }
+  t = &fs->table[q_type];
+  dq = fake_get (t, (u_int32_t) fake_number(word[1]));
+  dq->space  = fake_number (word[3]) * 1024;
+  dq->bsoft  = fake_number (word[4]);
+  dq->bhard  = fake_number (word[5]);
+  grace      = fake_number (word[6]);
+  dq->btime  = grace ? now + (time_t) grace : 0;
+  dq->inodes = fake_number (word[7]);
+  dq->isoft  = fake_number (word[8]);
+  dq->ihard  = fake_number (word[9]);
+  grace      = fake_number (word[10]);
+  dq->itime  = grace ? now + (time_t) grace : 0;
+  /* a timer only runs over the soft limit, one that should run does */
+  fake_timers (t, dq, 0, 0, 0);
+}
+
+static void fake_add_latency (char **word, int words) {
+  int cmd = -1, i;
+
+  if ( words < 2 || words > 3 ) {
+    fake_fail ("latency needs microseconds and maybe a command", word[0]);
+  }
+  if ( words == 2 ) {
+    fake_latency_default = (unsigned long) fake_number (word[1]);
+    return;
+  }
+  if ( (cmd = quota_ctl_byname(word[2])) < 0 ) {
+    fake_fail ("unknown quotactl command", word[2]);
+  }
+  for (i = 0; i < fake_latency_count && fake_latency[i].cmd != cmd; i++);
+  if ( i == FAKE_LATENCY_MAX ) {
+    fake_fail ("too many latency lines at", word[2]);
+  }
+  fake_latency[i].cmd = cmd;
+  fake_latency[i].us = (unsigned long) fake_number (word[1]);
+  if ( i == fake_latency_count ) {
+    fake_latency_count++;
+  }
+}
+
+/*
+ * fake_quota_load
+ * read the seed file named by QUOTATOOL_FAKE, once
+ */
+static void fake_quota_load (void) {
+  char line[FAKE_LINE_MAX], *cp, *word[16];
+  const char *env, *sep;
+  fake_fs_t *fs;
+  FILE *fp;
+  int words, q_type;
+
+  fake_file = getenv (FAKE_QUOTA_ENV);
+  if ( ! fake_file || ! *fake_file ) {
+    return;
+  }
+  fake_state = 1;
+  fp = strcmp(fake_file, "-") ? fopen (fake_file, "r") : stdin;
+  if ( ! fp ) {
+    output_error ("Failed opening %s (%s): %s", fake_file, FAKE_QUOTA_ENV, strerror(errno));
+    exit (ERR_ARG);
+  }
+
+  for (fake_line = 1; fgets(line, sizeof(line), fp); fake_line++) {
+    if ( (cp = strchr(line, '#')) ) {
+      *cp = '\0';
+    }
+    cp = line;
+    sep = line[strcspn(line, " \t")] ? " \t\r\n" : ",\r\n";
+    for (words = 0; words < 16 && cp; ) {
+      word[words] = strsep (&cp, sep);
+      if ( *word[words] ) {
+	words++;
+      }
+    }
+    if ( ! words || ! strcmp(word[0], "type") ) {
+      continue;			/* blank, or the -D --output csv header */
+    }
+    if ( ! strcmp(word[0], "mount") ) {
+      fake_add_mount (word, words);
+    }
+    else if ( ! strcmp(word[0], "latency") ) {
+      fake_add_latency (word, words);
+    }
+    else if ( ! strcmp(word[0], "grace") ) {
+      if ( words != 5 || (q_type = fake_type(word[1])) < 0 ) {
+	fake_fail ("grace needs a type, a filesystem and two times", word[0]);
+      }
+      if ( ! (fs = fake_quota_fs(word[2])) ) {
+	fake_fail ("no mount line for", word[2]);
+      }
+      fs->table[q_type].bgrace = (time_t) fake_number (word[3]);
+      fs->table[q_type].igrace = (time_t) fake_number (word[4]);
+    }
+    else if ( (q_type = fake_type(word[0])) >= 0 ) {
+      fake_add_quota (q_type, word, words);
+    }
+    else {
+      fake_fail ("unknown statement", word[0]);
+    }
+  }
+  if ( fp != stdin ) {
+    fclose (fp);
+  }
+
+  output_debug ("Using the fake quotactl() of %s, %d filesystems", fake_file, fake_fs_count);
+  if ( (env = getenv(FAKE_QUOTA_LATENCY_ENV)) && *env ) {
+    fake_file = FAKE_QUOTA_LATENCY_ENV;
+    fake_line = 0;
+    fake_latency_default = (unsigned long) fake_number (env);
+  }
+}
+
+#endif /* ENABLE_FAKE_QUOTA */
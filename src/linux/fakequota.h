@@ -0,0 +1,58 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * fakequota.h
+ * an in-memory stand-in for the kernel's quotactl(), for tests and
+ * benchmarks without root, loop devices or quota-enabled filesystems
+ *
+ * Only built with configure --enable-fake-quota, then
+ * QUOTATOOL_FAKE=seedfile selects it at run time. See fakequota.c
+ * for the seed file.
+ */
+#ifndef INCLUDE_QUOTATOOL_FAKEQUOTA
+#define INCLUDE_QUOTATOOL_FAKEQUOTA 1
+
+#include <config.h>
+
+#include <sys/types.h>
+
+#define FAKE_QUOTA_ENV          "QUOTATOOL_FAKE"
+#define FAKE_QUOTA_LATENCY_ENV  "QUOTATOOL_FAKE_LATENCY"	/* us, every call */
+
+/* one fake mount, in the terms of /proc/self/mountinfo */
+typedef struct {
+  char *source;
+  char *mount_pt;
+  char *fstype;
+  char *opts;
+  dev_t dev;
+} fake_mount_t;
+
+struct _quota_fs_t;
+
+#if ENABLE_FAKE_QUOTA
+
+/* is QUOTATOOL_FAKE set? The first call loads the seed file */
+int  fake_quota_active (void);
+/* the i'th fake mount, NULL past the last one */
+const fake_mount_t *fake_quota_mount (int i);
+/* quota format and kernel interface of q_type on the fake filesystem,
+ * like kern_quota_format(); 0 means generic, ask with Q_GETFMT */
+int  fake_quota_format (struct _quota_fs_t *myfs, int q_type, int *quota_format, int *kernel_iface);
+/* quotactl() on the fake filesystem, -1 and errno like the kernel */
+int  fake_quotactl (struct _quota_fs_t *myfs, int cmd, int id, void *addr);
+
+#else
+
+#  define fake_quota_active()  0
+#  define fake_quota_mount(i)  ((const fake_mount_t *) NULL)
+#  define fake_quota_format(myfs, q_type, quota_format, kernel_iface)  0
+#  define fake_quotactl(myfs, cmd, id, addr)  (-1)
+
+#endif /* ENABLE_FAKE_QUOTA */
+
+#endif /* INCLUDE_QUOTATOOL_FAKEQUOTA */
@@ -0,0 +1,252 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * formatcache.c
+ * remember the detected quota format of each filesystem between runs
+ *
+ * One line per filesystem and quota type:
+ *
+ *   release mount-id major:minor q_type quota-options format interface
+ *   6.1.0-18-amd64 27 8:3 0 usrjquota=aquota.user,jqfmt=vfsv1 4 3
+ *
+ * quota-options is "-" when there are none. The file is read once per
+ * process and rewritten (to a temporary file, then renamed) when a new
+ * filesystem is detected; lines of other kernel releases are dropped
+ * then. It is only trusted if root (or we) own it and nobody else may
+ * write it. Without mountinfo there is no mount id and no caching.
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/utsname.h>
+
+#include "output.h"
+#include "quota.h"
+#include "quotatool.h"
+#include "fakequota.h"
+#include "formatcache.h"
+
+/* the most lines kept, the oldest go first */
+#define FORMAT_CACHE_MAX  256
+#define FORMAT_LINE_MAX   512
+
+typedef struct {
+  int mnt_id;
+  unsigned int maj, min;
+  int q_type;
+  char opts[256];
+  int format;
+  int iface;
+} format_ent_t;
+
+static format_ent_t *format_ents = NULL;
+static int format_count = 0;
+static int format_loaded = 0;
+static const char *format_path = NULL;	/* NULL: no cache */
+static char format_release[sizeof(((struct utsname *) 0)->release)];
+static pthread_mutex_t format_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/*
+ * format_cache_load
+ * find the cache file and read the lines for this kernel, once
+ */
+static void format_cache_load (void) {
+  char line[FORMAT_LINE_MAX], release[sizeof(format_release)];
+  struct utsname uts;
+  struct stat st;
+  format_ent_t ent, *grown;
+  const char *env;
+  FILE *fp;
+
+  format_loaded = 1;
+  env = getenv (FORMAT_CACHE_ENV);
+  if ( env ) {
+    format_path = *env ? env : NULL;
+  }
+  else if ( ! fake_quota_active() ) {
+    format_path = FORMAT_CACHE_FILE;
+  }
+  if ( ! format_path || uname(&uts) < 0 ) {
+    format_path = NULL;
+    return;
+  }
+  snprintf (format_release, sizeof(format_release), "%s", uts.release);
+
+  if ( ! (fp = fopen(format_path, "r")) ) {
+    return;
+  }
+  if ( fstat(fileno(fp), &st) < 0 || (st.st_uid != 0 && st.st_uid != geteuid())
+       || (st.st_mode & (S_IWGRP | S_IWOTH)) ) {
+    output_debug ("Not using %s: writable by others", format_path);
+    fclose (fp);
+    format_path = NULL;
+    return;
+  }
+
+  while ( fgets(line, sizeof(line), fp) ) {
+    if ( line[0] == '#' ) {
+      continue;
+    }
+    if ( sscanf(line, "%64s %d %u:%u %d %255s %d %d", release, &ent.mnt_id, &ent.maj,
+		&ent.min, &ent.q_type, ent.opts, &ent.format, &ent.iface) != 8
+	 || strcmp(release, format_release) || ent.format <= 0
+	 || ent.q_type < 0 || ent.q_type >= MAXQUOTAS ) {
+      continue;
+    }
+    if ( ! strcmp(ent.opts, "-") ) {
+      ent.opts[0] = '\0';
+    }
+    if ( format_count == FORMAT_CACHE_MAX ) {
+      break;
+    }
+    grown = (format_ent_t *) realloc (format_ents, (format_count + 1) * sizeof(format_ent_t));
+    if ( ! grown ) {
+      break;
+    }
+    format_ents = grown;
+    format_ents[format_count++] = ent;
+  }
+  fclose (fp);
+  output_debug ("Read %d quota formats from %s", format_count, format_path);
+}
+
+/* the line for q_type on myfs, NULL if there is none */
+static format_ent_t *format_cache_find (quota_fs_t *myfs, int q_type) {
+  fs_t *fs = &myfs->_mnt;
+  int i;
+
+  for (i = 0; i < format_count; i++) {
+    if ( format_ents[i].mnt_id == fs->mnt_id && format_ents[i].q_type == q_type
+	 && format_ents[i].maj == major(fs->dev) && format_ents[i].min == minor(fs->dev)
+	 && ! strcmp(format_ents[i].opts, fs->quota_opts) ) {
+      return &format_ents[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * format_cache_write
+ * replace the cache file with what is in memory
+ */
+static void format_cache_write (void) {
+  char dir[PATH_MAX], tmp[PATH_MAX + 16], *slash;
+  FILE *fp;
+  int fd, i;
+
+  strncpy (dir, format_path, sizeof(dir) - 1);
+  dir[sizeof(dir) - 1] = '\0';
+  if ( (slash = strrchr(dir, '/')) && slash != dir ) {
+    *slash = '\0';
+    if ( mkdir(dir, 0755) < 0 && errno != EEXIST ) {
+      output_debug ("Not caching quota formats: %s: %s", dir, strerror(errno));
+      return;
+    }
+  }
+
+  snprintf (tmp, sizeof(tmp), "%s.XXXXXX", format_path);
+  if ( (fd = mkstemp(tmp)) < 0 ) {
+    output_debug ("Not caching quota formats: %s: %s", tmp, strerror(errno));
+    return;
+  }
+  if ( fchmod(fd, 0644) < 0 || ! (fp = fdopen(fd, "w")) ) {
+    close (fd);
+    unlink (tmp);
+    return;
+  }
+  fprintf (fp, "# quotatool: detected quota formats, safe to delete\n");
+  for (i = 0; i < format_count; i++) {
+    fprintf (fp, "%s %d %u:%u %d %s %d %d\n", format_release, format_ents[i].mnt_id,
+	     format_ents[i].maj, format_ents[i].min, format_ents[i].q_type,
+	     format_ents[i].opts[0] ? format_ents[i].opts : "-",
+	     format_ents[i].format, format_ents[i].iface);
+  }
+  if ( fclose(fp) != 0 || rename(tmp, format_path) < 0 ) {
+    output_debug ("Not caching quota formats: %s: %s", format_path, strerror(errno));
+    unlink (tmp);
+  }
+}
+
+
+
+int format_cache_get (quota_fs_t *myfs, int q_type, int *quota_format, int *kernel_iface) {
+  format_ent_t *ent;
+  int found = 0;
+
+  if ( myfs->_mnt.mnt_id < 0 ) {
+    return 0;
+  }
+  pthread_mutex_lock (&format_lock);
+  if ( ! format_loaded ) {
+    format_cache_load ();
+  }
+  if ( format_path && (ent = format_cache_find(myfs, q_type)) ) {
+    *quota_format = ent->format;
+    *kernel_iface = ent->iface;
+    found = 1;
+  }
+  pthread_mutex_unlock (&format_lock);
+  return found;
+}
+
+void format_cache_put (quota_fs_t *myfs, int q_type, int quota_format, int kernel_iface) {
+  format_ent_t *ent, *grown;
+
+  if ( myfs->_mnt.mnt_id < 0 || quota_format <= 0 ) {
+    return;
+  }
+  pthread_mutex_lock (&format_lock);
+  if ( ! format_loaded ) {
+    format_cache_load ();
+  }
+  if ( ! format_path ) {
+    pthread_mutex_unlock (&format_lock);
+    return;
+  }
+
+  /* a remount may have reused the mount id: that line goes */
+  if ( ! (ent = format_cache_find(myfs, q_type)) ) {
+    for (ent = format_ents; ent < format_ents + format_count; ent++) {
+      if ( ent->mnt_id == myfs->_mnt.mnt_id && ent->q_type == q_type ) {
+	break;
+      }
+    }
+  }
+  if ( ent == format_ents + format_count || ! ent ) {
+    if ( format_count == FORMAT_CACHE_MAX ) {
+      memmove (format_ents, format_ents + 1, (format_count - 1) * sizeof(format_ent_t));
+      format_count--;
+    }
+    grown = (format_ent_t *) realloc (format_ents, (format_count + 1) * sizeof(format_ent_t));
+    if ( ! grown ) {
+      pthread_mutex_unlock (&format_lock);
+      return;
+    }
+    format_ents = grown;
+    ent = &format_ents[format_count++];
+  }
+
+  ent->mnt_id = myfs->_mnt.mnt_id;
+  ent->maj = major(myfs->_mnt.dev);
+  ent->min = minor(myfs->_mnt.dev);
+  ent->q_type = q_type;
+  strncpy (ent->opts, myfs->_mnt.quota_opts, sizeof(ent->opts) - 1);
+  ent->opts[sizeof(ent->opts) - 1] = '\0';
+  ent->format = quota_format;
+  ent->iface = kernel_iface;
+  format_cache_write ();
+  pthread_mutex_unlock (&format_lock);
+}
@@ -0,0 +1,31 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * formatcache.h
+ * remember the detected quota format of each filesystem between runs
+ *
+ * kern_quota_format() reads /proc and probes the kernel with
+ * quotactl()s, the answer only changes with a remount or a new kernel.
+ * The cache file is keyed by mount id, device, quota mount options and
+ * kernel release, so a stale entry simply doesn't match.
+ */
+#ifndef INCLUDE_QUOTATOOL_FORMATCACHE
+#define INCLUDE_QUOTATOOL_FORMATCACHE 1
+
+#include <config.h>
+
+#define FORMAT_CACHE_FILE  "/run/quotatool/formats"
+#define FORMAT_CACHE_ENV   "QUOTATOOL_FORMAT_CACHE"	/* another file, "" = none */
+
+struct _quota_fs_t;
+
+/* the cached format and interface of q_type on myfs, 1 if found */
+int  format_cache_get (struct _quota_fs_t *myfs, int q_type, int *quota_format, int *kernel_iface);
+/* remember them, the file is rewritten if it can be */
+void format_cache_put (struct _quota_fs_t *myfs, int q_type, int quota_format, int kernel_iface);
+
+#endif /* INCLUDE_QUOTATOOL_FORMATCACHE */
@@ -20,9 +20,10 @@
 typedef u_int32_t qid_t;	/* Type in which we store ids in memory */
 typedef u_int64_t qsize_t;	/* Type in which we store size limitations */
 
-#define MAXQUOTAS 2
+#define MAXQUOTAS 3
 #define USRQUOTA  0		/* element used for user quotas */
 #define GRPQUOTA  1		/* element used for group quotas */
+#define PRJQUOTA  2		/* element used for project quotas (XFS, ext4 4.5+) */
 
 /*
  * Command definitions for the 'quotactl' system call.
@@ -57,6 +58,7 @@ typedef u_int64_t qsize_t;	/* Type in which we store size limitations */
 #define Q_SETINFO  0x800006     /* set information about quota files */
 #define Q_GETQUOTA 0x800007     /* get user quota structure */
 #define Q_SETQUOTA 0x800008     /* set user quota structure */
+#define Q_GETNEXTQUOTA 0x800009 /* get quota structure of next id >= given id (linux 4.6+) */
 
 /*
  * Quota structure used for communication with userspace via quotactl
@@ -87,6 +89,20 @@ struct if_dqblk {
   u_int32_t dqb_valid;
 };
 
+/* Q_GETNEXTQUOTA: if_dqblk plus the id the kernel found */
+struct if_nextdqblk {
+  u_int64_t dqb_bhardlimit;
+  u_int64_t dqb_bsoftlimit;
+  u_int64_t dqb_curspace;
+  u_int64_t dqb_ihardlimit;
+  u_int64_t dqb_isoftlimit;
+  u_int64_t dqb_curinodes;
+  u_int64_t dqb_btime;
+  u_int64_t dqb_itime;
+  u_int32_t dqb_valid;
+  u_int32_t dqb_id;
+};
+
 /* version-specific info */
 struct v0_mem_dqinfo {};
 struct old_mem_dqinfo {
@@ -149,9 +165,18 @@ long quotactl (int, const char *, qid_t, caddr_t);
 #define QF_VFSV0 1              /* New quota format - version 0 */
 #define QF_VFSV1 2              /* Newer quota format - version 1 */
 #define QF_XFS 3		/* XFS quota */
+#define QF_KERNEL 4		/* Kept by the filesystem, no quota file (tmpfs, bcachefs) */
 
 #define KERN_KNOWN_QUOTA_VERSION (6*10000 + 5*100 + 2)
-int kern_quota_format(fs_t *, int);
+struct _quota_fs_t;
+int kern_quota_format(struct _quota_fs_t *, int, int *, int *);
+/* --format: skip detection, 0 if the name is unknown */
+int quota_format_force(const char *name);
+
+/* "Q_GETQUOTA" etc for a quotactl() cmd, and back to the command
+ * (without the type), -1 if unknown */
+const char *quota_ctl_name(int cmd);
+int quota_ctl_byname(const char *name);
 
 #include "dqblk_old.h"
 #include "dqblk_v0.h"
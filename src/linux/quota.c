@@ -12,142 +12,463 @@
 #include <config.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include "output.h"
 #include "system.h"
 #include "quota.h"
 #include "quotatool.h"
+#include "stats.h"
+#include "fakequota.h"
+#include "formatcache.h"
 
 #ifndef ENOTSUP
 #define ENOTSUP EOPNOTSUPP
 #endif
 
+/* quotactl_fd(), linux 5.14, missing from older headers. Only where
+ * the number is known: mips, ia64 and x32 offset their syscall tables,
+ * guessing there would call something else. Without it, device paths */
+#ifndef SYS_quotactl_fd
+#  if defined(__alpha__)
+#    define SYS_quotactl_fd 553
+#  elif (defined(__x86_64__) && ! defined(__ILP32__)) || defined(__i386__) \
+     || defined(__aarch64__) || defined(__arm__) || defined(__riscv) \
+     || defined(__powerpc__) || defined(__s390__) || defined(__loongarch__)
+#    define SYS_quotactl_fd 443
+#  endif
+#endif
+
 /* Handy macros */
 #define QF_IS_OLD(qf)     (qf & (1 << QF_VFSOLD))
 #define QF_IS_V0(qf)      (qf & (1 << QF_VFSV0))
 #define QF_IS_V1(qf)      (qf & (1 << QF_VFSV1))
 #define QF_IS_XFS(qf)     (qf & (1 << QF_XFS))
+#define QF_IS_KERNEL(qf)  (qf & (1 << QF_KERNEL))
 #define QF_IS_TOO_NEW(qf) (qf == QF_TOONEW)
-#define IF_GENERIC        (kernel_iface == IFACE_GENERIC)
+#define IF_GENERIC(iface) (iface == IFACE_GENERIC)
+
+/* format and interface of the filesystem a quota lives on */
+#define QUOTA_FORMAT(q)   ((q)->_fs->_format[(q)->_id_type])
+#define QUOTA_IFACE(q)    ((q)->_fs->_iface[(q)->_id_type])
+#define QUOTA_INFO(q)     ((q)->_fs->_quotainfo[(q)->_id_type])
+
+/* all open filesystems, for quota_sync_all() */
+static quota_fs_t *open_filesystems = NULL;
+
+/* see quota_sync_mode() */
+static int sync_mode = QUOTA_SYNC_DEFERRED;
 
-static int quota_format;
-static int kernel_iface;
+/* see quota_format_force(), 0 = detect */
+static int forced_format = 0;
+
+/* quotactl_fd(): -1 not tried yet, 0 not in this kernel, 1 works */
+#ifdef SYS_quotactl_fd
+static int fd_support = -1;
+#else
+static int fd_support = 0;
+#endif
+
+/* grace info quotactl()s made, and those quota_get() no longer makes */
+static int info_issued = 0;
+static int info_avoided = 0;
+
+/* fd_support and the info counters, shared by the threads
+ * of run_parallel() and discover_quotafs() */
+static pthread_mutex_t quota_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* quotactl() commands by name, for --stats */
+static const struct {
+    unsigned int cmd;
+    const char *name;
+} quota_ctl_names[] = {
+    { Q_SYNC,          "Q_SYNC" },
+    { Q_GETFMT,        "Q_GETFMT" },
+    { Q_GETINFO,       "Q_GETINFO" },
+    { Q_SETINFO,       "Q_SETINFO" },
+    { Q_GETQUOTA,      "Q_GETQUOTA" },
+    { Q_SETQUOTA,      "Q_SETQUOTA" },
+    { Q_GETNEXTQUOTA,  "Q_GETNEXTQUOTA" },
+    { Q_XGETQUOTA,     "Q_XGETQUOTA" },
+    { Q_XSETQLIM,      "Q_XSETQLIM" },
+    { Q_XGETQSTAT,     "Q_XGETQSTAT" },
+    { Q_XGETNEXTQUOTA, "Q_XGETNEXTQUOTA" },
+    { Q_6_5_SYNC,      "Q_6_5_SYNC" },
+    { Q_V0_GETQUOTA,   "Q_V0_GETQUOTA" },
+    { Q_V0_SETQUOTA,   "Q_V0_SETQUOTA" },
+    { Q_V0_GETINFO,    "Q_V0_GETINFO" },
+    { Q_V0_SETGRACE,   "Q_V0_SETGRACE" },
+    { Q_OLD_GETQUOTA,  "Q_OLD_GETQUOTA" },
+    { Q_OLD_SETQUOTA,  "Q_OLD_SETQUOTA" }
+};
+
+static int quota_ctl(quota_fs_t *, int, int, void *);
+static void quota_fs_pin(quota_fs_t *);
+static int quota_fd_support(void);
+static void quota_count(int *);
+static void quota_ctl_stats(int, u_int64_t);
+static int quota_fs_probe(quota_fs_t *, int);
+static int quota_fs_get_info(quota_fs_t *, int);
+static int quota_sync(quota_fs_t *, int);
 
 static int old_quota_get(quota_t *);
 static int old_quota_set(quota_t *);
 static int v0_quota_get(quota_t *);
 static int v0_quota_set(quota_t *);
 static int generic_quota_get(quota_t *);
+static int generic_quota_get_next(quota_t *);
 static int generic_quota_set(quota_t *);
 static int xfs_quota_get(quota_t *);
+static int xfs_quota_get_next(quota_t *);
 static int xfs_quota_set(quota_t *);
 
-quota_t *quota_new(int q_type, int id, char *fs_spec) {
-    quota_t *myquota;
+quota_fs_t *quota_fs_open(char *fs_spec) {
+    quota_fs_t *myfs;
     fs_t *fs;
-    char *qfile;
+    u_int64_t start;
 
-    q_type--;            /* see defs in quota.h */
-    if (q_type >= MAXQUOTAS) {
-	output_error("Unknown quota type: %d", q_type);
-	return 0;
+    start = stats_now();
+    fs = system_getfs(fs_spec);
+    stats_phase(STATS_MOUNTS, start);
+    if (! fs) {
+	return NULL;
     }
 
-    myquota = (quota_t *) calloc(1, sizeof(quota_t));
-    if (! myquota) {
-	output_error("Insufficient memory");
-	exit(ERR_MEM);
+    /* already open, maybe under another name (device vs mount point).
+     * tmpfs and the like all have the same "device", tell them apart
+     * by mount point */
+    for (myfs = open_filesystems; myfs; myfs = myfs->_next) {
+	if (! strcmp(myfs->_mnt.device, fs->device)
+	    && (fs->device[0] == '/' || ! strcmp(myfs->_mnt.mount_pt, fs->mount_pt))) {
+	    output_debug("Using open filesystem %s for %s", myfs->_qfile, fs_spec);
+	    free(fs);
+	    return myfs;
+	}
     }
 
-    fs = system_getfs(fs_spec);
-    if (! fs) {
-	free(myquota);
+    myfs = (quota_fs_t *) calloc(1, sizeof(quota_fs_t));
+    if (! myfs) {
+	output_error("Insufficient memory");
+	free(fs);
+	errno = ENOMEM;
 	return NULL;
     }
+    memcpy(&myfs->_mnt, fs, sizeof(fs_t));
+    myfs->_qfile = myfs->_mnt.device;
+    free(fs);
 
-    /*
-     * Detect quota format
-     */
-    output_debug("Detecting quota format");
-    if (kern_quota_format(fs, q_type) == QF_ERROR) {
-	output_error("Cannot determine quota format!");
-	exit(ERR_SYS);
-    }
-    if (QF_IS_TOO_NEW(quota_format)) {
+    quota_fs_pin(myfs);
+    myfs->_next = open_filesystems;
+    open_filesystems = myfs;
+    return myfs;
+}
+
+/* Q_SYNC anything still pending, then forget the filesystem */
+void quota_fs_close(quota_fs_t *myfs) {
+    quota_fs_t **link;
+    int q_type;
+
+    for (link = &open_filesystems; *link; link = &(*link)->_next) {
+	if (*link == myfs) {
+	    *link = myfs->_next;
+	    break;
+	}
+    }
+
+    for (q_type = 0; q_type < MAXQUOTAS; q_type++) {
+	if (myfs->_dirty[q_type])
+	    quota_sync(myfs, q_type);
+	free(myfs->_quotainfo[q_type]);
+    }
+    if (myfs->_fd >= 0)
+	close(myfs->_fd);
+    free(myfs);
+}
+
+/*
+ * quota_fs_pin
+ * open the mount point of myfs for quotactl_fd(), so the kernel
+ * doesn't look up the device path on every call. Failing is fine,
+ * see quota_ctl()
+ */
+static void quota_fs_pin(quota_fs_t *myfs) {
+    myfs->_fd = -1;
+    myfs->_fd_unpinned = 0;
+    if (quota_fd_support()) {
+	myfs->_fd = open(myfs->_mnt.mount_pt, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (myfs->_fd < 0)
+	    output_debug("Cannot open %s (%s), using device path", myfs->_mnt.mount_pt,
+			 strerror(errno));
+    }
+}
+
+void quota_fs_close_stale(void) {
+    quota_fs_t *myfs, *next;
+
+    for (myfs = open_filesystems; myfs; myfs = next) {
+	next = myfs->_next;
+	if (! system_mount_current(&myfs->_mnt)) {
+	    output_debug("%s is no longer mounted as it was, closing it", myfs->_mnt.mount_pt);
+	    quota_fs_close(myfs);
+	}
+    }
+}
+
+void quota_fs_unpin_all(void) {
+    quota_fs_t *myfs;
+
+    for (myfs = open_filesystems; myfs; myfs = myfs->_next) {
+	if (myfs->_fd >= 0) {
+	    close(myfs->_fd);
+	    myfs->_fd = -1;
+	    myfs->_fd_unpinned = 1;
+	}
+    }
+}
+
+/*
+ * quota_ctl
+ * quotactl() on myfs: with quotactl_fd() on the mount point where the
+ * kernel has it (tmpfs and bcachefs have no device to name), else with
+ * the device path, or to the fake backend (QUOTATOOL_FAKE).
+ * Every quotactl() on a filesystem goes through here.
+ */
+static int quota_ctl(quota_fs_t *myfs, int cmd, int id, void *addr) {
+    int retval;
+#ifdef SYS_quotactl_fd
+    int use_fd;
+#endif
+    u_int64_t start;
+
+    start = stats_now();
+    if (fake_quota_active()) {
+	retval = fake_quotactl(myfs, cmd, id, addr);
+	quota_ctl_stats(cmd, start);
+	return retval;
+    }
+#ifdef SYS_quotactl_fd
+    if (myfs->_fd_unpinned)
+	quota_fs_pin(myfs);
+    use_fd = quota_fd_support();
+    if (myfs->_fd >= 0 && use_fd) {
+	retval = syscall(SYS_quotactl_fd, myfs->_fd, cmd, id, addr);
+	if (retval >= 0 || errno != ENOSYS || use_fd > 0) {
+	    if (use_fd < 0) {
+		pthread_mutex_lock(&quota_lock);
+		fd_support = 1;
+		pthread_mutex_unlock(&quota_lock);
+	    }
+	    quota_ctl_stats(cmd, start);
+	    return retval;
+	}
+	output_debug("No quotactl_fd() in this kernel, using device paths");
+	pthread_mutex_lock(&quota_lock);
+	fd_support = 0;
+	pthread_mutex_unlock(&quota_lock);
+    }
+#endif /* SYS_quotactl_fd */
+    if (myfs->_fd >= 0) {
+	close(myfs->_fd);
+	myfs->_fd = -1;
+    }
+    retval = quotactl(cmd, myfs->_qfile, id, (caddr_t) addr);
+    quota_ctl_stats(cmd, start);
+    return retval;
+}
+
+/*
+ * quota_ctl_stats
+ * count a quota_ctl() that began at start under its command
+ */
+static void quota_ctl_stats(int cmd, u_int64_t start) {
+    int saved_errno;
+
+    if (! stats_enabled)
+	return;
+    saved_errno = errno;
+    stats_quotactl(quota_ctl_name(cmd), start);
+    errno = saved_errno;
+}
+
+const char *quota_ctl_name(int cmd) {
+    unsigned int subcmd = (unsigned int) cmd >> SUBCMDSHIFT;
+    size_t i;
+
+    for (i = 0; i < sizeof(quota_ctl_names) / sizeof(quota_ctl_names[0]); i++) {
+	if (quota_ctl_names[i].cmd == subcmd)
+	    return quota_ctl_names[i].name;
+    }
+    return "other";
+}
+
+int quota_ctl_byname(const char *name) {
+    size_t i;
+
+    for (i = 0; i < sizeof(quota_ctl_names) / sizeof(quota_ctl_names[0]); i++) {
+	if (! strcmp(quota_ctl_names[i].name, name))
+	    return (int) quota_ctl_names[i].cmd;
+    }
+    return -1;
+}
+
+/*
+ * quota_fs_probe
+ * detect the quota format of q_type on myfs,
+ * unless that has been done already
+ */
+static int quota_fs_probe(quota_fs_t *myfs, int q_type) {
+    int format, iface, retval;
+    u_int64_t start;
+
+    if (myfs->_format[q_type])
+	return 1;
+
+    format = iface = 0;
+    if (forced_format) {
+	format = forced_format;
+	iface = QF_IS_XFS(format) ? 0 : IFACE_GENERIC;
+	output_debug("Quota format given with --format, not detecting");
+    }
+    else if (format_cache_get(myfs, q_type, &format, &iface)) {
+	output_debug("Quota format of %s from the format cache", myfs->_mnt.mount_pt);
+    }
+    else {
+	output_debug("Detecting quota format");
+	start = stats_now();
+	retval = kern_quota_format(myfs, q_type, &format, &iface);
+	stats_phase(STATS_PROBE, start);
+	if (retval == QF_ERROR) {
+	    output_error("Cannot determine quota format!");
+	    return 0;
+	}
+	if (! QF_IS_TOO_NEW(format))
+	    format_cache_put(myfs, q_type, format, iface);
+    }
+    if (QF_IS_TOO_NEW(format)) {
 	output_error("Quota format too new (?)");
-	exit(ERR_SYS);
+	return 0;
     }
-    if (QF_IS_XFS(quota_format)) {
+    if (QF_IS_XFS(format)) {
 	output_debug("Detected quota format: XFS");
     }
-    if (QF_IS_V0(quota_format)) {
+    if (QF_IS_V0(format)) {
 	output_debug("Detected quota format: VFSV0");
-	if (IF_GENERIC) {
+	if (IF_GENERIC(iface)) {
 	    output_debug("Detected quota interface: GENERIC");
 	}
 	else {
-	    myquota->_v0_quotainfo = (struct v0_kern_dqinfo *) 0;
-	    myquota->_v0_quotainfo = (struct v0_kern_dqinfo *) malloc (sizeof(struct v0_kern_dqinfo));
-	    if (! myquota->_v0_quotainfo) {
+	    myfs->_quotainfo[q_type] = (struct v0_kern_dqinfo *) malloc (sizeof(struct v0_kern_dqinfo));
+	    if (! myfs->_quotainfo[q_type]) {
 		output_error("Insufficient memory");
-		exit(ERR_MEM);
+		errno = ENOMEM;
+		return 0;
 	    }
 	}
     }
-    else if (QF_IS_V1(quota_format)) {
+    else if (QF_IS_V1(format)) {
 	output_debug("Detected quota format: VFSV1");
-	if (IF_GENERIC) {
+	if (IF_GENERIC(iface)) {
 	    output_debug("Detected quota interface: GENERIC");
 	}
 	else {
 	    output_error("Unsupported quota format: VFSV1 but not GENERIC, please report Issue on github: https://github.com/ekenberg/quotatool");
-	    exit(ERR_SYS);
+	    return 0;
 	}
     }
-    else if (QF_IS_OLD(quota_format)) {
+    else if (QF_IS_OLD(format)) {
 	output_debug("Detected quota format: OLD");
-	if (IF_GENERIC) {
+	if (IF_GENERIC(iface)) {
 	    output_debug("Detected quota interface: GENERIC");
 	}
     }
-    else if (! QF_IS_XFS(quota_format)) {
+    else if (QF_IS_KERNEL(format)) {
+	output_debug("Detected quota format: kept by the filesystem (%s)", myfs->_mnt.mnt_type);
+	if (myfs->_fd < 0 && ! fake_quota_active()) {
+	    output_error("%s has no quota device, needs quotactl_fd() (linux 5.14+)",
+			 myfs->_mnt.mount_pt);
+	    return 0;
+	}
+    }
+    else if (! QF_IS_XFS(format)) {
 	output_error("Unknown quota format!");
-	exit(ERR_SYS);
+	return 0;
     }
-    if (IF_GENERIC) {
-	myquota->_generic_quotainfo = (struct if_dqinfo *) 0;
-	myquota->_generic_quotainfo = (struct if_dqinfo *) malloc(sizeof(struct if_dqinfo));
-	if (! myquota->_generic_quotainfo) {
+    if (IF_GENERIC(iface)) {
+	myfs->_quotainfo[q_type] = (struct if_dqinfo *) calloc(1, sizeof(struct if_dqinfo));
+	if (! myfs->_quotainfo[q_type]) {
 	    output_error("Insufficient memory");
-	    exit(ERR_MEM);
+	    errno = ENOMEM;
+	    return 0;
+	}
+    }
+
+    myfs->_format[q_type] = format;
+    myfs->_iface[q_type]  = iface;
+    return 1;
+}
+
+/*
+ * quota_format_force
+ * use the named quota format ("vfsold", "vfsv0", "vfsv1", "xfs" or
+ * "kernel") on every filesystem instead of detecting it. The generic
+ * interface of 2.6+ kernels is assumed. Returns 0 for an unknown name
+ */
+int quota_format_force(const char *name) {
+    static const struct { const char *name; int format; } formats[] = {
+	{ "vfsold", 1 << QF_VFSOLD },
+	{ "vfsv0",  1 << QF_VFSV0 },
+	{ "vfsv1",  1 << QF_VFSV1 },
+	{ "xfs",    1 << QF_XFS },
+	{ "kernel", 1 << QF_KERNEL },
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+	if (! strcmp(name, formats[i].name)) {
+	    forced_format = formats[i].format;
+	    return 1;
 	}
     }
+    return 0;
+}
 
-    qfile = strdup(fs->device);
+quota_t *quota_new(quota_fs_t *myfs, int q_type, int id) {
+    quota_t *myquota;
+
+    q_type--;            /* see defs in quota.h */
+    if (q_type >= MAXQUOTAS) {
+	output_error("Unknown quota type: %d", q_type);
+	return 0;
+    }
+
+    if (! quota_fs_probe(myfs, q_type)) {
+	return NULL;
+    }
+
+    myquota = (quota_t *) calloc(1, sizeof(quota_t));
+    if (! myquota) {
+	output_error("Insufficient memory");
+	errno = ENOMEM;
+	return NULL;
+    }
 
     myquota->_id = id;
     myquota->_id_type = q_type;
-    myquota->_qfile = qfile;
+    myquota->_qfile = myfs->_qfile;
+    myquota->_fs = myfs;
 
-    free(fs);
     return myquota;
 }
 
 inline void quota_delete(quota_t *myquota) {
-    free(myquota->_qfile);
-    if (IF_GENERIC) {
-	free(myquota->_generic_quotainfo);
-    }
-    else if (QF_IS_V0(quota_format)) {
-	free(myquota->_v0_quotainfo);
-    }
-
     free(myquota);
 }
 
@@ -156,13 +477,13 @@ int quota_get(quota_t *myquota) {
 
     output_debug("fetching quotas: device='%s',id='%d'", myquota->_qfile,
 		 myquota->_id);
-    if (QF_IS_XFS(quota_format)) {
+    if (QF_IS_XFS(QUOTA_FORMAT(myquota))) {
 	retval = xfs_quota_get(myquota);
     }
-    else if (IF_GENERIC) {
+    else if (IF_GENERIC(QUOTA_IFACE(myquota))) {
 	retval = generic_quota_get(myquota);
     }
-    else if (QF_IS_V0(quota_format)) {
+    else if (QF_IS_V0(QUOTA_FORMAT(myquota))) {
 	retval = v0_quota_get(myquota);
     }
     else {
@@ -171,12 +492,124 @@ int quota_get(quota_t *myquota) {
     return retval;
 }
 
+int quota_get_next(quota_t *myquota) {
+    output_debug("fetching next quota: device='%s',id>='%u'", myquota->_qfile,
+		 (unsigned int) myquota->_id);
+    if (QF_IS_XFS(QUOTA_FORMAT(myquota))) {
+	return xfs_quota_get_next(myquota);
+    }
+    else if (IF_GENERIC(QUOTA_IFACE(myquota))) {
+	return generic_quota_get_next(myquota);
+    }
+    output_error("Listing all ids needs the generic quota interface, not available for %s",
+		 myquota->_qfile);
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+int quota_get_grace(quota_t *myquota) {
+    quota_fs_t *myfs = myquota->_fs;
+    int q_type = myquota->_id_type;
+
+    /* old format: quota_get() took them from the user's own record */
+    if (! QF_IS_XFS(QUOTA_FORMAT(myquota)) && ! IF_GENERIC(QUOTA_IFACE(myquota))
+	&& ! QF_IS_V0(QUOTA_FORMAT(myquota))) {
+	return 1;
+    }
+
+    if (myfs->_grace_loaded[q_type]) {
+	quota_count(&info_avoided);
+    }
+    else if (! quota_fs_get_info(myfs, q_type)) {
+	return 0;
+    }
+    myquota->block_grace = myfs->_block_grace[q_type];
+    myquota->inode_grace = myfs->_inode_grace[q_type];
+    return 1;
+}
+
+/*
+ * quota_fs_get_info
+ * fetch the grace periods of q_type on myfs
+ */
+static int quota_fs_get_info(quota_fs_t *myfs, int q_type) {
+    fs_quota_stat_t quotastat;
+    int retval;
+
+    output_debug("fetching grace periods: device='%s'", myfs->_qfile);
+    quota_count(&info_issued);
+    if (QF_IS_XFS(myfs->_format[q_type])) {
+	retval = quota_ctl(myfs, QCMD(Q_XGETQSTAT, q_type),
+			   0, (caddr_t) &quotastat);
+	if (retval < 0) {
+	    output_error("Failed fetching quota state (xfs): %s", strerror(errno));
+	    return 0;
+	}
+	myfs->_block_grace[q_type] = quotastat.qs_btimelimit;
+	myfs->_inode_grace[q_type] = quotastat.qs_itimelimit;
+    }
+    else if (IF_GENERIC(myfs->_iface[q_type])) {
+	retval = quota_ctl(myfs, QCMD(Q_GETINFO, q_type),
+			   0, (caddr_t) myfs->_quotainfo[q_type]);
+	if (retval < 0) {
+	    output_error("Failed fetching quotainfo (generic): %s", strerror(errno));
+	    return 0;
+	}
+	myfs->_block_grace[q_type] = ((struct if_dqinfo *) myfs->_quotainfo[q_type])->dqi_bgrace;
+	myfs->_inode_grace[q_type] = ((struct if_dqinfo *) myfs->_quotainfo[q_type])->dqi_igrace;
+    }
+    else {
+	retval = quota_ctl(myfs, QCMD(Q_V0_GETINFO, q_type),
+			   0, (caddr_t) myfs->_quotainfo[q_type]);
+	if (retval < 0) {
+	    output_error("Failed fetching quotainfo: %s", strerror(errno));
+	    return 0;
+	}
+	myfs->_block_grace[q_type] = ((struct v0_kern_dqinfo *) myfs->_quotainfo[q_type])->dqi_bgrace;
+	myfs->_inode_grace[q_type] = ((struct v0_kern_dqinfo *) myfs->_quotainfo[q_type])->dqi_igrace;
+    }
+    myfs->_grace_loaded[q_type] = 1;
+    return 1;
+}
+
+/* someone else may have changed them since (--serve) */
+void quota_forget_grace(void) {
+    quota_fs_t *myfs;
+
+    for (myfs = open_filesystems; myfs; myfs = myfs->_next)
+	memset(myfs->_grace_loaded, 0, sizeof(myfs->_grace_loaded));
+}
+
+/* fd_support, as one thread sees it */
+static int quota_fd_support(void) {
+    int retval;
+
+    pthread_mutex_lock(&quota_lock);
+    retval = fd_support;
+    pthread_mutex_unlock(&quota_lock);
+    return retval;
+}
+
+/* one more grace info call made or avoided */
+static void quota_count(int *counter) {
+    pthread_mutex_lock(&quota_lock);
+    (*counter)++;
+    pthread_mutex_unlock(&quota_lock);
+}
+
+void quota_info_stats(int *issued, int *avoided) {
+    pthread_mutex_lock(&quota_lock);
+    *issued = info_issued;
+    *avoided = info_avoided;
+    pthread_mutex_unlock(&quota_lock);
+}
+
 static int old_quota_get(quota_t *myquota) {
     struct old_kern_dqblk sysquota;
     int retval;
 
-    retval = quotactl(QCMD(Q_OLD_GETQUOTA,myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_OLD_GETQUOTA,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
 	output_error("Failed fetching quotas (old): %s", strerror(errno));
 	return 0;
@@ -185,7 +618,8 @@ static int old_quota_get(quota_t *myquota) {
     /* copy the linux-formatted quota info into our struct */
     myquota->block_hard        = sysquota.dqb_bhardlimit;
     myquota->block_soft        = sysquota.dqb_bsoftlimit;
-    myquota->diskspace_used    = sysquota.dqb_curblocks;
+    /* the old interface counts 1K blocks in use, not bytes */
+    myquota->diskspace_used    = (u_int64_t) sysquota.dqb_curblocks * BLOCK_SIZE;
     myquota->inode_hard        = sysquota.dqb_ihardlimit;
     myquota->inode_soft        = sysquota.dqb_isoftlimit;
     myquota->inode_used        = sysquota.dqb_curinodes;
@@ -204,8 +638,8 @@ static int v0_quota_get(quota_t *myquota) {
     struct v0_kern_dqblk sysquota;
     int retval;
 
-    retval = quotactl(QCMD(Q_V0_GETQUOTA,myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_V0_GETQUOTA,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
 	output_error("Failed fetching quotas (vfsv0): %s", strerror(errno));
 	return 0;
@@ -221,23 +655,15 @@ static int v0_quota_get(quota_t *myquota) {
     myquota->block_time        = sysquota.dqb_btime;
     myquota->inode_time        = sysquota.dqb_itime;
 
-    retval = quotactl(QCMD(Q_V0_GETINFO,myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) myquota->_v0_quotainfo);
-    if (retval < 0) {
-	output_error("Failed fetching quotainfo: %s", strerror(errno));
-	return 0;
-    }
-    myquota->block_grace = ((struct v0_kern_dqinfo *) myquota->_v0_quotainfo)->dqi_bgrace;
-    myquota->inode_grace = ((struct v0_kern_dqinfo *) myquota->_v0_quotainfo)->dqi_igrace;
-
+    quota_count(&info_avoided);    /* grace periods: see quota_get_grace() */
     return 1;
 }
 
 static int generic_quota_get(quota_t *myquota) {
     struct if_dqblk sysquota;
     long retval;
-    retval = quotactl(QCMD(Q_GETQUOTA,myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_GETQUOTA,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
 	output_error("Failed fetching quotas (generic): %s", strerror(errno));
 	return 0;
@@ -253,27 +679,48 @@ static int generic_quota_get(quota_t *myquota) {
     myquota->block_time = sysquota.dqb_btime;
     myquota->inode_time = sysquota.dqb_itime;
 
-    retval = quotactl(QCMD(Q_GETINFO,myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) myquota->_generic_quotainfo);
+    quota_count(&info_avoided);    /* grace periods: see quota_get_grace() */
+    return 1;
+}
+
+static int generic_quota_get_next(quota_t *myquota) {
+    struct if_nextdqblk sysquota;
+    long retval;
+
+    retval = quota_ctl(myquota->_fs, QCMD(Q_GETNEXTQUOTA,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
-	output_error("Failed fetching quotainfo (generic): %s", strerror(errno));
-	return 0;
+	if (errno == ENOENT)
+	    return 0;    /* no more ids */
+	if (errno == EINVAL)
+	    output_error("Failed listing quotas (generic): kernel has no Q_GETNEXTQUOTA (needs 4.6+)");
+	else
+	    output_error("Failed listing quotas (generic): %s", strerror(errno));
+	return -1;
     }
-    myquota->block_grace = ((struct if_dqinfo *) myquota->_generic_quotainfo)->dqi_bgrace;
-    myquota->inode_grace = ((struct if_dqinfo *) myquota->_generic_quotainfo)->dqi_igrace;
+
+    /* copy the linux-formatted quota info into our struct */
+    myquota->_id = sysquota.dqb_id;
+    myquota->block_hard = sysquota.dqb_bhardlimit;
+    myquota->block_soft = sysquota.dqb_bsoftlimit;
+    myquota->diskspace_used = sysquota.dqb_curspace;
+    myquota->inode_hard = sysquota.dqb_ihardlimit;
+    myquota->inode_soft = sysquota.dqb_isoftlimit;
+    myquota->inode_used = sysquota.dqb_curinodes;
+    myquota->block_time = sysquota.dqb_btime;
+    myquota->inode_time = sysquota.dqb_itime;
 
     return 1;
 }
 
 static int xfs_quota_get(quota_t *myquota) {
     fs_disk_quota_t sysquota;
-    fs_quota_stat_t quotastat;
     int block_diff;    // XFS quota always uses BB (Basic Blocks = 512 bytes)
     int retval;
 
     block_diff = BLOCK_SIZE / 512;
-    retval = quotactl(QCMD(Q_XGETQUOTA, myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_XGETQUOTA, myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     /*
     ** 2005-04-26  : fmicaux@actilis.net -
     handling a non-set quota for a user/group
@@ -301,9 +748,6 @@ static int xfs_quota_get(quota_t *myquota) {
 	return 0;
     }
 
-    retval = quotactl(QCMD(Q_XGETQSTAT, myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) &quotastat);
-
     /* copy the linux-xfs-formatted quota info into our struct */
     myquota->block_hard    =  sysquota.d_blk_hardlimit / block_diff;
     myquota->block_soft    =  sysquota.d_blk_softlimit / block_diff;
@@ -312,30 +756,63 @@ static int xfs_quota_get(quota_t *myquota) {
     myquota->inode_hard  =  sysquota.d_ino_hardlimit;
     myquota->inode_soft  =  sysquota.d_ino_softlimit;
     myquota->inode_used  =  sysquota.d_icount;
-    myquota->block_grace    =  quotastat.qs_btimelimit;
-    myquota->inode_grace    =  quotastat.qs_itimelimit;
     myquota->block_time    =  sysquota.d_btimer;
     myquota->inode_time    =  sysquota.d_itimer;
 
+    quota_count(&info_avoided);    /* grace periods: see quota_get_grace() */
+    return 1;
+}
+
+static int xfs_quota_get_next(quota_t *myquota) {
+    fs_disk_quota_t sysquota;
+    int block_diff;    // XFS quota always uses BB (Basic Blocks = 512 bytes)
+    int retval;
+
+    block_diff = BLOCK_SIZE / 512;
+    retval = quota_ctl(myquota->_fs, QCMD(Q_XGETNEXTQUOTA, myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
+    if (retval < 0) {
+	if (errno == ENOENT)
+	    return 0;    /* no more ids */
+	if (errno == EINVAL)
+	    output_error("Failed listing quotas (xfs): kernel has no Q_XGETNEXTQUOTA (needs 4.6+)");
+	else
+	    output_error("Failed listing quotas (xfs): %s", strerror(errno));
+	return -1;
+    }
+
+    /* copy the linux-xfs-formatted quota info into our struct */
+    myquota->_id         =  sysquota.d_id;
+    myquota->block_hard  =  sysquota.d_blk_hardlimit / block_diff;
+    myquota->block_soft  =  sysquota.d_blk_softlimit / block_diff;
+    // XFS really uses blocks, all other formats in this file use bytes
+    myquota->diskspace_used = (sysquota.d_bcount * 1024) / block_diff;
+    myquota->inode_hard  =  sysquota.d_ino_hardlimit;
+    myquota->inode_soft  =  sysquota.d_ino_softlimit;
+    myquota->inode_used  =  sysquota.d_icount;
+    myquota->block_time  =  sysquota.d_btimer;
+    myquota->inode_time  =  sysquota.d_itimer;
+
     return 1;
 }
 
 int quota_set(quota_t *myquota){
     int retval;
 
-    if (geteuid() != 0) {
+    if (geteuid() != 0 && ! fake_quota_active()) {
 	output_error("Only root can set quotas");
+	errno = EPERM;
 	return 0;
     }
 
     /* set quota */
-    if (QF_IS_XFS(quota_format)) {
+    if (QF_IS_XFS(QUOTA_FORMAT(myquota))) {
 	retval = xfs_quota_set(myquota);
     }
-    else if (IF_GENERIC) {
+    else if (IF_GENERIC(QUOTA_IFACE(myquota))) {
 	retval = generic_quota_set(myquota);
     }
-    else if (QF_IS_V0(quota_format)) {
+    else if (QF_IS_V0(QUOTA_FORMAT(myquota))) {
 	retval = v0_quota_set(myquota);
     }
     else {
@@ -344,15 +821,74 @@ int quota_set(quota_t *myquota){
 
     if (! retval)
 	return retval;
-    if (QF_IS_XFS(quota_format))
-	return 1;    // no sync needed for XFS
+    if (QF_IS_XFS(QUOTA_FORMAT(myquota)) || QF_IS_KERNEL(QUOTA_FORMAT(myquota)))
+	return 1;    // no sync needed for XFS, tmpfs, bcachefs
+
+    /* remember that a sync is needed, quota_sync_all() does it */
+    myquota->_fs->_syncs_needed++;
+    if (sync_mode == QUOTA_SYNC_DEFERRED)
+	myquota->_fs->_dirty[myquota->_id_type] = 1;
+    return 1;
+}
+
+void quota_sync_mode(int mode) {
+    sync_mode = mode;
+}
+
+/*
+ * quota_fs_sync
+ * Q_SYNC whatever is pending on one filesystem. Only touches myfs,
+ * so workers may sync their own filesystems concurrently.
+ */
+int quota_fs_sync(quota_fs_t *myfs) {
+    int q_type;
+    int retval = 1;
 
-    /* sync */
-    retval = quotactl(QCMD(IF_GENERIC ? Q_SYNC : Q_6_5_SYNC
-			   ,myquota->_id_type), myquota->_qfile,
-		      0, NULL);
+    for (q_type = 0; q_type < MAXQUOTAS; q_type++) {
+	if (myfs->_dirty[q_type] && ! quota_sync(myfs, q_type))
+	    retval = 0;
+    }
+    return retval;
+}
+
+/*
+ * quota_sync_all
+ * issue the Q_SYNCs deferred by quota_set(), one per
+ * filesystem and quota type that had quotas set
+ */
+int quota_sync_all(void) {
+    quota_fs_t *myfs;
+    int needed, issued;
+    int retval = 1;
+    u_int64_t start;
+
+    start = stats_now();
+    needed = issued = 0;
+    for (myfs = open_filesystems; myfs; myfs = myfs->_next) {
+	if (! quota_fs_sync(myfs))
+	    retval = 0;
+	needed += myfs->_syncs_needed;
+	issued += myfs->_syncs_issued;
+    }
+
+    if (needed) {
+	output_info("Q_SYNC: %d issued for %d quota changes, %d saved",
+		    issued, needed, needed - issued);
+    }
+    stats_phase(STATS_SYNC, start);
+    return retval;
+}
+
+static int quota_sync(quota_fs_t *myfs, int q_type) {
+    int retval;
+
+    output_debug("syncing quotas on %s", myfs->_qfile);
+    myfs->_dirty[q_type] = 0;
+    myfs->_syncs_issued++;
+    retval = quota_ctl(myfs, QCMD(IF_GENERIC(myfs->_iface[q_type]) ? Q_SYNC : Q_6_5_SYNC
+			   ,q_type), 0, NULL);
     if (retval < 0) {
-	output_error("Failed syncing quotas on %s: %s", myquota->_qfile,
+	output_error("Failed syncing quotas on %s: %s", myfs->_qfile,
 		     strerror(errno));
 	return 0;
     }
@@ -375,16 +911,22 @@ static int generic_quota_set(quota_t *myquota) {
        Timer setting is handled by quota_reset_grace() when needed. */
     sysquota.dqb_valid      = QIF_LIMITS;
 
-    retval = quotactl(QCMD(Q_SETQUOTA,myquota->_id_type),myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_SETQUOTA,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
 	output_error("Failed setting quota (generic): %s", strerror(errno));
 	return 0;
     }
     /* update quotainfo (global gracetimes) */
     if (myquota->_do_set_global_block_gracetime || myquota->_do_set_global_inode_gracetime) {
-	struct if_dqinfo *foo = ((struct if_dqinfo *) myquota->_generic_quotainfo);
-	u_int32_t old_dqi_valid = foo->dqi_valid; // Save now, restore later
+	struct if_dqinfo *foo = ((struct if_dqinfo *) QUOTA_INFO(myquota));
+	u_int32_t old_dqi_valid;
+
+	/* Q_SETINFO needs the rest of the info as it is */
+	if (! myquota->_fs->_grace_loaded[myquota->_id_type]
+	    && ! quota_fs_get_info(myquota->_fs, myquota->_id_type))
+	    return 0;
+	old_dqi_valid = foo->dqi_valid; // Save now, restore later
 
 	if (myquota->_do_set_global_block_gracetime) {
 	    output_debug(">> set global block gracetime");
@@ -396,13 +938,16 @@ static int generic_quota_set(quota_t *myquota) {
 	    foo->dqi_igrace = myquota->inode_grace;
 	    foo->dqi_valid  = IIF_IGRACE;
 	}
-	retval = quotactl(QCMD(Q_SETINFO, myquota->_id_type), myquota->_qfile,
-			  myquota->_id, (caddr_t) myquota->_generic_quotainfo);
+	retval = quota_ctl(myquota->_fs, QCMD(Q_SETINFO, myquota->_id_type),
+			   myquota->_id, (caddr_t) QUOTA_INFO(myquota));
 	foo->dqi_valid = old_dqi_valid; // restore
 	if (retval < 0) {
 	    output_error("Failed setting gracetime (generic): %s", strerror(errno));
+	    myquota->_fs->_grace_loaded[myquota->_id_type] = 0;
 	    return 0;
 	}
+	myquota->_fs->_block_grace[myquota->_id_type] = foo->dqi_bgrace;
+	myquota->_fs->_inode_grace[myquota->_id_type] = foo->dqi_igrace;
     }
     /* success */
     return 1;
@@ -424,8 +969,8 @@ static int v0_quota_set(quota_t *myquota) {
     // sysquota.dqb_itime      = myquota->inode_time;
 
     /* make the syscall */
-    retval = quotactl(QCMD(Q_V0_SETQUOTA,myquota->_id_type),myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_V0_SETQUOTA,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
 	output_error("Failed setting quota (vfsv0): %s", strerror(errno));
 	return 0;
@@ -433,16 +978,22 @@ static int v0_quota_set(quota_t *myquota) {
 
     /* update quotainfo (global gracetimes) */
     if (myquota->_do_set_global_block_gracetime || myquota->_do_set_global_inode_gracetime) {
+	if (! myquota->_fs->_grace_loaded[myquota->_id_type]
+	    && ! quota_fs_get_info(myquota->_fs, myquota->_id_type))
+	    return 0;
 	if (myquota->_do_set_global_block_gracetime)
-	    ((struct v0_kern_dqinfo *) myquota->_v0_quotainfo)->dqi_bgrace = myquota->block_grace;
+	    ((struct v0_kern_dqinfo *) QUOTA_INFO(myquota))->dqi_bgrace = myquota->block_grace;
 	if (myquota->_do_set_global_inode_gracetime)
-	    ((struct v0_kern_dqinfo *) myquota->_v0_quotainfo)->dqi_igrace = myquota->inode_grace;
-	retval = quotactl(QCMD(Q_V0_SETGRACE, myquota->_id_type), myquota->_qfile,
-			  myquota->_id, (caddr_t) myquota->_v0_quotainfo);
+	    ((struct v0_kern_dqinfo *) QUOTA_INFO(myquota))->dqi_igrace = myquota->inode_grace;
+	retval = quota_ctl(myquota->_fs, QCMD(Q_V0_SETGRACE, myquota->_id_type),
+			   myquota->_id, (caddr_t) QUOTA_INFO(myquota));
 	if (retval < 0) {
 	    output_error("Failed setting gracetime: %s", strerror(errno));
+	    myquota->_fs->_grace_loaded[myquota->_id_type] = 0;
 	    return 0;
 	}
+	myquota->_fs->_block_grace[myquota->_id_type] = ((struct v0_kern_dqinfo *) QUOTA_INFO(myquota))->dqi_bgrace;
+	myquota->_fs->_inode_grace[myquota->_id_type] = ((struct v0_kern_dqinfo *) QUOTA_INFO(myquota))->dqi_igrace;
     }
     /* success */
     return 1;
@@ -455,7 +1006,7 @@ static int old_quota_set(quota_t *myquota) {
     /* copy our data into the linux dqblk */
     sysquota.dqb_bhardlimit = myquota->block_hard;
     sysquota.dqb_bsoftlimit = myquota->block_soft;
-    sysquota.dqb_curblocks  = myquota->diskspace_used;
+    sysquota.dqb_curblocks  = BYTES_TO_BLOCKS(myquota->diskspace_used);
     sysquota.dqb_ihardlimit = myquota->inode_hard;
     sysquota.dqb_isoftlimit = myquota->inode_soft;
     sysquota.dqb_curinodes  = myquota->inode_used;
@@ -464,8 +1015,8 @@ static int old_quota_set(quota_t *myquota) {
     sysquota.dqb_itime      = myquota->inode_grace;
 
     /* make the syscall */
-    retval = quotactl(QCMD(Q_OLD_SETQUOTA,myquota->_id_type),myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_OLD_SETQUOTA,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
 	output_error("Failed setting quota (old): %s", strerror(errno));
 	return 0;
@@ -495,12 +1046,15 @@ static int xfs_quota_set(quota_t *myquota) {
     if (myquota->_do_set_global_block_gracetime || myquota->_do_set_global_inode_gracetime)
 	sysquota.d_fieldmask |= FS_DQ_TIMER_MASK;
 
-    retval = quotactl(QCMD(Q_XSETQLIM,myquota->_id_type), myquota->_qfile,
-		      myquota->_id, (caddr_t) &sysquota);
+    retval = quota_ctl(myquota->_fs, QCMD(Q_XSETQLIM,myquota->_id_type),
+		       myquota->_id, (caddr_t) &sysquota);
     if (retval < 0) {
 	output_error("Failed setting quota (xfs): %s", strerror(errno));
 	return(0);
     }
+    /* root's timers are the global grace periods, read them again next time */
+    if (sysquota.d_fieldmask & FS_DQ_TIMER_MASK)
+	myquota->_fs->_grace_loaded[myquota->_id_type] = 0;
 
     /* success */
     return 1;
@@ -511,24 +1065,77 @@ static int xfs_quota_set(quota_t *myquota) {
  *    (ripped from quota-utils, all credits to Honza!)
  */
 
-int kern_quota_format(fs_t *fs, int q_type) {
+/*
+ * kern_quota_getfmt
+ * the format of q_type on myfs, from the generic interface's Q_GETFMT
+ */
+static int kern_quota_getfmt(quota_fs_t *myfs, int q_type, int *quota_format, int *kernel_iface) {
+    int actfmt, retval;
+
+    *kernel_iface = IFACE_GENERIC;
+    retval = quota_ctl(myfs, QCMD(Q_GETFMT, q_type), 0, &actfmt);
+    if (retval < 0) {
+	if (! QF_IS_XFS(*quota_format)) {
+	    if (errno == 3) {
+		output_error("Quotatool cannot function while quotas are disabled. "
+			     "Please enable quotas by running `quotaon -a`.\n");
+	    }
+	    else {
+		output_error("Error while detecting kernel quota version: %i, %s\n", errno, strerror(errno));
+	    }
+	    return QF_ERROR;
+	}
+    }
+    else {
+	if (actfmt == 1)  /* Q_GETFMT retval for QF_VFSOLD */
+	    *quota_format |= (1 << QF_VFSOLD);
+	else if (actfmt == 2)  /* Q_GETFMT retval for QF_VFSV0 */
+	    *quota_format |= (1 << QF_VFSV0);
+	else if (actfmt == 4)  /* Q_GETFMT retval for QF_VFSV1 */
+	    *quota_format |= (1 << QF_VFSV1);
+	else if (actfmt == 5)  /* Q_GETFMT retval for QFMT_SHMEM, tmpfs (6.6+) */
+	    *quota_format |= (1 << QF_KERNEL);
+	else {
+	    output_debug("Unknown Q_GETFMT: %d\n", actfmt);
+	    return QF_ERROR;
+	}
+    }
+    return 0;
+}
+
+int kern_quota_format(quota_fs_t *myfs, int q_type, int *quota_format, int *kernel_iface) {
+    fs_t *fs = &myfs->_mnt;
     u_int32_t version;
     struct v0_dqstats v0_stats;
     FILE *f;
     int ret = 0;
     struct stat st;
 
+    /* no /proc to look at, the seed file says */
+    if (fake_quota_active()) {
+	if (fake_quota_format(myfs, q_type, quota_format, kernel_iface))
+	    return ret;
+	return kern_quota_getfmt(myfs, q_type, quota_format, kernel_iface);
+    }
+
     if (strcasecmp(fs->mnt_type, "xfs") == 0) {
 	if (stat("/proc/fs/xfs/stat", &st) == 0) {
-	    quota_format |= (1 << QF_XFS);
+	    *quota_format |= (1 << QF_XFS);
 	    return ret;
 	}
 	else {
 	    output_error("%s is mounted as XFS but no kernel support for XFS quota!", fs->device);
-	    exit(ERR_SYS);
+	    return QF_ERROR;
 	}
     }
 
+    /* bcachefs keeps quotas itself, Q_GETFMT doesn't know about it */
+    if (strcasecmp(fs->mnt_type, "bcachefs") == 0) {
+	*quota_format |= (1 << QF_KERNEL);
+	*kernel_iface = IFACE_GENERIC;
+	return ret;
+    }
+
     if ((f = fopen("/proc/fs/quota", "r"))) {
 	if (fscanf(f, "Version %u", &version) != 1) {
 	    fclose(f);
@@ -538,34 +1145,7 @@ int kern_quota_format(fs_t *fs, int q_type) {
     }
     else if (stat("/proc/sys/fs/quota", &st) == 0) {
 	/* Either QF_VFSOLD or QF_VFSV0 or QF_VFSV1 */
-	int actfmt, retval;
-	kernel_iface = IFACE_GENERIC;
-	retval = quotactl(QCMD(Q_GETFMT, q_type), fs->device, 0, (void *) &actfmt);
-	if (retval < 0) {
-	    if (! QF_IS_XFS(quota_format)) {
-		if (errno == 3) {
-		    output_error("Quotatool cannot function while quotas are disabled. "
-				 "Please enable quotas by running `quotaon -a`.\n");
-		}
-		else {
-		    output_error("Error while detecting kernel quota version: %i, %s\n", errno, strerror(errno));
-		}
-		exit(ERR_SYS);
-	    }
-	}
-	else {
-	    if (actfmt == 1)  /* Q_GETFMT retval for QF_VFSOLD */
-		quota_format |= (1 << QF_VFSOLD);
-	    else if (actfmt == 2)  /* Q_GETFMT retval for QF_VFSV0 */
-		quota_format |= (1 << QF_VFSV0);
-	    else if (actfmt == 4)  /* Q_GETFMT retval for QF_VFSV1 */
-		quota_format |= (1 << QF_VFSV1);
-	    else {
-		output_debug("Unknown Q_GETFMT: %d\n", actfmt);
-		return QF_ERROR;
-	    }
-	}
-	return ret;
+	return kern_quota_getfmt(myfs, q_type, quota_format, kernel_iface);
     }
     else if (quotactl(QCMD(Q_V0_GETSTATS, 0), NULL, 0, (void *) &v0_stats) >= 0) {
 	version = v0_stats.version;    /* Copy the version */
@@ -590,34 +1170,34 @@ int kern_quota_format(fs_t *fs, int q_type) {
 	     * On a 2.4.x         we expect 0, ENOENT
 	     * On a 2.4.x-ac    we wont get here */
 	    if (err_stat == 0 && err_quota == EINVAL) {
-		quota_format |= (1 << QF_VFSV0);    /* New format supported */
-		kernel_iface = IFACE_VFSV0;
+		*quota_format |= (1 << QF_VFSV0);    /* New format supported */
+		*kernel_iface = IFACE_VFSV0;
 	    }
 	    else {
-		quota_format |= (1 << QF_VFSOLD);
-		kernel_iface = IFACE_VFSOLD;
+		*quota_format |= (1 << QF_VFSOLD);
+		*kernel_iface = IFACE_VFSOLD;
 	    }
 	    return ret;
 	}
 	output_error("Error while detecting kernel quota version: %s\n", strerror(errno));
-	exit(ERR_SYS);
+	return QF_ERROR;
     }
     if (version > KERN_KNOWN_QUOTA_VERSION)  /* Newer kernel than we know? */
-	quota_format = QF_TOONEW;
+	*quota_format = QF_TOONEW;
     if (version <= 6*10000+4*100+0) {        /* Old quota format? */
-	quota_format |= (1 << QF_VFSOLD);
-	kernel_iface = IFACE_VFSOLD;
+	*quota_format |= (1 << QF_VFSOLD);
+	*kernel_iface = IFACE_VFSOLD;
     }
     else {
-	quota_format |= (1 << QF_VFSV0);      /* New format supported */
-	kernel_iface = IFACE_VFSOLD;
+	*quota_format |= (1 << QF_VFSV0);      /* New format supported */
+	*kernel_iface = IFACE_VFSOLD;
     }
     return ret;
 }
 
 int quota_reset_grace(quota_t *myquota, int grace_type) {
 
-    if (QF_IS_XFS(quota_format)) {
+    if (QF_IS_XFS(QUOTA_FORMAT(myquota))) {
 	/*
 	 * XFS grace reset uses two mechanisms for portability:
 	 *
@@ -656,8 +1236,8 @@ int quota_reset_grace(quota_t *myquota, int grace_type) {
 	    sysquota.d_itimer = (__s32)(time(NULL) + myquota->inode_grace);
 	    sysquota.d_fieldmask = FS_DQ_ITIMER;
 	}
-	quotactl(QCMD(Q_XSETQLIM, myquota->_id_type),
-	    myquota->_qfile, myquota->_id, (caddr_t) &sysquota);
+	quota_ctl(myquota->_fs, QCMD(Q_XSETQLIM, myquota->_id_type),
+		  myquota->_id, (caddr_t) &sysquota);
 
 	return 1;
     }
@@ -6,6 +6,7 @@
 #define Q_XSETQLIM	XQM_CMD(0x4)	/* set disk limits */
 #define Q_XGETQSTAT	XQM_CMD(0x5)	/* get quota subsystem status */
 #define Q_XQUOTARM	XQM_CMD(0x6)	/* free disk space used by dquots */
+#define Q_XGETNEXTQUOTA	XQM_CMD(0x9)	/* get limits and usage of next id >= given id */
 
 /*
  * fs_disk_quota structure:
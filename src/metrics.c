@@ -0,0 +1,430 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * metrics.c
+ * quotas as Prometheus metrics, for node_exporter or scraped over HTTP
+ *
+ * One pass over the kernel's list of ids per filesystem and quota type
+ * gives every series. The exposition format wants the samples of each
+ * metric together, while the pass yields all metrics of one id at a
+ * time, so each metric's samples are streamed into a temporary file of
+ * their own and the files are joined at the end. Memory stays the same
+ * for 100 or 100k ids.
+ *
+ * The textfile is written next to its final name and renamed into
+ * place, node_exporter never sees half of it.
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#ifdef HAVE_INTTYPES_H
+#include <inttypes.h>
+#endif
+
+#include "quotatool.h"
+#include "metrics.h"
+#include "output.h"
+#include "parse.h"
+#include "quota.h"
+#include "system.h"
+
+#ifdef HAVE_INTTYPES_H
+#  define _METRICS_U64 "%" PRIu64
+#else
+#  define _METRICS_U64 "%llu"
+#endif
+
+#define METRICS_BLOCK_USED   0
+#define METRICS_BLOCK_SOFT   1
+#define METRICS_BLOCK_HARD   2
+#define METRICS_BLOCK_GRACE  3
+#define METRICS_INODE_USED   4
+#define METRICS_INODE_SOFT   5
+#define METRICS_INODE_HARD   6
+#define METRICS_INODE_GRACE  7
+#define METRICS_FAMILIES     8
+
+static const char *metrics_names[METRICS_FAMILIES][2] = {
+  { "quotatool_block_used_bytes",       "Disk space used" },
+  { "quotatool_block_soft_limit_bytes", "Soft limit on disk space, 0 = none" },
+  { "quotatool_block_hard_limit_bytes", "Hard limit on disk space, 0 = none" },
+  { "quotatool_block_grace_seconds",    "Time left before the block soft limit is enforced" },
+  { "quotatool_inode_used",             "Inodes used" },
+  { "quotatool_inode_soft_limit",       "Soft limit on inodes, 0 = none" },
+  { "quotatool_inode_hard_limit",       "Hard limit on inodes, 0 = none" },
+  { "quotatool_inode_grace_seconds",    "Time left before the inode soft limit is enforced" },
+};
+
+struct _metrics_t {
+  FILE *family[METRICS_FAMILIES];
+  unsigned long ids;
+};
+
+static volatile sig_atomic_t metrics_stop = 0;
+
+
+
+static void metrics_signal (int sig) {
+  (void) sig;
+  metrics_stop = 1;
+}
+
+
+
+/*
+ * metrics_label
+ * a label value with \, " and newlines escaped
+ */
+static void metrics_label (char *buf, size_t len, const char *value) {
+  size_t i = 0;
+
+  for ( ; *value && i < len - 2; value++) {
+    if ( *value == '\\' || *value == '"' || *value == '\n' ) {
+      buf[i++] = '\\';
+      buf[i++] = *value == '\n' ? 'n' : *value;
+    }
+    else {
+      buf[i++] = *value;
+    }
+  }
+  buf[i] = '\0';
+}
+
+
+
+/*
+ * metrics_add
+ * one sample of every metric for the id in quota
+ */
+static void metrics_add (struct _metrics_t *m, quota_t *quota, const char *labels, time_t now) {
+  u_int64_t value[METRICS_FAMILIES];
+  int k;
+
+  value[METRICS_BLOCK_USED]  = quota->diskspace_used;
+  value[METRICS_BLOCK_SOFT]  = (u_int64_t) quota->block_soft * BLOCK_SIZE;
+  value[METRICS_BLOCK_HARD]  = (u_int64_t) quota->block_hard * BLOCK_SIZE;
+  value[METRICS_BLOCK_GRACE] = quota->block_time > now ? quota->block_time - now : 0;
+  value[METRICS_INODE_USED]  = quota->inode_used;
+  value[METRICS_INODE_SOFT]  = quota->inode_soft;
+  value[METRICS_INODE_HARD]  = quota->inode_hard;
+  value[METRICS_INODE_GRACE] = quota->inode_time > now ? quota->inode_time - now : 0;
+
+  for (k = 0; k < METRICS_FAMILIES; k++) {
+    fprintf (m->family[k], "%s%s " _METRICS_U64 "\n", metrics_names[k][0], labels, value[k]);
+  }
+  m->ids++;
+}
+
+
+
+/*
+ * metrics_type
+ * walk the ids of one quota type on fs. A type that was not asked
+ * for and isn't enabled on the filesystem is left out quietly.
+ */
+static int metrics_type (struct _metrics_t *m, quota_fs_t *fs, int q_type, int quiet) {
+  char labels[PATH_MAX * 2 + 128];
+  char mount_pt[PATH_MAX * 2];
+  quota_t *quota;
+  time_t now;
+  int found, level;
+
+  level = output_level;
+  if ( quiet ) {
+    output_level = 0;
+  }
+  quota = quota_new (fs, q_type, 0);
+  found = quota ? quota_get_next(quota) : -1;
+  output_level = level;
+  if ( found < 0 ) {
+    if ( quota ) {
+      quota_delete (quota);
+    }
+    if ( quiet ) {
+      output_info ("%s: no %s quotas, left out", fs->_mnt.mount_pt, QUOTA_TYPE_NAME(q_type));
+      return 0;
+    }
+    return ERR_SYS;
+  }
+
+  metrics_label (mount_pt, sizeof(mount_pt), fs->_mnt.mount_pt);
+  now = time(NULL);
+  while ( found > 0 ) {
+    if ( quota->diskspace_used || quota->block_soft || quota->block_hard
+	 || quota->inode_used || quota->inode_soft || quota->inode_hard ) {
+      snprintf (labels, sizeof(labels), "{filesystem=\"%s\",type=\"%s\",id=\"%u\"}",
+		mount_pt, QUOTA_TYPE_NAME(q_type), (unsigned int) quota->_id);
+      metrics_add (m, quota, labels, now);
+    }
+    if ( (unsigned int) quota->_id == (unsigned int) -1 ) {
+      break;
+    }
+    quota->_id++;
+    found = quota_get_next (quota);
+  }
+  quota_delete (quota);
+  return found < 0 ? ERR_SYS : 0;
+}
+
+
+
+/*
+ * metrics_collect
+ * every series of every filesystem, written to out
+ */
+static int metrics_collect (argdata_t *argdata, char **qfiles, int count, FILE *out) {
+  static const int types[] = {
+    QUOTA_USER, QUOTA_GROUP,
+#ifdef QUOTA_PROJECT
+    QUOTA_PROJECT,
+#endif
+  };
+  struct _metrics_t m;
+  quota_fs_t **done, *fs;
+  char buf[64 * 1024];
+  size_t got;
+  int retval, status, i, j, k;
+
+  memset (&m, 0, sizeof(m));
+  for (k = 0; k < METRICS_FAMILIES; k++) {
+    if ( ! (m.family[k] = tmpfile()) ) {
+      output_error ("Failed creating temporary file: %s", strerror(errno));
+      while ( k-- ) {
+	fclose (m.family[k]);
+      }
+      return ERR_SYS;
+    }
+  }
+  done = (quota_fs_t **) calloc (count, sizeof(quota_fs_t *));
+  if ( ! done ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+
+  retval = 0;
+  for (i = 0; i < count; i++) {
+    if ( ! (fs = quota_fs_open(qfiles[i])) ) {
+      retval = ERR_SYS;
+      continue;
+    }
+    /* the same filesystem twice, by another name */
+    for (j = 0; j < i && done[j] != fs; j++);
+    if ( j < i ) {
+      continue;
+    }
+    done[i] = fs;
+
+    for (k = 0; k < (int) (sizeof(types) / sizeof(types[0])); k++) {
+      if ( argdata->id_type && argdata->id_type != types[k] ) {
+	continue;
+      }
+      status = metrics_type (&m, fs, types[k], ! argdata->id_type);
+      if ( status && ! retval ) {
+	retval = status;
+      }
+    }
+  }
+  free (done);
+
+  for (k = 0; k < METRICS_FAMILIES; k++) {
+    fprintf (out, "# HELP %s %s\n# TYPE %s gauge\n", metrics_names[k][0], metrics_names[k][1],
+	     metrics_names[k][0]);
+    rewind (m.family[k]);
+    while ( (got = fread(buf, 1, sizeof(buf), m.family[k])) ) {
+      fwrite (buf, 1, got, out);
+    }
+    if ( ferror(m.family[k]) && ! retval ) {
+      output_error ("Failed reading temporary file: %s", strerror(errno));
+      retval = ERR_SYS;
+    }
+    fclose (m.family[k]);
+  }
+  output_info ("%lu ids with usage or limits on %d filesystems", m.ids, count);
+  return retval;
+}
+
+
+
+/*
+ * metrics_file
+ * write the metrics to file, or stdout for "-"
+ */
+static int metrics_file (argdata_t *argdata, char **qfiles, int count) {
+  char tmp[PATH_MAX];
+  FILE *out;
+  int fd, status;
+
+  if ( ! strcmp(argdata->metrics_file, "-") ) {
+    status = metrics_collect (argdata, qfiles, count, stdout);
+    fflush (stdout);
+    return status;
+  }
+
+  /* in the same directory, for rename() */
+  if ( snprintf(tmp, sizeof(tmp), "%s.%d.tmp", argdata->metrics_file, (int) getpid())
+       >= (int) sizeof(tmp) ) {
+    output_error ("Path too long: %s", argdata->metrics_file);
+    return ERR_ARG;
+  }
+  fd = open (tmp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if ( fd < 0 || ! (out = fdopen(fd, "w")) ) {
+    output_error ("Failed creating %s: %s", tmp, strerror(errno));
+    if ( fd >= 0 ) {
+      close (fd);
+      unlink (tmp);
+    }
+    return ERR_SYS;
+  }
+
+  status = metrics_collect (argdata, qfiles, count, out);
+  if ( fflush(out) || fsync(fd) ) {
+    output_error ("Failed writing %s: %s", tmp, strerror(errno));
+    fclose (out);
+    unlink (tmp);
+    return ERR_SYS;
+  }
+  fclose (out);
+
+  /* with a filesystem failing the others are still put in place */
+  if ( rename(tmp, argdata->metrics_file) < 0 ) {
+    output_error ("Failed renaming %s to %s: %s", tmp, argdata->metrics_file, strerror(errno));
+    unlink (tmp);
+    return ERR_SYS;
+  }
+  return status;
+}
+
+
+
+/*
+ * metrics_answer
+ * read one HTTP request from fd and answer it with the metrics
+ */
+static void metrics_answer (argdata_t *argdata, char **qfiles, int count, int fd) {
+  char request[METRICS_REQUEST_MAX];
+  struct pollfd pfd;
+  size_t len = 0;
+  ssize_t got;
+  FILE *out;
+
+  /* the request line and headers, up to the empty line */
+  request[0] = '\0';
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while ( ! strstr(request, "\r\n\r\n") && ! strstr(request, "\n\n")
+	  && len < sizeof(request) - 1 ) {
+    if ( poll(&pfd, 1, METRICS_REQUEST_TIMEOUT) <= 0 ) {
+      return;
+    }
+    got = read (fd, request + len, sizeof(request) - len - 1);
+    if ( got <= 0 ) {
+      return;
+    }
+    len += got;
+    request[len] = '\0';
+  }
+
+  if ( ! (out = fdopen(dup(fd), "w")) ) {
+    return;
+  }
+  if ( strncmp(request, "GET ", 4) ) {
+    fputs ("HTTP/1.0 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\n\r\n", out);
+  }
+  else {
+    /* HTTP/1.0 and no length: the body ends when the connection does */
+    fputs ("HTTP/1.0 200 OK\r\n"
+	   "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+	   "Connection: close\r\n\r\n", out);
+    metrics_collect (argdata, qfiles, count, out);
+  }
+  fclose (out);
+}
+
+
+
+/*
+ * metrics_http
+ * answer scrapes on 127.0.0.1:port until SIGTERM or SIGINT
+ */
+static int metrics_http (argdata_t *argdata, char **qfiles, int count) {
+  struct sockaddr_in addr;
+  struct sigaction sa;
+  int listen_fd, fd, on = 1;
+
+  listen_fd = socket (AF_INET, SOCK_STREAM, 0);
+  if ( listen_fd < 0 ) {
+    output_error ("Failed creating socket: %s", strerror(errno));
+    return ERR_SYS;
+  }
+  setsockopt (listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  memset (&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons ((unsigned short) argdata->metrics_port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if ( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+       || listen(listen_fd, SOMAXCONN) < 0 ) {
+    output_error ("Failed listening on 127.0.0.1:%d: %s", argdata->metrics_port, strerror(errno));
+    close (listen_fd);
+    return ERR_SYS;
+  }
+
+  /* no SA_RESTART, accept() has to return on a signal */
+  memset (&sa, 0, sizeof(sa));
+  sa.sa_handler = metrics_signal;
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGINT, &sa, NULL);
+  sa.sa_handler = SIG_IGN;
+  sigaction (SIGPIPE, &sa, NULL);
+
+  output_notice ("serving metrics on http://127.0.0.1:%d/metrics", argdata->metrics_port);
+  while ( ! metrics_stop ) {
+    fd = accept (listen_fd, NULL, NULL);
+    if ( fd < 0 ) {
+      continue;
+    }
+    /* filesystems stay open between scrapes, see serve.c */
+    if ( system_mounts_changed() ) {
+      quota_fs_close_stale ();
+    }
+    metrics_answer (argdata, qfiles, count, fd);
+    close (fd);
+    quota_fs_unpin_all ();
+  }
+
+  close (listen_fd);
+  output_notice ("stopped serving metrics on 127.0.0.1:%d", argdata->metrics_port);
+  return 0;
+}
+
+
+
+int metrics_run (argdata_t *argdata, char **qfiles, int count) {
+  int status = 0;
+
+  if ( argdata->metrics_file ) {
+    status = metrics_file (argdata, qfiles, count);
+  }
+  if ( argdata->metrics_port && ! metrics_stop ) {
+    if ( metrics_http(argdata, qfiles, count) && ! status ) {
+      status = ERR_SYS;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,26 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * metrics.h
+ * quotas as Prometheus metrics, for node_exporter or scraped over HTTP
+ */
+#ifndef INCLUDE_QUOTATOOL_METRICS
+#define INCLUDE_QUOTATOOL_METRICS 1
+
+#include <config.h>
+
+#include "parse.h"
+
+/* how long a scraper may take to send its request */
+#define METRICS_REQUEST_TIMEOUT  5000	/* ms */
+#define METRICS_REQUEST_MAX      4096
+
+/* write argdata->metrics_file and/or answer scrapes on
+ * argdata->metrics_port, for every id on the filesystems qfiles */
+int   metrics_run   (argdata_t *argdata, char **qfiles, int count);
+
+#endif /* INCLUDE_QUOTATOOL_METRICS */
@@ -11,9 +11,11 @@
 
 #include <config.h>
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "output.h"
 #include "quotatool.h"
@@ -23,8 +25,15 @@
 #define OUTPUT_INFO     2
 #define OUTPUT_DEBUG    3
 
+/* longer messages are cut */
+#define OUTPUT_LINE_MAX 8192
+
 int output_level = OUTPUT_ERROR;
 
+/* the output_capture_t of each thread that captures */
+static pthread_key_t capture_key;
+static pthread_once_t capture_once = PTHREAD_ONCE_INIT;
+
 
 
 /*
@@ -48,9 +57,17 @@ void output_version () {
 void output_help () {
 
   output_version ();
-  fprintf (stderr, "\nUsage: quotatool -u uid | -g gid options [...] filesystem\n");
-  fprintf (stderr, "       quotatool -u | -g -i | -b  -t time filesystem\n");
+  fprintf (stderr, "\nUsage: quotatool -u uid | -g gid | -p project options [...] filesystem [...] | -a\n");
+  fprintf (stderr, "       quotatool -u | -g | -p -i | -b  -t time filesystem\n");
+  fprintf (stderr, "       quotatool -u | -g | -p [-nRv] --reconcile file filesystem [...] | -a\n");
+  fprintf (stderr, "       quotatool -p project [-nv] --tag-tree directory [...]\n");
+  fprintf (stderr, "       quotatool -p --du filesystem [...] | -a\n");
+  fprintf (stderr, "       quotatool [-u | -g | -p] --metrics file | --metrics-port port filesystem [...] | -a\n");
+  fprintf (stderr, "       quotatool [-nRv] [--no-sync] --batch file\n");
+  fprintf (stderr, "       quotatool [-nRv] [--no-sync] --serve socket [--serve-group group]\n");
   fprintf (stderr, "Options:\n");
+  fprintf (stderr, "  uid, gid and project may be lists: alice,bob,:10000-59999\n");
+  fprintf (stderr, "  -u, -g and -p may be combined, limits go to the one given last before them\n");
   fprintf (stderr, "  -b      : set block limits\n");
   fprintf (stderr, "  -i      : set inode limits\n");
   fprintf (stderr, "\n");
@@ -64,45 +81,114 @@ void output_help () {
   fprintf (stderr, "  -r      : restart grace period for uid or gid\n");
   fprintf (stderr, "  -R      : raise-only, never lower quotas for uid/gid\n");
   fprintf (stderr, "  -d      : dump quota info in machine readable format (see manpage)\n");
+  fprintf (stderr, "  -D      : like -d, for every uid/gid with usage or limits\n");
+  fprintf (stderr, "  --top n      : like -D, the n ids using the most (--by blocks, inodes or percent)\n");
+  fprintf (stderr, "  --over       : like -D, the ids at or over a soft or hard limit\n");
+  fprintf (stderr, "  --summary    : totals and usage percentiles of all ids, a record per filesystem\n");
   fprintf (stderr, "  -h      : show this help\n");
   fprintf (stderr, "  -v      : be verbose (twice or thrice for debugging)\n");
   fprintf (stderr, "  -V      : show version\n");
   fprintf (stderr, "  -n      : do nothing (useful with -v)\n");
+  fprintf (stderr, "  -a, --all-filesystems : all filesystems with quotas on\n");
+  fprintf (stderr, "  --probe-timeout secs : leave out mounts slower to answer for -a (5)\n");
+  fprintf (stderr, "  --batch file : read one command line per line from file ('-' = stdin)\n");
+  fprintf (stderr, "  --reconcile file : set the limits listed in file, only where they differ\n");
+  fprintf (stderr, "  --tag-tree   : put the directories (not filesystems) and all below into the -p project\n");
+  fprintf (stderr, "  --du         : like -d, for each directory in /etc/projects (usage of its project)\n");
+  fprintf (stderr, "  --output fmt : -d, -D, --du and --reconcile -n records as text, csv or ndjson\n");
+  fprintf (stderr, "  --metrics file : write all ids as Prometheus metrics to file (atomically, '-' = stdout)\n");
+  fprintf (stderr, "  --metrics-port port : answer Prometheus scrapes on 127.0.0.1:port\n");
+  fprintf (stderr, "  --no-sync    : don't sync quota files, rely on kernel writeback\n");
+  fprintf (stderr, "  --stats      : time each phase and quotactl() command, print a summary at exit\n");
+  fprintf (stderr, "  --format fmt : don't detect the quota format, use vfsold, vfsv0, vfsv1, xfs or kernel\n");
+  fprintf (stderr, "  --serve socket : answer requests (command lines) on a unix socket\n");
+  fprintf (stderr, "  --serve-group group : members of group may use the socket, besides root\n");
   fprintf (stderr, "\nSee 'man quotatool' for detailed information\n");
 }
 
 
 
+static void _output_capture_init (void) {
+  pthread_key_create (&capture_key, NULL);
+}
+
+/*
+ * output_capture
+ * keep this thread's first error message in capture->buf
+ * instead of printing it, until called again with NULL
+ */
+void output_capture (output_capture_t *capture) {
+  pthread_once (&capture_once, _output_capture_init);
+  if ( capture && capture->size ) {
+    capture->buf[0] = '\0';
+  }
+  pthread_setspecific (capture_key, capture);
+}
+
+
+
 /*
  * _output
  * print status messages if we're supposed to
  */
-static inline void _output (int level, const char *format, va_list arglist)
+static inline void _output (int level, int error, const char *format, va_list arglist)
 {
+  char line[OUTPUT_LINE_MAX];
+  output_capture_t *capture;
+  int len;
+
+  if ( level > output_level && ! error ) {
+    return;
+  }
+  pthread_once (&capture_once, _output_capture_init);
+  if ( (capture = (output_capture_t *) pthread_getspecific(capture_key)) ) {
+    if ( error && capture->size && ! capture->buf[0] ) {
+      vsnprintf (capture->buf, capture->size, format, arglist);
+      len = strlen (capture->buf);
+      while ( len > 0 && capture->buf[len - 1] == '\n' ) {
+	capture->buf[--len] = '\0';
+      }
+    }
+    return;
+  }
+
   if ( level <= output_level ) {
-    fprintf (stderr, "%s: ", PROGNAME);
-    vfprintf (stderr, format, arglist);
-    fprintf (stderr, "\n");
+    /* one write per message (stderr is unbuffered), whole lines from each worker */
+    len = snprintf (line, sizeof(line), "%s: ", PROGNAME);
+    len += vsnprintf (line + len, sizeof(line) - len, format, arglist);
+    if ( len > (int) sizeof(line) - 1 ) {
+      len = sizeof(line) - 1;
+    }
+    line[len++] = '\n';
+    fwrite (line, 1, len, stderr);
   }
 }
 
 void output_error (const char *format, ...) {
   va_list arglist;
   va_start (arglist, format);
-  _output (OUTPUT_ERROR, format, arglist);
+  _output (OUTPUT_ERROR, 1, format, arglist);
+  va_end (arglist);
+}
+
+/* not an error, but shown at the default output level (summaries) */
+void output_notice (const char *format, ...) {
+  va_list arglist;
+  va_start (arglist, format);
+  _output (OUTPUT_ERROR, 0, format, arglist);
   va_end (arglist);
 }
 
 void output_info (const char *format, ...) {
   va_list arglist;
   va_start (arglist, format);
-  _output (OUTPUT_INFO, format, arglist);
+  _output (OUTPUT_INFO, 0, format, arglist);
   va_end (arglist);
 }
 
 void output_debug (const char *format, ...) {
   va_list arglist;
   va_start (arglist, format);
-  _output (OUTPUT_DEBUG, format, arglist);
+  _output (OUTPUT_DEBUG, 0, format, arglist);
   va_end (arglist);
 }
@@ -14,14 +14,26 @@
 #include <config.h>
 
 #include <stdarg.h>
+#include <stddef.h>
 
 extern int output_level;
 
+/* while a thread captures, none of its messages go to stderr and
+ * the first error is kept in buf instead (libquotatool) */
+typedef struct {
+  char *buf;
+  size_t size;
+} output_capture_t;
+
 void   output_version (void);
 void   output_help (void);
 
 void   output_debug (const char *format, ...);
 void   output_info (const char *format, ...);
 void   output_error (const char *format, ...);
+void   output_notice (const char *format, ...);
+
+/* start capturing this thread's messages, NULL stops */
+void   output_capture (output_capture_t *capture);
 
 #endif /* INCLUDE_QUOTATOOL_OUTPUT */
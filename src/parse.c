@@ -18,12 +18,14 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <errno.h>
+#include <getopt.h>
 
 
 #include "quotatool.h"
 #include "output.h"
 #include "parse.h"
 #include "quota.h"
+#include "record.h"
 #include "system.h"
 
 
@@ -31,15 +33,109 @@
 #define ABC "abcdefghijklmnopqrstuvwxyzABCDEFGHIJLKMNOPQRSTUVWXYZ"
 
 #if HAVE_GNU_GETOPT
-#  define OPTSTRING "hVvnu::g::birq:l:t:dR"
+#  define OPTSTRING "hVvnu::g::p::birq:l:t:dDRa"
+#  define REQUEST_OPTSTRING "vnu::g::p::birq:l:t:dDR"
 #else
-#  define OPTSTRING "hVvnu:g:birq:l:t:dR"
+#  define OPTSTRING "hVvnu:g:p:birq:l:t:dDRa"
+#  define REQUEST_OPTSTRING "vnu:g:p:birq:l:t:dDR"
 #endif
 
 
+/* long options without a short equivalent */
+enum {
+    _PARSE_OPT_BATCH = 0x100,
+    _PARSE_OPT_NO_SYNC,
+    _PARSE_OPT_SERVE,
+    _PARSE_OPT_SERVE_GROUP,
+    _PARSE_OPT_RECONCILE,
+    _PARSE_OPT_TAG_TREE,
+    _PARSE_OPT_DU,
+    _PARSE_OPT_OUTPUT,
+    _PARSE_OPT_METRICS,
+    _PARSE_OPT_METRICS_PORT,
+    _PARSE_OPT_STATS,
+    _PARSE_OPT_FORMAT,
+    _PARSE_OPT_TOP,
+    _PARSE_OPT_BY,
+    _PARSE_OPT_OVER,
+    _PARSE_OPT_SUMMARY,
+    _PARSE_OPT_PROBE_TIMEOUT
+};
+
+static struct option long_options[] = {
+  { "batch",    required_argument,  NULL,  _PARSE_OPT_BATCH },
+  { "no-sync",  no_argument,        NULL,  _PARSE_OPT_NO_SYNC },
+  { "serve",    required_argument,  NULL,  _PARSE_OPT_SERVE },
+  { "serve-group", required_argument, NULL, _PARSE_OPT_SERVE_GROUP },
+  { "reconcile", required_argument,  NULL,  _PARSE_OPT_RECONCILE },
+  { "tag-tree", no_argument,        NULL,  _PARSE_OPT_TAG_TREE },
+  { "du",       no_argument,        NULL,  _PARSE_OPT_DU },
+  { "output",   required_argument,  NULL,  _PARSE_OPT_OUTPUT },
+  { "metrics",  required_argument,  NULL,  _PARSE_OPT_METRICS },
+  { "metrics-port", required_argument, NULL, _PARSE_OPT_METRICS_PORT },
+  { "stats",    no_argument,        NULL,  _PARSE_OPT_STATS },
+  { "format",   required_argument,  NULL,  _PARSE_OPT_FORMAT },
+  { "top",      required_argument,  NULL,  _PARSE_OPT_TOP },
+  { "by",       required_argument,  NULL,  _PARSE_OPT_BY },
+  { "over",     no_argument,        NULL,  _PARSE_OPT_OVER },
+  { "summary",  no_argument,        NULL,  _PARSE_OPT_SUMMARY },
+  { "all-filesystems", no_argument, NULL,  'a' },
+  { "probe-timeout", required_argument, NULL, _PARSE_OPT_PROBE_TIMEOUT },
+  { NULL,       0,                  NULL,  0 }
+};
+
+/* all a --serve request may use: getting, setting, resetting and
+ * dumping limits. Everything else is refused, new options too */
+static struct option request_options[] = {
+  { "output",   required_argument,  NULL,  _PARSE_OPT_OUTPUT },
+  { "top",      required_argument,  NULL,  _PARSE_OPT_TOP },
+  { "by",       required_argument,  NULL,  _PARSE_OPT_BY },
+  { "over",     no_argument,        NULL,  _PARSE_OPT_OVER },
+  { "summary",  no_argument,        NULL,  _PARSE_OPT_SUMMARY },
+  { NULL,       0,                  NULL,  0 }
+};
+
+
+/* PARSE_BATCH or PARSE_REQUEST while parsing batch or --serve
+ * records: -h and -V must not exit() then, they are refused instead */
+int parse_records = 0;
+
+
 #define _PARSE_UNDEF 0x00
 #define _PARSE_BLOCK 0x01
 #define _PARSE_INODE 0x02
+
+/*
+ * _parse_type
+ * start on the quota type id_type of the command line: the ids and
+ * limits that follow are for it. Each type may be given once, the
+ * second and third get their own argdata in the data->next chain.
+ * Returns the argdata to fill in, NULL on error
+ */
+static argdata_t *_parse_type (argdata_t *data, argdata_t *cur, int id_type)
+{
+  argdata_t *type;
+
+  if ( ! cur->id_type ) {
+    cur->id_type = id_type;
+    return cur;
+  }
+  for (type = data; type; type = type->next) {
+    if ( type->id_type == id_type ) {
+      output_error ("Only one %s quota can be set", QUOTA_TYPE_NAME(id_type));
+      return NULL;
+    }
+  }
+  type = (argdata_t *) calloc (1, sizeof(argdata_t));
+  if ( ! type ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  type->id_type = id_type;
+  cur->next = type;
+  return type;
+}
+
 /*
  * parse_commandline
  * read our args, parse them
@@ -47,12 +143,13 @@
  */
 argdata_t *parse_commandline (int argc, char **argv)
 {
-  argdata_t *data;
+  argdata_t *data, *cur, *next;
   extern char *optarg;
   extern int optind, opterr, optopt;
-  int done, fail;
+  int done, fail, by_given;
   int quota_type;
-  int opt;
+  int opt, i;
+  char *end;
 
   if (argc == 1) {
     output_help ();
@@ -65,14 +162,28 @@ argdata_t *parse_commandline (int argc, char **argv)
     exit (ERR_MEM);
   }
 
+  cur = data;
+  by_given = 0;
   quota_type = _PARSE_UNDEF;
   optarg = NULL;
   opterr = 0;
+
+  /* we may be called again for every line in batch mode */
+#if HAVE_GNU_GETOPT
+  optind = 0;
+#else
+  optreset = 1;
+  optind = 1;
+#endif
+
   done = fail = 0;
   while ( ! done && ! fail ) {
-    opt = getopt(argc, argv, OPTSTRING);
+    if ( parse_records == PARSE_REQUEST )
+      opt = getopt_long(argc, argv, REQUEST_OPTSTRING, request_options, NULL);
+    else
+      opt = getopt_long(argc, argv, OPTSTRING, long_options, NULL);
 
-    if (opt > 0)
+    if (opt > 0 && opt < _PARSE_OPT_BATCH)
        output_debug ("option: '%c', argument: '%s'", opt, optarg);
 
     switch (opt) {
@@ -82,11 +193,16 @@ argdata_t *parse_commandline (int argc, char **argv)
       break;
 
     case 'h':
-      output_help ();
-      exit (0);
-
     case 'V':
-      output_version();
+      if ( parse_records ) {
+	output_error ("Option '%c' is only for the command line", opt);
+	fail = 1;
+	break;
+      }
+      if ( opt == 'h' )
+	output_help ();
+      else
+	output_version ();
       exit (0);
 
     case 'v':
@@ -99,70 +215,103 @@ argdata_t *parse_commandline (int argc, char **argv)
 
 
     case 'u':   /* set username */
-      if ( data->id_type ) {
-	output_error("Only one quota (user or group) can be set");
+      if ( ! (next = _parse_type(data, cur, QUOTA_USER)) ) {
 	fail = 1;
 	continue;
       }
-      data->id_type = QUOTA_USER;
+      cur = next;
 #if HAVE_GNU_GETOPT
       /* -uuser */
       if ( optarg ) {
 	output_debug ("not mangling: optarg='%s', next='%s'", optarg,
 		      argv[optind]);
-	data->id = optarg;
+	cur->id = optarg;
       }
       /* -u [-next-opt] */
       else if ( ! argv[optind] || argv[optind][0] == '-' ) {
 	output_debug ("not mangling: NULL user");
-	data->id = NULL;
+	cur->id = NULL;
       }
       /* -u user */
       else {
 	output_debug ("mangling everything: next='%s'", argv[optind]);
-	data->id = argv[optind];
+	cur->id = argv[optind];
 	optind++;
       }
 #else
-      if (optarg && ((data->block_grace || data->inode_grace) || (optarg[0] == '-'))) {
+      if (optarg && ((cur->block_grace || cur->inode_grace) || (optarg[0] == '-'))) {
           /* -u [-next-opt] */
           optind--;
-          data->id = NULL;
+          cur->id = NULL;
       }
       else {
           /* -u user */
-          data->id = optarg;
+          cur->id = optarg;
       }
 #endif
-      output_info ("using uid %s", data->id);
+      output_info ("using uid %s", cur->id);
       break;
 
     case 'g':   /* set groupname */
-      if ( data->id_type ) {
-	output_error("Only one quota (user or group) can be set");
+      if ( ! (next = _parse_type(data, cur, QUOTA_GROUP)) ) {
 	fail = 1;
 	continue;
       }
-      data->id_type = QUOTA_GROUP;
+      cur = next;
 #if HAVE_GNU_GETOPT
       if ( optarg ) {
 	output_debug ("not mangling: optarg='%s', next='%s'", optarg,
 		      argv[optind]);
-	data->id = optarg;
+	cur->id = optarg;
       }
       else if ( ! argv[optind] || argv[optind][0] == '-' ) {
 	output_debug ("not mangling: NULL user");
-	data->id = NULL;
+	cur->id = NULL;
       }
       else {
 	output_debug ("mangling everything: next='%s', argv[optind]");
-	data->id = argv[optind];
+	cur->id = argv[optind];
 	optind++;
       }
 #else
-      data->id = optarg;
+      cur->id = optarg;
 #endif
-      output_info ("using gid  %s", data->id);
+      output_info ("using gid  %s", cur->id);
+      break;
+
+    case 'p':   /* set project */
+#ifdef QUOTA_PROJECT
+      if ( ! (next = _parse_type(data, cur, QUOTA_PROJECT)) ) {
+	fail = 1;
+	continue;
+      }
+      cur = next;
+#else
+      output_error ("Project quotas are not supported on this platform");
+      fail = 1;
+      continue;
+#endif
+#if HAVE_GNU_GETOPT
+      if ( optarg ) {
+	cur->id = optarg;
+      }
+      else if ( ! argv[optind] || argv[optind][0] == '-' ) {
+	cur->id = NULL;
+      }
+      else {
+	cur->id = argv[optind];
+	optind++;
+      }
+#else
+      if (optarg && ((cur->block_grace || cur->inode_grace) || (optarg[0] == '-'))) {
+          optind--;
+          cur->id = NULL;
+      }
+      else {
+          cur->id = optarg;
+      }
+#endif
+      output_info ("using project %s", cur->id);
       break;
 
     case 'b':   // Work with block limits
@@ -182,10 +331,10 @@ argdata_t *parse_commandline (int argc, char **argv)
 	fail = 1;
 	break;
       case _PARSE_BLOCK:
-	data->block_soft = optarg;
+	cur->block_soft = optarg;
 	break;
       case _PARSE_INODE:
-	data->inode_soft = optarg;
+	cur->inode_soft = optarg;
 	break;
       default:
 	output_error ("Impossible error #42q: evacuate the building!");
@@ -202,10 +351,10 @@ argdata_t *parse_commandline (int argc, char **argv)
 	fail = 1;
 	break;
       case _PARSE_BLOCK:
-	data->block_hard = optarg;
+	cur->block_hard = optarg;
 	break;
       case _PARSE_INODE:
-	data->inode_hard = optarg;
+	cur->inode_hard = optarg;
 	break;
       default:
 	output_error ("Impossible error #42l: evacuate the building!");
@@ -217,17 +366,17 @@ argdata_t *parse_commandline (int argc, char **argv)
 
 
     case 't': // set grace period
-      data->id = NULL;
+      cur->id = NULL;
       switch ( quota_type ) {
       case _PARSE_UNDEF:
 	output_error ("Must specify either block (-b) or inode (-i) before -t");
 	fail = 1;
 	break;
       case _PARSE_BLOCK:
-	data->block_grace = optarg;
+	cur->block_grace = optarg;
 	break;
       case _PARSE_INODE:
-	data->inode_grace = optarg;
+	cur->inode_grace = optarg;
 	break;
       default:
 	output_error ("Impossible error #42t: evacuate the building!");
@@ -243,10 +392,10 @@ argdata_t *parse_commandline (int argc, char **argv)
 	fail = 1;
 	break;
       case _PARSE_BLOCK:
-	data->block_reset = 1;
+	cur->block_reset = 1;
 	break;
       case _PARSE_INODE:
-	data->inode_reset = 1;
+	cur->inode_reset = 1;
 	break;
       default:
 	output_error ("Impossible error #42r: evacuate the building!");
@@ -258,16 +407,163 @@ argdata_t *parse_commandline (int argc, char **argv)
        data->dump_info = 1;
        break;
 
+    case 'D':
+       data->dump_all = 1;
+       break;
+
     case 'R':
        data->raise_only = 1;
        break;
 
+    case 'a':
+       data->all_fs = 1;
+       output_info ("using all filesystems with quotas enabled");
+       break;
+
+    case _PARSE_OPT_BATCH:
+       data->batch_file = optarg;
+       output_info ("reading batch records from %s",
+		    strcmp(optarg, "-") ? optarg : "stdin");
+       break;
+
+    case _PARSE_OPT_NO_SYNC:
+       if ( parse_records ) {
+	 output_error ("Option '--no-sync' is only for the command line");
+	 fail = 1;
+	 break;
+       }
+       data->no_sync = 1;
+       output_info ("not syncing quota files, relying on kernel writeback");
+       break;
+
+    case _PARSE_OPT_SERVE:
+       data->serve_socket = optarg;
+       break;
+
+    case _PARSE_OPT_SERVE_GROUP:
+       data->serve_group = optarg;
+       break;
+
+    case _PARSE_OPT_RECONCILE:
+       data->reconcile_file = optarg;
+       output_info ("reading desired limits from %s",
+		    strcmp(optarg, "-") ? optarg : "stdin");
+       break;
+
+    case _PARSE_OPT_TAG_TREE:
+       data->tag_tree = 1;
+       break;
+
+    case _PARSE_OPT_DU:
+       data->du = 1;
+       break;
+
+    case _PARSE_OPT_METRICS:
+       data->metrics_file = optarg;
+       break;
+
+    case _PARSE_OPT_METRICS_PORT:
+       data->metrics_port = (int) strtol (optarg, &end, 10);
+       if ( *end || data->metrics_port < 1 || data->metrics_port > 65535 ) {
+	 output_error ("Bad port '%s' for --metrics-port", optarg);
+	 fail = 1;
+       }
+       break;
+
+    case _PARSE_OPT_STATS:
+       if ( parse_records ) {
+	 output_error ("Option '--stats' is only for the command line");
+	 fail = 1;
+	 break;
+       }
+       data->stats = 1;
+       break;
+
+    case _PARSE_OPT_FORMAT:
+       if ( parse_records ) {
+	 output_error ("Option '--format' is only for the command line");
+	 fail = 1;
+       }
+#if PLATFORM_LINUX
+       else if ( ! quota_format_force(optarg) ) {
+	 output_error ("Unknown quota format '%s', use vfsold, vfsv0, vfsv1, xfs or kernel", optarg);
+	 fail = 1;
+       }
+#else
+       else {
+	 output_error ("--format is only supported on Linux");
+	 fail = 1;
+       }
+#endif
+       break;
+
+    /* --top, --over and --summary are -D, reduced */
+    case _PARSE_OPT_TOP:
+       data->top = (int) strtol (optarg, &end, 10);
+       if ( *end || data->top < 1 ) {
+	 output_error ("Bad number '%s' for --top", optarg);
+	 fail = 1;
+       }
+       data->dump_all = 1;
+       break;
+
+    case _PARSE_OPT_BY:
+       if ( ! strcmp(optarg, "blocks") ) {
+	 data->top_by = PARSE_TOP_BLOCKS;
+       }
+       else if ( ! strcmp(optarg, "inodes") ) {
+	 data->top_by = PARSE_TOP_INODES;
+       }
+       else if ( ! strcmp(optarg, "percent") ) {
+	 data->top_by = PARSE_TOP_PERCENT;
+       }
+       else {
+	 output_error ("Unknown ranking '%s' for --by, use blocks, inodes or percent", optarg);
+	 fail = 1;
+       }
+       by_given = 1;
+       break;
+
+    case _PARSE_OPT_OVER:
+       data->over = 1;
+       data->dump_all = 1;
+       break;
+
+    case _PARSE_OPT_SUMMARY:
+       data->summary = 1;
+       data->dump_all = 1;
+       break;
+
+    case _PARSE_OPT_PROBE_TIMEOUT:
+       data->probe_timeout = (int) strtol (optarg, &end, 10);
+       if ( *end || data->probe_timeout < 1 ) {
+	 output_error ("Bad number of seconds '%s' for --probe-timeout", optarg);
+	 fail = 1;
+       }
+       break;
+
+    case _PARSE_OPT_OUTPUT:
+       if ( ! record_set_format(optarg) ) {
+	 output_error ("Unknown output format '%s', use text, csv or ndjson", optarg);
+	 fail = 1;
+       }
+       break;
+
     case ':':
       output_error ("Option '%c' requires an argument", optopt);
       break;
 
     case '?':
-      output_error ("Unrecognized option: '%c'", optopt);
+      if ( optopt >= _PARSE_OPT_BATCH )
+	output_error ("Option '%s' requires an argument", argv[optind - 1]);
+      else if ( optopt && parse_records == PARSE_REQUEST )
+	output_error ("Option '%c' cannot be used in a request", optopt);
+      else if ( optopt )
+	output_error ("Unrecognized option: '%c'", optopt);
+      else if ( parse_records == PARSE_REQUEST )
+	output_error ("Option '%s' cannot be used in a request", argv[optind - 1]);
+      else
+	output_error ("Unrecognized option: '%s'", argv[optind - 1]);
       // fall through
 
     default:
@@ -278,51 +574,191 @@ argdata_t *parse_commandline (int argc, char **argv)
   }
 
   if ( fail ) {
-    free (data);
-    return NULL;
+    goto invalid;
   }
 
-  if ( ! data->id_type ) {
+  if ( by_given && ! data->top ) {
+    output_error ("--by needs --top");
+    goto invalid;
+  }
+
+  if ( data->serve_group && ! data->serve_socket ) {
+    output_error ("--serve-group needs --serve");
+    goto invalid;
+  }
+
+  /* several quota types only for getting and setting limits */
+  if ( data->next && (data->batch_file || data->serve_socket || data->metrics_file
+		      || data->metrics_port || data->tag_tree || data->du
+		      || data->dump_all || data->reconcile_file) ) {
+    output_error ("Wrong options for several quota types, please see manpage for usage instructions!");
+    goto invalid;
+  }
+
+  /* in batch and server mode ids, limits and filesystems come from the records,
+   * only -n, -R, -v and --no-sync may be given on the command line */
+  if ( data->batch_file || data->serve_socket ) {
+    if ( data->id_type || argv[optind] || data->dump_info || data->dump_all || data->all_fs
+	 || data->probe_timeout || data->reconcile_file || data->tag_tree || data->du
+	 || data->metrics_file || data->metrics_port
+	 || data->block_hard || data->block_soft || data->block_grace || data->block_reset
+	 || data->inode_hard || data->inode_soft || data->inode_grace || data->inode_reset
+	 || (data->batch_file && data->serve_socket) ) {
+      output_error ("Wrong options for %s, please see manpage for usage instructions!",
+		    data->batch_file ? "--batch" : "--serve");
+      goto invalid;
+    }
+    return data;
+  }
+
+  /* metrics take every id, of every quota type unless one is given */
+  if ( data->metrics_file || data->metrics_port ) {
+    if ( data->id || data->dump_info || data->dump_all || data->du
+	 || data->reconcile_file || data->tag_tree
+	 || data->block_hard || data->block_soft || data->block_grace || data->block_reset
+	 || data->inode_hard || data->inode_soft || data->inode_grace || data->inode_reset ) {
+      output_error ("Wrong options for --metrics, please see manpage for usage instructions!");
+      goto invalid;
+    }
+  }
+  else if ( ! data->id_type ) {
     output_error ("Must specify either user or group quota");
-    return NULL;
+    goto invalid;
   }
 
-  if ( data->dump_info) {
-     output_info("Option 'd' => just dumping quota-info for %s", data->id_type == QUOTA_USER ? "user" : "group");
+  /* --tag-tree takes a project id and directories, nothing else */
+  if ( data->tag_tree ) {
+    if ( data->id_type == QUOTA_USER || data->id_type == QUOTA_GROUP || ! data->id
+	 || data->dump_info || data->dump_all || data->all_fs || data->reconcile_file
+	 || data->block_hard || data->block_soft || data->block_grace || data->block_reset
+	 || data->inode_hard || data->inode_soft || data->inode_grace || data->inode_reset ) {
+      output_error ("Wrong options for --tag-tree, please see manpage for usage instructions!");
+      goto invalid;
+    }
   }
 
-  /* the remaining arg is the filesystem */
-  data->qfile = argv[optind];
-  if ( ! data->qfile || strlen(data->qfile) == 0) {
-    output_error ("No filesystem specified");
-    return NULL;
+  /* --du reports projects, it takes no id or limits */
+  if ( data->du ) {
+    if ( data->id_type == QUOTA_USER || data->id_type == QUOTA_GROUP || data->id
+	 || data->dump_info || data->dump_all || data->reconcile_file || data->tag_tree
+	 || data->block_hard || data->block_soft || data->block_grace || data->block_reset
+	 || data->inode_hard || data->inode_soft || data->inode_grace || data->inode_reset ) {
+      output_error ("Wrong options for --du, please see manpage for usage instructions!");
+      goto invalid;
+    }
+    output_info ("Option 'du' => dumping usage of the directories in %s", PROJECTS_FILE);
   }
 
-  /* remove trailing slash(es) except for / filesystem */
-  while (strlen(data->qfile) > 1) {
-    if (data->qfile[strlen(data->qfile) - 1] != '/') break;
-    data->qfile[strlen(data->qfile) - 1] = '\0';
+  /* check for mixing -D with other options, it takes no id or limits */
+  if ( data->dump_all ) {
+    if ( data->id || data->dump_info || (data->summary && (data->top || data->over))
+	 || data->block_hard || data->block_soft || data->block_grace || data->block_reset
+	 || data->inode_hard || data->inode_soft || data->inode_grace || data->inode_reset ) {
+      output_error ("Wrong options for %s, please see manpage for usage instructions!",
+		    data->summary ? "--summary" : data->top ? "--top" : data->over ? "--over" : "-D");
+      goto invalid;
+    }
+    if ( data->summary ) {
+      output_info ("Option 'summary' => summing up all %ss", QUOTA_TYPE_NAME(data->id_type));
+    }
+    else if ( data->top ) {
+      output_info ("Option 'top' => dumping quota-info for the %d heaviest %ss", data->top,
+		   QUOTA_TYPE_NAME(data->id_type));
+    }
+    else {
+      output_info ("Option 'D' => dumping quota-info for all %ss", QUOTA_TYPE_NAME(data->id_type));
+    }
   }
 
-  /* check for mixing -t with other options in the wrong way */
-  if (data->block_grace || data->inode_grace) {
-     if (data->block_hard || data->block_soft || data->inode_hard || data->inode_soft || data->id) {
-	output_error("Wrong options for -t, please see manpage for usage instructions!");
-	return NULL;
-     }
+  /* --reconcile takes its ids and limits from the file */
+  if ( data->reconcile_file ) {
+    if ( data->id || data->dump_info || data->dump_all
+	 || data->block_hard || data->block_soft || data->block_grace || data->block_reset
+	 || data->inode_hard || data->inode_soft || data->inode_grace || data->inode_reset ) {
+      output_error ("Wrong options for --reconcile, please see manpage for usage instructions!");
+      goto invalid;
+    }
   }
 
-  /* check for mixing -r with other options in the wrong way */
-  if (data->block_reset || data->inode_reset) {
-      if (data->block_hard || data->block_soft || data->inode_hard || data->inode_soft) {
-          output_error("Wrong options for -r, please see manpage for usage instructions!");
-          return NULL;
-      }
+  if ( data->dump_info) {
+     output_info("Option 'd' => just dumping quota-info for %s", QUOTA_TYPE_NAME(data->id_type));
+  }
+
+  /* -a finds the filesystems itself, else the remaining args are the filesystems */
+  if ( data->all_fs ) {
+    if ( argv[optind] ) {
+      output_error ("Wrong options for -a, please see manpage for usage instructions!");
+      goto invalid;
+    }
+  }
+  else if ( data->probe_timeout ) {
+    output_error ("--probe-timeout needs -a");
+    goto invalid;
+  }
+  else {
+    data->qfiles = argv + optind;
+    data->qfile_count = argc - optind;
+    data->qfile = argv[optind];
+    if ( ! data->qfile ) {
+      output_error ("No filesystem specified");
+      goto invalid;
+    }
+  }
+
+  for (i = 0; i < data->qfile_count; i++) {
+    if ( strlen(data->qfiles[i]) == 0 ) {
+      output_error ("No filesystem specified");
+      goto invalid;
+    }
+    /* remove trailing slash(es) except for / filesystem */
+    while (strlen(data->qfiles[i]) > 1) {
+      if (data->qfiles[i][strlen(data->qfiles[i]) - 1] != '/') break;
+      data->qfiles[i][strlen(data->qfiles[i]) - 1] = '\0';
+    }
   }
 
-  output_info ("using filesystem %s", data->qfile);
+  for (cur = data; cur; cur = cur->next) {
+    /* check for mixing -t with other options in the wrong way */
+    if (cur->block_grace || cur->inode_grace) {
+       if (cur->block_hard || cur->block_soft || cur->inode_hard || cur->inode_soft || cur->id) {
+	  output_error("Wrong options for -t, please see manpage for usage instructions!");
+	  goto invalid;
+       }
+    }
+
+    /* check for mixing -r with other options in the wrong way */
+    if (cur->block_reset || cur->inode_reset) {
+	if (cur->block_hard || cur->block_soft || cur->inode_hard || cur->inode_soft) {
+	    output_error("Wrong options for -r, please see manpage for usage instructions!");
+	    goto invalid;
+	}
+    }
+  }
+
+  for (i = 0; i < data->qfile_count; i++) {
+    output_info ("using filesystem %s", data->qfiles[i]);
+  }
 
   return data;
+
+ invalid:
+  parse_free (data);
+  return NULL;
+}
+
+/*
+ * parse_free
+ * free what parse_commandline() returned, all quota types
+ */
+void parse_free (argdata_t *data)
+{
+  argdata_t *next;
+
+  while ( data ) {
+    next = data->next;
+    free (data);
+    data = next;
+  }
 }
 
 #define _PARSE_OP_ADD '+'
@@ -416,7 +852,8 @@ time_t parse_timespan (time_t orig, char *string)
 /*
  * parse_size
  * understands Kb, Mb, Gb, Tb, bytes, and disk blocks
- * returns the number of bytes represented
+ * returns the number of blocks or inodes represented,
+ * (u_int64_t) -1 for a negative size
  */
 u_int64_t parse_size (u_int64_t orig, char *string, int parse_type) {
   char *cp;
@@ -440,7 +877,8 @@ u_int64_t parse_size (u_int64_t orig, char *string, int parse_type) {
   /* negative sizes make no sense */
   if (count<0)
   {
-    exit (ERR_ARG);
+    output_error ("Invalid size: %s", string);
+    return (u_int64_t) -1;
   }
 
   /* remove whitespace */
@@ -16,6 +16,13 @@ enum {
     PARSE_INODES = 2
 };
 
+/* what --top ranks by, see --by */
+enum {
+    PARSE_TOP_BLOCKS = 0,
+    PARSE_TOP_INODES = 1,
+    PARSE_TOP_PERCENT = 2
+};
+
 #include <config.h>
 
 #include <sys/types.h> /* *BSD */
@@ -23,12 +30,33 @@ enum {
 
 struct _argdata_t {
   char *id;
-  char *qfile;
+  char *qfile;      // the first (often only) filesystem
+  char **qfiles;    // all filesystems given, NULL terminated
+  int qfile_count;
+  short all_fs;     // every filesystem mounted with quotas, instead of qfiles
+  int probe_timeout; // with all_fs: seconds a filesystem may take to answer, 0 = default
   short id_type;
   short silent;
   short noaction;
   short dump_info; // don't touch anything, just dump machine-readable info for user/group
+  short dump_all;  // like dump_info, for every id with a quota record on the filesystem
+  int top;         // with dump_all: only the top ids, ranked by top_by
+  short top_by;    // PARSE_TOP_*
+  short over;      // with dump_all: only ids at or over a soft or hard limit
+  short summary;   // with dump_all: totals and usage quantiles, one record per filesystem
   short raise_only; // When changing quotas, don't lower - just raise
+  char *batch_file; // read one command line per line from this file ("-" = stdin)
+  short stats;      // time phases and quotactl()s, print them at exit
+  short no_sync;    // don't Q_SYNC after setting quotas, rely on kernel writeback
+  char *serve_socket; // answer requests on this unix socket (daemon mode)
+  char *serve_group;  // members of this group may use the socket, besides root
+  char *reconcile_file; // desired limits, one id per line: set only those that differ
+  short tag_tree;   // put the trees in qfiles (directories) into project id
+  short du;         // usage of each directory in /etc/projects, from its project quota
+  char *metrics_file; // write all ids as Prometheus metrics to this file ("-" = stdout)
+  int metrics_port;   // answer Prometheus scrapes on 127.0.0.1:port
+  struct _argdata_t *next; // the next quota type (-u, -g, -p) of the command line, or NULL.
+                           // Only its id, id_type and limit fields are set, the rest is here
 
   char *block_hard;
   char *block_soft;
@@ -43,7 +71,14 @@ struct _argdata_t {
 typedef struct _argdata_t argdata_t;
 
 
+/* what parse_records is set to */
+#define PARSE_BATCH    1    /* --batch lines */
+#define PARSE_REQUEST  2    /* --serve requests, only get/set/reset/dump options */
+
+extern int parse_records;
+
 argdata_t *   parse_commandline   (int argc, char **argv);
+void          parse_free          (argdata_t *data);
 time_t        parse_timespan      (time_t orig, char *string);
 u_int64_t     parse_size          (u_int64_t orig, char *string, int parse_type);
 
@@ -12,6 +12,7 @@
 #define INCLUDE_QUOTATOOL_QUOTA
 
 #include "quotatool.h"
+#include "system.h"
 #include <config.h>
 
 /* Find out the system BLOCK_SIZE */
@@ -35,6 +36,7 @@
 #  include "linux/linux_quota.h"
 #  define QUOTA_USER  USRQUOTA + 1
 #  define QUOTA_GROUP GRPQUOTA + 1
+#  define QUOTA_PROJECT PRJQUOTA + 1
 #elif HAVE_UFS_UFS_QUOTA_H /* FreeBSD || OpenBSD */
 #  include <sys/types.h>
 #  include <ufs/ufs/quota.h>
@@ -44,6 +46,10 @@
 #  error "no quota headers found"
 #endif
 
+/* what the ids of a quota type are called in output */
+#define QUOTA_ID_NAME(q_type) ((q_type) == QUOTA_USER ? "uid" : (q_type) == QUOTA_GROUP ? "gid" : "project")
+#define QUOTA_TYPE_NAME(q_type) ((q_type) == QUOTA_USER ? "user" : (q_type) == QUOTA_GROUP ? "group" : "project")
+
 
 // Upwards integer division, always make room for remainder
 #define DIV_UP(a, b) ( (a) % (b) == 0 ? (a) / (b) : ((a) / (b) + 1))
@@ -54,6 +60,30 @@
 // Convert from system block-size to Kb. The constant 8 allows for BLOCK_SIZE >= 1024 / 8 (= 128 bytes)
 #define BLOCKS_TO_KB(num_blocks) ((BLOCK_SIZE == 1) ? DIV_UP(num_blocks, 1024) : DIV_UP((num_blocks) * ((BLOCK_SIZE * 8) / 1024), 8))
 
+/*
+ * A filesystem with quotas, resolved and probed once and shared by
+ * all quota_t's on it. Several can be open at the same time, e.g.
+ * one on ext4 and one on XFS, each with its own quota format.
+ */
+struct _quota_fs_t {
+   fs_t    _mnt;                    /* device, mount point and type */
+   char *  _qfile;                  /* passed to quotactl: device (linux) or mount point (bsd) */
+   int     _fd;                     /* mount point, for quotactl_fd() (linux), or -1 */
+   int     _fd_unpinned;            /* _fd closed by quota_fs_unpin_all(), open it again */
+   int     _format[MAXQUOTAS];      /* detected quota format per quota type, 0 = not yet */
+   int     _iface[MAXQUOTAS];       /* kernel quota interface per quota type */
+   void *  _quotainfo[MAXQUOTAS];   /* format specific grace info per quota type */
+   int     _grace_loaded[MAXQUOTAS];  /* grace periods below are valid */
+   time_t  _block_grace[MAXQUOTAS];
+   time_t  _inode_grace[MAXQUOTAS];
+   int     _dirty[MAXQUOTAS];       /* quotas were set, Q_SYNC pending */
+   int     _syncs_needed;
+   int     _syncs_issued;
+   struct _quota_fs_t *_next;
+};
+
+typedef struct _quota_fs_t quota_fs_t;
+
 struct _quota_t {
    u_int64_t	block_hard;
    u_int64_t	block_soft;
@@ -67,11 +97,10 @@ struct _quota_t {
    time_t  inode_grace;
    int     _id;
    int     _id_type;
-   char *  _qfile;
+   char *  _qfile;                  /* borrowed from _fs */
+   quota_fs_t * _fs;
    int     _do_set_global_block_gracetime;
    int     _do_set_global_inode_gracetime;
-   void *  _v0_quotainfo;
-   void *  _generic_quotainfo;
 };
 
 #define GRACE_BLOCK 1
@@ -79,13 +108,47 @@ struct _quota_t {
 
 typedef struct _quota_t quota_t;
 
-quota_t *   quota_new      (int q_type, int id, char *device);
+/* look up fs_spec (device or mount point). Asking twice for the same
+ * filesystem returns the same handle, it stays open until closed */
+quota_fs_t *quota_fs_open  (char *fs_spec);
+void        quota_fs_close (quota_fs_t *fs);
+
+/* between --serve requests and --metrics-port scrapes: close the
+ * filesystems that are no longer mounted as they were when opened,
+ * and let go of the mount points of the others so that umount doesn't
+ * fail with EBUSY. Those keep their quota formats */
+void        quota_fs_close_stale (void);
+void        quota_fs_unpin_all (void);
+
+/* quota_new() detects the quota format of q_type on fs the first time
+ * it is asked for, after that it only allocates */
+quota_t *   quota_new      (quota_fs_t *fs, int q_type, int id);
 void        quota_delete   (quota_t *myquota);
 
 int         quota_get      (quota_t *myquota);
 int         quota_set      (quota_t *myquota);
 
+/* quota_get() leaves block_grace and inode_grace alone where that would
+ * take another quotactl(). Callers that need them (-t, -r) ask here, the
+ * grace periods are fetched once per filesystem and quota type */
+int         quota_get_grace(quota_t *myquota);
+void        quota_forget_grace(void);
+void        quota_info_stats(int *issued, int *avoided);
+
+/* fetch the first id >= myquota->_id that has a quota record and store
+ * it in myquota->_id. Grace periods are not fetched.
+ * Returns 1 if an id was found, 0 if there are no more, -1 on error */
+int         quota_get_next (quota_t *myquota);
+
 int         quota_reset_grace(quota_t *myquota, int grace_type);
 
+/* when quota_set() flushes the kernel's quota files with Q_SYNC */
+#define QUOTA_SYNC_DEFERRED 1   /* once per filesystem, in quota_sync_all() (default) */
+#define QUOTA_SYNC_NEVER    2   /* never, rely on kernel writeback */
+
+void        quota_sync_mode(int mode);
+int         quota_fs_sync  (quota_fs_t *fs);
+int         quota_sync_all (void);
+
 
 #endif /* INCLUDE_QUOTATOOL_QUOTA */
@@ -0,0 +1,403 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * reconcile.c
+ * bring the limits on a filesystem in line with a desired-state file
+ *
+ * Every line of the file is one user (or group) and its four limits:
+ *
+ *   # id        block-soft  block-hard  inode-soft  inode-hard
+ *   alice       800M        1G          0           0
+ *   :12345      -           10G         -           50k
+ *
+ * Limits take the same units as -q and -l, 0 means no limit and "-"
+ * leaves that limit as it is. Ids not in the file are not touched.
+ * The current limits are read with one walk over the kernel's list
+ * (Q_GETNEXTQUOTA), and only ids whose limits differ are set.
+ */
+#include <config.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_INTTYPES_H
+#include <inttypes.h>
+#endif
+
+#include "quotatool.h"
+#include "output.h"
+#include "parse.h"
+#include "quota.h"
+#include "reconcile.h"
+#include "record.h"
+#include "stats.h"
+#include "system.h"
+
+#define WHITESPACE " \t\r\n"
+
+#ifdef HAVE_INTTYPES_H
+#  define _RECONCILE_U64 "%" PRIu64
+#else
+#  define _RECONCILE_U64 "%llu"
+#endif
+
+static const char *limit_names[RECONCILE_LIMITS] = {
+  "block soft", "block hard", "inode soft", "inode hard"
+};
+
+/* fields of a -n plan record */
+static const char *const plan_fields[] = {
+  "type", "id", "filesystem", "block_soft_old_kb", "block_soft_new_kb",
+  "block_hard_old_kb", "block_hard_new_kb", "inode_soft_old", "inode_soft_new",
+  "inode_hard_old", "inode_hard_new", NULL
+};
+
+
+
+static int reconcile_cmp_id (const void *a, const void *b) {
+  const struct _reconcile_ent_t *x = a, *y = b;
+
+  if ( x->id != y->id ) {
+    return x->id < y->id ? -1 : 1;
+  }
+  return 0;
+}
+
+/* by id, and a repeated id in file order */
+static int reconcile_cmp (const void *a, const void *b) {
+  const struct _reconcile_ent_t *x = a, *y = b;
+  int cmp = reconcile_cmp_id (a, b);
+
+  return cmp ? cmp : x->lineno - y->lineno;
+}
+
+
+
+/*
+ * reconcile_getid
+ * the uid, gid or project id of the first word of a line, -1 if none.
+ * Same rules as -u, -g and -p: a name, or ':' and a number
+ */
+static int reconcile_getid (char *word, int id_type) {
+  char *end;
+  long id;
+
+  if ( word[0] == ':' && isdigit(word[1]) ) {
+    id = strtol (word + 1, &end, 10);
+    if ( *end || id < 0 ) {
+      output_error ("Bad id %s", word);
+      return -1;
+    }
+    return (int) id;
+  }
+  if ( id_type == QUOTA_USER ) {
+    return (int) system_getuid (word);
+  }
+  if ( id_type == QUOTA_GROUP ) {
+    return (int) system_getgid (word);
+  }
+  return system_getprjid (word);
+}
+
+
+
+/*
+ * reconcile_line
+ * fill ent from the words of one line, 0 if the line is wrong
+ */
+static int reconcile_line (struct _reconcile_ent_t *ent, char **word, int id_type) {
+  int id, k;
+  u_int64_t start;
+
+  start = stats_now ();
+  id = reconcile_getid (word[0], id_type);
+  stats_phase (STATS_IDS, start);
+  if ( id < 0 ) {
+    return 0;
+  }
+  ent->id = (unsigned int) id;
+
+  for (k = 0; k < RECONCILE_LIMITS; k++) {
+    ent->want[k] = ent->have[k] = 0;
+    ent->keep[k] = 0;
+    if ( ! strcmp(word[k + 1], "-") ) {
+      ent->keep[k] = 1;
+      continue;
+    }
+    /* no +/-: the file says what the limit is, not how to change it */
+    if ( ! isdigit(word[k + 1][0]) && word[k + 1][0] != '.' ) {
+      output_error ("line %d: bad %s limit '%s'", ent->lineno, limit_names[k], word[k + 1]);
+      return 0;
+    }
+    ent->want[k] = parse_size (0, word[k + 1],
+			       k <= RECONCILE_BLOCK_HARD ? PARSE_BLOCKS : PARSE_INODES);
+  }
+  return 1;
+}
+
+
+
+/*
+ * reconcile_load
+ * read a desired-state file ("-" = stdin). All lines are checked
+ * before giving up, so every mistake is reported at once.
+ */
+reconcile_t *reconcile_load (char *file, int id_type) {
+  FILE *in;
+  reconcile_t *state;
+  struct _reconcile_ent_t *ent;
+  char line[RECONCILE_LINE_MAX];
+  char *word[RECONCILE_LIMITS + 2];
+  int lineno, size, words, bad, i;
+
+  if ( ! strcmp(file, "-") ) {
+    in = stdin;
+  }
+  else if ( ! (in = fopen(file, "r")) ) {
+    output_error ("Failed opening %s for reading: %s", file, strerror(errno));
+    return NULL;
+  }
+
+  state = (reconcile_t *) calloc (1, sizeof(reconcile_t));
+  if ( ! state ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+
+  /* resolve names from one pass over each database */
+  system_idcache_enable ();
+
+  lineno = size = bad = 0;
+  while ( fgets(line, sizeof(line), in) ) {
+    lineno++;
+
+    if ( ! strchr(line, '\n') && ! feof(in) ) {
+      output_error ("line %d: longer than %d characters", lineno, RECONCILE_LINE_MAX - 2);
+      while ( fgets(line, sizeof(line), in) && ! strchr(line, '\n') );
+      bad++;
+      continue;
+    }
+
+    word[0] = strtok (line, WHITESPACE);
+    if ( ! word[0] || word[0][0] == '#' ) {
+      continue;
+    }
+    for (words = 1; words < RECONCILE_LIMITS + 2; words++) {
+      if ( ! (word[words] = strtok(NULL, WHITESPACE)) ) {
+	break;
+      }
+    }
+    if ( words != RECONCILE_LIMITS + 1 ) {
+      output_error ("line %d: expected an id and %d limits", lineno, RECONCILE_LIMITS);
+      bad++;
+      continue;
+    }
+
+    if ( state->count == size ) {
+      size = size ? size * 2 : 64;
+      state->ents = (struct _reconcile_ent_t *)
+	realloc (state->ents, size * sizeof(struct _reconcile_ent_t));
+      if ( ! state->ents ) {
+	output_error ("Insufficient memory");
+	exit (ERR_MEM);
+      }
+    }
+    ent = &state->ents[state->count];
+    ent->lineno = lineno;
+    if ( ! reconcile_line(ent, word, id_type) ) {
+      output_error ("line %d: skipped", lineno);
+      bad++;
+      continue;
+    }
+    state->count++;
+  }
+  if ( in != stdin ) {
+    fclose (in);
+  }
+
+  /* sorted for bsearch() while walking the kernel's list */
+  qsort (state->ents, state->count, sizeof(struct _reconcile_ent_t), reconcile_cmp);
+  for (i = 1; i < state->count; i++) {
+    if ( state->ents[i].id == state->ents[i - 1].id ) {
+      output_error ("line %d: %s %u already given on line %d", state->ents[i].lineno,
+		    QUOTA_ID_NAME(id_type),
+		    state->ents[i].id, state->ents[i - 1].lineno);
+      bad++;
+    }
+  }
+
+  if ( bad ) {
+    output_error ("%s: %d bad lines, nothing changed", file, bad);
+    reconcile_free (state);
+    return NULL;
+  }
+  output_info ("%s: desired limits for %d ids", file, state->count);
+  return state;
+}
+
+
+
+void reconcile_free (reconcile_t *state) {
+  free (state->ents);
+  free (state);
+}
+
+
+
+/* the current limits of ent, from a quota_get() or quota_get_next() */
+static void reconcile_have (struct _reconcile_ent_t *ent, quota_t *quota) {
+  ent->have[RECONCILE_BLOCK_SOFT] = quota->block_soft;
+  ent->have[RECONCILE_BLOCK_HARD] = quota->block_hard;
+  ent->have[RECONCILE_INODE_SOFT] = quota->inode_soft;
+  ent->have[RECONCILE_INODE_HARD] = quota->inode_hard;
+}
+
+
+
+/*
+ * reconcile_plan
+ * one record of the change plan: id, filesystem, then old and new
+ * value of each limit. Blocks in Kb like -d, inodes as they are.
+ */
+static void reconcile_plan (struct _reconcile_ent_t *ent, u_int64_t *want,
+			    char *qfile, int id_type) {
+  record_t rec;
+  int k;
+
+  record_begin (&rec, plan_fields);
+  record_label (&rec, QUOTA_TYPE_NAME(id_type));
+  record_u64 (&rec, ent->id);
+  record_str (&rec, qfile);
+  for (k = 0; k < RECONCILE_LIMITS; k++) {
+    if ( k <= RECONCILE_BLOCK_HARD ) {
+      record_u64 (&rec, BLOCKS_TO_KB(ent->have[k]));
+      record_u64 (&rec, BLOCKS_TO_KB(want[k]));
+    }
+    else {
+      record_u64 (&rec, ent->have[k]);
+      record_u64 (&rec, want[k]);
+    }
+  }
+  record_end (&rec);
+}
+
+
+
+/*
+ * reconcile_fs
+ * compare state with the limits on one filesystem and set the
+ * ids that differ. With -n print the plan on stdout instead.
+ */
+int reconcile_fs (argdata_t *argdata, reconcile_t *state, quota_fs_t *fs, char *qfile) {
+  struct _reconcile_ent_t *ent, key;
+  u_int64_t want[RECONCILE_LIMITS];
+  quota_t *quota;
+  int found, differ, changed, unchanged, failed;
+  int i, k;
+
+  quota = quota_new (fs, argdata->id_type, 0);
+  if ( ! quota ) {
+    return ERR_SYS;
+  }
+
+  /* ids without a record have no limits */
+  for (i = 0; i < state->count; i++) {
+    memset (state->ents[i].have, 0, sizeof(state->ents[i].have));
+  }
+
+  /* one walk over the kernel's list instead of a Q_GETQUOTA per line */
+  while ( (found = quota_get_next(quota)) > 0 ) {
+    key.id = (unsigned int) quota->_id;
+    key.lineno = 0;
+    ent = bsearch (&key, state->ents, state->count, sizeof(struct _reconcile_ent_t),
+		   reconcile_cmp_id);
+    if ( ent ) {
+      reconcile_have (ent, quota);
+    }
+    if ( (unsigned int) quota->_id == (unsigned int) -1 ) {
+      break;
+    }
+    quota->_id++;
+  }
+  if ( found < 0 ) {
+    output_info ("%s: cannot list ids, asking for each of them", qfile);
+    for (i = 0; i < state->count; i++) {
+      quota->_id = (int) state->ents[i].id;
+      if ( ! quota_get(quota) ) {
+	quota_delete (quota);
+	return ERR_SYS;
+      }
+      reconcile_have (&state->ents[i], quota);
+    }
+  }
+
+  if ( argdata->noaction ) {
+    output_info ("");
+    output_info ("%s Filesystem block-soft old new block-hard old new inode-soft old new inode-hard old new",
+		 QUOTA_ID_NAME(argdata->id_type));
+  }
+
+  changed = unchanged = failed = 0;
+  for (i = 0; i < state->count; i++) {
+    ent = &state->ents[i];
+
+    differ = 0;
+    for (k = 0; k < RECONCILE_LIMITS; k++) {
+      want[k] = ent->keep[k] ? ent->have[k] : ent->want[k];
+      if ( argdata->raise_only && want[k] < ent->have[k] ) {
+	want[k] = ent->have[k];
+      }
+      if ( want[k] != ent->have[k] ) {
+	differ = 1;
+      }
+    }
+    if ( ! differ ) {
+      unchanged++;
+      continue;
+    }
+
+    if ( argdata->noaction ) {
+      reconcile_plan (ent, want, qfile, argdata->id_type);
+      changed++;
+      continue;
+    }
+    output_info ("%u %s "
+		 _RECONCILE_U64 " " _RECONCILE_U64 " " _RECONCILE_U64 " " _RECONCILE_U64 " "
+		 _RECONCILE_U64 " " _RECONCILE_U64 " " _RECONCILE_U64 " " _RECONCILE_U64,
+		 ent->id, qfile,
+		 (u_int64_t) BLOCKS_TO_KB(ent->have[RECONCILE_BLOCK_SOFT]),
+		 (u_int64_t) BLOCKS_TO_KB(want[RECONCILE_BLOCK_SOFT]),
+		 (u_int64_t) BLOCKS_TO_KB(ent->have[RECONCILE_BLOCK_HARD]),
+		 (u_int64_t) BLOCKS_TO_KB(want[RECONCILE_BLOCK_HARD]),
+		 ent->have[RECONCILE_INODE_SOFT], want[RECONCILE_INODE_SOFT],
+		 ent->have[RECONCILE_INODE_HARD], want[RECONCILE_INODE_HARD]);
+
+    /* fresh usage and timers, only the limits come from the file */
+    quota->_id = (int) ent->id;
+    if ( ! quota_get(quota) ) {
+      failed++;
+      continue;
+    }
+    quota->block_soft = want[RECONCILE_BLOCK_SOFT];
+    quota->block_hard = want[RECONCILE_BLOCK_HARD];
+    quota->inode_soft = want[RECONCILE_INODE_SOFT];
+    quota->inode_hard = want[RECONCILE_INODE_HARD];
+    if ( ! quota_set(quota) ) {
+      failed++;
+      continue;
+    }
+    changed++;
+  }
+
+  output_notice ("%s: %d ids, %d unchanged, %d %s, %d failed", qfile, state->count,
+		 unchanged, changed, argdata->noaction ? "to change" : "changed", failed);
+  quota_delete (quota);
+  return failed ? ERR_SYS : 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * reconcile.h
+ * bring the limits on a filesystem in line with a desired-state file
+ */
+#ifndef INCLUDE_QUOTATOOL_RECONCILE
+#define INCLUDE_QUOTATOOL_RECONCILE 1
+
+#include <config.h>
+
+#include "parse.h"
+#include "quota.h"
+
+/* longest line of a desired-state file */
+#define RECONCILE_LINE_MAX  1024
+
+/* the four limits of a line, in file order */
+enum {
+  RECONCILE_BLOCK_SOFT = 0,
+  RECONCILE_BLOCK_HARD,
+  RECONCILE_INODE_SOFT,
+  RECONCILE_INODE_HARD,
+  RECONCILE_LIMITS
+};
+
+struct _reconcile_ent_t {
+  unsigned int id;
+  int          lineno;
+  u_int64_t    want[RECONCILE_LIMITS];
+  short        keep[RECONCILE_LIMITS];  /* "-": leave this limit alone */
+  u_int64_t    have[RECONCILE_LIMITS];  /* current limits, 0 if no record */
+};
+
+struct _reconcile_t {
+  struct _reconcile_ent_t *ents;        /* sorted by id */
+  int count;
+};
+typedef struct _reconcile_t reconcile_t;
+
+/* returns NULL after printing what is wrong with the file */
+reconcile_t * reconcile_load  (char *file, int id_type);
+void          reconcile_free  (reconcile_t *state);
+
+/* returns 0 on success or one of the ERR_* codes in quotatool.h */
+int           reconcile_fs    (argdata_t *argdata, reconcile_t *state,
+			       quota_fs_t *fs, char *qfile);
+
+#endif /* INCLUDE_QUOTATOOL_RECONCILE */
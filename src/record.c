@@ -0,0 +1,215 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * record.c
+ * machine readable output: one record per id or per change
+ *
+ * Dumps of 100k ids are mostly numbers, so a record is put together by
+ * hand in a line buffer (no printf format parsing) and handed to stdio
+ * with a single fwrite(). stdout gets a large buffer when it isn't a
+ * terminal. One fwrite() per record also keeps the records of several
+ * workers from mixing.
+ */
+#include <config.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "record.h"
+
+int record_format = RECORD_TEXT;
+
+/* the CSV header written last, a new layout gets a new header */
+static const char *const *record_header = NULL;
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+void record_init (void) {
+  if ( ! isatty(STDOUT_FILENO) ) {
+    setvbuf (stdout, NULL, _IOFBF, RECORD_BUFFER);
+  }
+}
+
+int record_set_format (const char *name) {
+  if ( ! strcmp(name, "text") ) {
+    record_format = RECORD_TEXT;
+  }
+  else if ( ! strcmp(name, "csv") ) {
+    record_format = RECORD_CSV;
+  }
+  else if ( ! strcmp(name, "ndjson") ) {
+    record_format = RECORD_NDJSON;
+  }
+  else {
+    return 0;
+  }
+  return 1;
+}
+
+/* a new output stream (a --serve request), CSV starts with a header again */
+void record_restart (void) {
+  pthread_mutex_lock (&record_lock);
+  record_header = NULL;
+  pthread_mutex_unlock (&record_lock);
+}
+
+
+
+/* room is kept for the closing "}\n", a record that doesn't fit is cut */
+static void record_putc (record_t *rec, char c) {
+  if ( rec->len < sizeof(rec->buf) - 2 ) {
+    rec->buf[rec->len++] = c;
+  }
+}
+
+static void record_puts (record_t *rec, const char *s) {
+  while ( *s ) {
+    record_putc (rec, *s++);
+  }
+}
+
+static void record_put_u64 (record_t *rec, u_int64_t value) {
+  char digits[20];
+  int n = 0;
+
+  do {
+    digits[n++] = (char) ('0' + value % 10);
+    value /= 10;
+  } while ( value );
+  while ( n ) {
+    record_putc (rec, digits[--n]);
+  }
+}
+
+static void record_put_json (record_t *rec, const char *s) {
+  static const char hex[] = "0123456789abcdef";
+  unsigned char c;
+
+  record_putc (rec, '"');
+  for ( ; (c = (unsigned char) *s); s++) {
+    if ( c == '"' || c == '\\' ) {
+      record_putc (rec, '\\');
+      record_putc (rec, (char) c);
+    }
+    else if ( c < 0x20 ) {
+      record_puts (rec, "\\u00");
+      record_putc (rec, hex[c >> 4]);
+      record_putc (rec, hex[c & 0xf]);
+    }
+    else {
+      record_putc (rec, (char) c);
+    }
+  }
+  record_putc (rec, '"');
+}
+
+static void record_put_csv (record_t *rec, const char *s) {
+  if ( ! s[strcspn(s, ",\"\r\n")] ) {
+    record_puts (rec, s);
+    return;
+  }
+  record_putc (rec, '"');
+  for ( ; *s; s++) {
+    if ( *s == '"' ) {
+      record_putc (rec, '"');
+    }
+    record_putc (rec, *s);
+  }
+  record_putc (rec, '"');
+}
+
+
+
+void record_begin (record_t *rec, const char *const *names) {
+  rec->names = names;
+  rec->field = 0;
+  rec->len = 0;
+}
+
+/* separator and, for NDJSON, the name of the next field */
+static void record_next (record_t *rec) {
+  switch ( record_format ) {
+  case RECORD_NDJSON:
+    record_putc (rec, rec->field ? ',' : '{');
+    record_put_json (rec, rec->names[rec->field]);
+    record_putc (rec, ':');
+    break;
+  case RECORD_CSV:
+    if ( rec->field ) {
+      record_putc (rec, ',');
+    }
+    break;
+  default:
+    if ( rec->len ) {
+      record_putc (rec, ' ');
+    }
+    break;
+  }
+  rec->field++;
+}
+
+void record_str (record_t *rec, const char *value) {
+  record_next (rec);
+  if ( record_format == RECORD_NDJSON ) {
+    record_put_json (rec, value);
+  }
+  else if ( record_format == RECORD_CSV ) {
+    record_put_csv (rec, value);
+  }
+  else {
+    record_puts (rec, value);
+  }
+}
+
+void record_u64 (record_t *rec, u_int64_t value) {
+  record_next (rec);
+  record_put_u64 (rec, value);
+}
+
+void record_label (record_t *rec, const char *value) {
+  if ( record_format == RECORD_TEXT ) {
+    rec->field++;
+    return;
+  }
+  record_str (rec, value);
+}
+
+
+
+void record_end (record_t *rec) {
+  char header[RECORD_LINE_MAX];
+  size_t len = 0;
+  int i;
+
+  if ( record_format == RECORD_NDJSON ) {
+    rec->buf[rec->len++] = rec->field ? '}' : '{';
+    if ( ! rec->field ) {
+      rec->buf[rec->len++] = '}';
+    }
+  }
+  rec->buf[rec->len++] = '\n';
+
+  pthread_mutex_lock (&record_lock);
+  if ( record_format == RECORD_CSV && record_header != rec->names ) {
+    for (i = 0; rec->names[i] && len + strlen(rec->names[i]) + 2 < sizeof(header); i++) {
+      if ( i ) {
+	header[len++] = ',';
+      }
+      memcpy (header + len, rec->names[i], strlen(rec->names[i]));
+      len += strlen (rec->names[i]);
+    }
+    header[len++] = '\n';
+    fwrite (header, 1, len, stdout);
+    record_header = rec->names;
+  }
+  fwrite (rec->buf, 1, rec->len, stdout);
+  pthread_mutex_unlock (&record_lock);
+}
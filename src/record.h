@@ -0,0 +1,53 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * record.h
+ * machine readable output: one record per id or per change
+ */
+#ifndef INCLUDE_QUOTATOOL_RECORD
+#define INCLUDE_QUOTATOOL_RECORD 1
+
+#include <config.h>
+
+#include <sys/types.h>
+
+#include "system.h"		/* PATH_MAX */
+
+#define RECORD_TEXT    0	/* space separated, the -d format */
+#define RECORD_CSV     1	/* a header line, then comma separated */
+#define RECORD_NDJSON  2	/* one JSON object per line */
+
+/* a path, escaped, and the numbers */
+#define RECORD_LINE_MAX  (2 * PATH_MAX + 512)
+
+/* stdout buffer when it isn't a terminal */
+#define RECORD_BUFFER    (64 * 1024)
+
+extern int record_format;
+
+/* one record, filled field by field in the order of names (NULL
+ * terminated, the field names of CSV and NDJSON) */
+typedef struct {
+  const char *const *names;
+  int  field;
+  size_t len;
+  char buf[RECORD_LINE_MAX];
+} record_t;
+
+void record_init       (void);
+int  record_set_format (const char *name);
+void record_restart    (void);
+
+void record_begin (record_t *rec, const char *const *names);
+void record_str   (record_t *rec, const char *value);
+void record_u64   (record_t *rec, u_int64_t value);
+/* a field the text format leaves out, it keeps its old columns */
+void record_label (record_t *rec, const char *value);
+/* write the record to stdout, in one piece */
+void record_end   (record_t *rec);
+
+#endif /* INCLUDE_QUOTATOOL_RECORD */
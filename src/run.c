@@ -0,0 +1,982 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * run.c
+ * carry out the work described by one parsed command line
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "quotatool.h"
+#include "discover.h"
+#include "metrics.h"
+#include "output.h"
+#include "parse.h"
+#include "quota.h"
+#include "reconcile.h"
+#include "record.h"
+#include "run.h"
+#include "stats.h"
+#include "summary.h"
+#include "system.h"
+#include "tree.h"
+
+
+/* fields of a -d record; --du has the directory in place of the filesystem */
+static const char *const run_dump_fields[] = {
+  "type", "id", "filesystem", "block_used_kb", "block_soft_kb", "block_hard_kb",
+  "block_grace_s", "inode_used", "inode_soft", "inode_hard", "inode_grace_s", NULL
+};
+static const char *const run_du_fields[] = {
+  "type", "id", "directory", "block_used_kb", "block_soft_kb", "block_hard_kb",
+  "block_grace_s", "inode_used", "inode_soft", "inode_hard", "inode_grace_s", NULL
+};
+
+
+
+/* is quota at or over its soft or hard block (what: GRACE_BLOCK) or
+ * inode (GRACE_INODE) limit */
+static int run_over_limit (quota_t *quota, int what) {
+  if ( what == GRACE_BLOCK ) {
+    return (quota->block_soft && BYTES_TO_BLOCKS(quota->diskspace_used) >= quota->block_soft)
+      || (quota->block_hard && BYTES_TO_BLOCKS(quota->diskspace_used) >= quota->block_hard);
+  }
+  return (quota->inode_soft && quota->inode_used >= quota->inode_soft)
+    || (quota->inode_hard && quota->inode_used >= quota->inode_hard);
+}
+
+/*
+ * run_dump_line
+ * print one line (record) of -d output for quota
+ */
+static void run_dump_line (argdata_t *argdata, quota_t *quota, const char *const *fields,
+			   char *qfile, time_t now) {
+  unsigned long block_grace, inode_grace;
+  record_t rec;
+
+#if ANY_BSD
+  /* Check both: user is over limit AND timer hasn't expired.
+   * Without the > now check, expired timers wrap to huge
+   * unsigned values (bug #36). */
+  block_grace = (unsigned long)
+    (run_over_limit(quota, GRACE_BLOCK) && quota->block_time > now ? quota->block_time - now : 0);
+  inode_grace = (unsigned long)
+    (run_over_limit(quota, GRACE_INODE) && quota->inode_time > now ? quota->inode_time - now : 0);
+#else
+  block_grace = (unsigned long)(quota->block_time > now ? quota->block_time - now : 0);
+  inode_grace = (unsigned long)(quota->inode_time > now ? quota->inode_time - now : 0);
+#endif /* ANY_BSD */
+
+  record_begin (&rec, fields);
+  record_label (&rec, QUOTA_TYPE_NAME(argdata->id_type));
+  record_u64 (&rec, (unsigned int) quota->_id);
+  record_str (&rec, qfile);
+  // quota->diskspace_used is bytes. Display in Kb
+  record_u64 (&rec, DIV_UP(quota->diskspace_used, 1024));
+  record_u64 (&rec, BLOCKS_TO_KB(quota->block_soft));
+  record_u64 (&rec, BLOCKS_TO_KB(quota->block_hard));
+  record_u64 (&rec, block_grace);
+  record_u64 (&rec, quota->inode_used);
+  record_u64 (&rec, quota->inode_soft);
+  record_u64 (&rec, quota->inode_hard);
+  record_u64 (&rec, inode_grace);
+  record_end (&rec);
+}
+
+
+
+/* one id of a --top report */
+struct _run_top_t {
+  double key;
+  quota_t quota;
+};
+
+/* ranks a below b: a smaller key, or the same key and a higher id */
+#define RUN_TOP_BELOW(a, b) \
+  ((a).key < (b).key || ((a).key == (b).key && (unsigned int) (a).quota._id > (unsigned int) (b).quota._id))
+
+/*
+ * run_top_key
+ * what --by ranks quota by: its block or inode usage, or how full
+ * (in percent) it is, of its soft limit if it has one, else the hard
+ * limit, blocks or inodes, whichever is fuller
+ */
+static double run_top_key (argdata_t *argdata, quota_t *quota) {
+  u_int64_t limit;
+  double block_pct, inode_pct;
+
+  switch ( argdata->top_by ) {
+  case PARSE_TOP_INODES:
+    return (double) quota->inode_used;
+  case PARSE_TOP_PERCENT:
+    block_pct = inode_pct = 0;
+    limit = quota->block_soft ? quota->block_soft : quota->block_hard;
+    if ( limit ) {
+      block_pct = 100.0 * BYTES_TO_BLOCKS(quota->diskspace_used) / limit;
+    }
+    limit = quota->inode_soft ? quota->inode_soft : quota->inode_hard;
+    if ( limit ) {
+      inode_pct = 100.0 * quota->inode_used / limit;
+    }
+    return block_pct > inode_pct ? block_pct : inode_pct;
+  default:
+    return (double) quota->diskspace_used;
+  }
+}
+
+/* move heap[i] down to its place in the min-heap of count entries */
+static void run_top_sift (struct _run_top_t *heap, int count, int i) {
+  struct _run_top_t tmp;
+  int child;
+
+  while ( (child = 2 * i + 1) < count ) {
+    if ( child + 1 < count && RUN_TOP_BELOW(heap[child + 1], heap[child]) ) {
+      child++;
+    }
+    if ( ! RUN_TOP_BELOW(heap[child], heap[i]) ) {
+      break;
+    }
+    tmp = heap[i];
+    heap[i] = heap[child];
+    heap[child] = tmp;
+    i = child;
+  }
+}
+
+/*
+ * run_top
+ * add quota to the --top min-heap of at most argdata->top entries;
+ * once it's full, quota only gets in by pushing out the lowest
+ */
+static void run_top (argdata_t *argdata, struct _run_top_t **heap, int *count,
+		     int *allocated, quota_t *quota) {
+  struct _run_top_t entry;
+  int i;
+
+  entry.key = run_top_key (argdata, quota);
+  entry.quota = *quota;
+  if ( entry.key <= 0 ) {
+    return;
+  }
+
+  if ( *count == argdata->top ) {
+    if ( RUN_TOP_BELOW((*heap)[0], entry) ) {
+      (*heap)[0] = entry;
+      run_top_sift (*heap, *count, 0);
+    }
+    return;
+  }
+
+  /* grown as needed, memory follows the ids seen up to N */
+  if ( *count == *allocated ) {
+    *allocated = *allocated ? *allocated * 2 : 64;
+    if ( *allocated > argdata->top ) {
+      *allocated = argdata->top;
+    }
+    *heap = (struct _run_top_t *) realloc (*heap, *allocated * sizeof(struct _run_top_t));
+    if ( ! *heap ) {
+      output_error ("Insufficient memory");
+      exit (ERR_MEM);
+    }
+  }
+  for (i = (*count)++; i > 0 && RUN_TOP_BELOW(entry, (*heap)[(i - 1) / 2]); i = (i - 1) / 2) {
+    (*heap)[i] = (*heap)[(i - 1) / 2];
+  }
+  (*heap)[i] = entry;
+}
+
+
+
+/*
+ * run_dump_all
+ * print a -d line for every id the kernel has a quota record for,
+ * skipping records with neither usage nor limits. With --over only
+ * those at or over a limit, with --top the N heaviest of them, in
+ * order: a min-heap of N entries, however many ids there are.
+ * Walks the kernel's list, no passwd/group lookups.
+ */
+static int run_dump_all (argdata_t *argdata, quota_fs_t *fs, char *qfile) {
+  struct _run_top_t *heap, tmp;
+  quota_t *quota;
+  time_t now;
+  int found, count, allocated, i;
+
+  quota = quota_new (fs, argdata->id_type, 0);
+  if ( ! quota ) {
+    return ERR_SYS;
+  }
+
+  output_info ("");
+  output_info ("%s Filesystem blocks quota limit grace files quota limit grace",
+	       QUOTA_ID_NAME(argdata->id_type));
+
+  now = time(NULL);
+  heap = NULL;
+  count = allocated = 0;
+  while ( (found = quota_get_next(quota)) > 0 ) {
+    if ( (quota->diskspace_used || quota->block_soft || quota->block_hard
+	  || quota->inode_used || quota->inode_soft || quota->inode_hard)
+	 && (! argdata->over
+	     || run_over_limit(quota, GRACE_BLOCK) || run_over_limit(quota, GRACE_INODE)) ) {
+      if ( argdata->top ) {
+	run_top (argdata, &heap, &count, &allocated, quota);
+      }
+      else {
+	run_dump_line (argdata, quota, run_dump_fields, qfile, now);
+	count++;
+      }
+    }
+    /* the highest possible id, don't wrap around to 0 */
+    if ( (unsigned int) quota->_id == (unsigned int) -1 ) {
+      break;
+    }
+    quota->_id++;
+  }
+
+  /* heapsort: the lowest goes to the end, until the heap is empty */
+  if ( argdata->top && found == 0 ) {
+    for (i = count - 1; i > 0; i--) {
+      tmp = heap[0];
+      heap[0] = heap[i];
+      heap[i] = tmp;
+      run_top_sift (heap, i, 0);
+    }
+    for (i = 0; i < count; i++) {
+      run_dump_line (argdata, &heap[i].quota, run_dump_fields, qfile, now);
+    }
+  }
+  free (heap);
+
+  output_info ("%d ids %s on %s", count, argdata->over ? "at or over a limit" : "with usage or limits",
+	       qfile);
+  quota_delete (quota);
+  return found < 0 ? ERR_SYS : 0;
+}
+
+
+
+/*
+ * run_du
+ * a -d line for every directory in /etc/projects on the filesystem,
+ * with the usage of its project. The kernel keeps that count, so no
+ * tree is walked: one pass over the kernel's list of projects,
+ * skipping straight to the next listed id each time.
+ */
+static int run_du (argdata_t *argdata, quota_fs_t *fs, char *qfile) {
+  system_project_t *projects;
+  quota_t *quota, *empty;
+  struct stat st;
+  time_t now;
+  int count, found, shown, failed, i;
+
+  if ( stat(fs->_mnt.mount_pt, &st) < 0 ) {
+    output_error ("Cannot stat %s: %s", fs->_mnt.mount_pt, strerror(errno));
+    return ERR_SYS;
+  }
+
+  projects = system_getprojects (&count);
+  if ( count < 0 ) {
+    return ERR_ARG;
+  }
+
+  quota = quota_new (fs, argdata->id_type, 0);
+  empty = quota_new (fs, argdata->id_type, 0);
+  if ( ! quota || ! empty ) {
+    if ( quota ) quota_delete (quota);
+    system_freeprojects (projects, count);
+    return ERR_SYS;
+  }
+
+  output_info ("");
+  output_info ("project Directory blocks quota limit grace files quota limit grace");
+
+  now = time(NULL);
+  i = shown = failed = found = 0;
+  while ( i < count ) {
+    quota->_id = (int) projects[i].prjid;
+    if ( (found = quota_get_next(quota)) <= 0 ) {
+      break;
+    }
+    /* listed projects up to the one found, those before it have no record */
+    for ( ; i < count && projects[i].prjid <= (unsigned int) quota->_id; i++) {
+      if ( projects[i].dev != st.st_dev ) {
+	continue;
+      }
+      if ( projects[i].prjid == (unsigned int) quota->_id ) {
+	run_dump_line (argdata, quota, run_du_fields, projects[i].path, now);
+      }
+      else {
+	empty->_id = (int) projects[i].prjid;
+	run_dump_line (argdata, empty, run_du_fields, projects[i].path, now);
+      }
+      shown++;
+    }
+  }
+
+  if ( i < count && found < 0 ) {
+    output_info ("%s: cannot list projects, asking for each of them", qfile);
+  }
+  for ( ; i < count; i++) {
+    if ( projects[i].dev != st.st_dev ) {
+      continue;
+    }
+    empty->_id = (int) projects[i].prjid;
+    if ( found < 0 && ! quota_get(empty) ) {
+      failed++;
+      continue;
+    }
+    run_dump_line (argdata, empty, run_du_fields, projects[i].path, now);
+    shown++;
+  }
+
+  output_info ("%d directories on %s", shown, qfile);
+  quota_delete (empty);
+  quota_delete (quota);
+  system_freeprojects (projects, count);
+  return failed ? ERR_SYS : 0;
+}
+
+
+
+/* one element of an -u/-g/-p list: a single id, or the ids from
+ * first to last that the kernel has a quota record for */
+struct _run_id_t {
+  unsigned int first, last;
+  short range;
+};
+
+/* one quota type of the command line: argdata with that type's id and
+ * limits, and its ids */
+struct _run_type_t {
+  argdata_t argdata;
+  struct _run_id_t *ids;
+  int id_count;
+};
+
+/* user, group and project */
+#define RUN_TYPES_MAX 3
+
+/*
+ * run_getid
+ * the uid, gid or project id called name, -1 if there is none
+ */
+static int run_getid (argdata_t *argdata, char *name) {
+  char *tmpstr;
+
+  /* numerical uid starting with ':', don't check uid/gid against system users/groups */
+  if ( strlen(name) > 1 && name[0] == ':' && isdigit(name[1]) ) {
+    return strtol(name + 1, &tmpstr, 10);
+  }
+  if ( argdata->id_type == QUOTA_USER ) {
+    return (int) system_getuid (name);
+  }
+  if ( argdata->id_type == QUOTA_GROUP ) {
+    return (int) system_getgid (name);
+  }
+  return system_getprjid (name);
+}
+
+/*
+ * run_getids
+ * the ids argdata asks for: a comma separated list of names,
+ * :ids and :first-last ranges. Returns how many, -1 on error
+ */
+static int run_getids (argdata_t *argdata, struct _run_id_t **ids) {
+  char *list, *name, *cp, *end;
+  int count, id;
+
+  count = 1;
+  for (cp = argdata->id; cp && *cp; cp++) {
+    if ( *cp == ',' ) count++;
+  }
+  *ids = (struct _run_id_t *) calloc (count, sizeof(struct _run_id_t));
+  if ( ! *ids ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  if ( ! argdata->id ) {
+    return 1;
+  }
+  if ( ! (list = strdup(argdata->id)) ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+
+  count = 0;
+  for (cp = list; (name = strsep(&cp, ",")); count++) {
+    if ( ! *name ) {
+      output_error ("Empty %s in '%s'", QUOTA_ID_NAME(argdata->id_type), argdata->id);
+      break;
+    }
+    if ( name[0] == ':' && isdigit(name[1]) && strchr(name, '-') ) {
+      (*ids)[count].range = 1;
+      (*ids)[count].first = strtoul (name + 1, &end, 10);
+      if ( *end == '-' && isdigit(end[1]) ) {
+	(*ids)[count].last = strtoul (end + 1, &end, 10);
+      }
+      if ( *end || (*ids)[count].last < (*ids)[count].first ) {
+	output_error ("Bad %s range '%s', use :first-last", QUOTA_ID_NAME(argdata->id_type), name);
+	break;
+      }
+      continue;
+    }
+    if ( (id = run_getid(argdata, name)) < 0 ) {
+      break;
+    }
+    (*ids)[count].first = (*ids)[count].last = (unsigned int) id;
+  }
+
+  free (list);
+  if ( name ) {
+    free (*ids);
+    *ids = NULL;
+    return -1;
+  }
+  return count;
+}
+
+
+
+/*
+ * run_quota
+ * dump or set quota, already fetched with quota_get() or
+ * quota_get_next(). The caller deletes it.
+ */
+static int run_quota (argdata_t *argdata, quota_t *quota, char *qfile) {
+  u_int64_t old_quota;
+  time_t old_grace;
+
+  /* only -t and -r look at the grace periods */
+  if ( argdata->block_grace || argdata->inode_grace
+       || argdata->block_reset || argdata->inode_reset ) {
+    if ( ! quota_get_grace(quota) ) {
+      return ERR_SYS;
+    }
+  }
+
+  if (argdata->dump_info) {
+     output_info ("");
+     output_info ("%s Filesystem blocks quota limit grace files quota limit grace",
+		  QUOTA_ID_NAME(argdata->id_type));
+     run_dump_line (argdata, quota, run_dump_fields, qfile, time(NULL));
+     return 0;
+  }
+
+  /* print a header for verbose info */
+  output_info ("");
+  output_info ("%-14s %-16s %-16s", "Limit", "Old", "New");
+  output_info ("%-14s %-16s %-16s", "-----", "---", "---");
+
+  /*
+   *  BEGIN  setting global grace periods
+   */
+
+  if ( argdata->block_grace ) {
+    old_grace = quota->block_grace;
+    quota->block_grace = parse_timespan (old_grace, argdata->block_grace);
+    if (quota->block_grace == (time_t) -1) {
+      return ERR_ARG;
+    }
+    quota->_do_set_global_block_gracetime = 1;
+    output_info ("%-14s %-16d %-16d", "block grace:", old_grace, quota->block_grace);
+  }
+
+  if ( argdata->inode_grace ) {
+    old_grace = quota->inode_grace;
+    quota->inode_grace = parse_timespan (old_grace, argdata->inode_grace);
+    if (quota->inode_grace == (time_t) -1) {
+      return ERR_ARG;
+    }
+    quota->_do_set_global_inode_gracetime = 1;
+    output_info ("%-14s %-16d %-16d", "inode grace:", old_grace, quota->inode_grace);
+  }
+
+
+
+  /*
+   *  FINISH setting global grace periods
+   *  BEGIN  preparing to set quotas
+   */
+
+
+  /* update quota info from the command line */
+  if ( argdata->block_hard ) {
+    old_quota = quota->block_hard;
+    quota->block_hard = parse_size (old_quota, argdata->block_hard, PARSE_BLOCKS);
+    if ( quota->block_hard == (u_int64_t) -1 ) {
+      return ERR_ARG;
+    }
+    if ( argdata->raise_only && quota->block_hard <= old_quota) {
+       output_info ("New block quota not higher than current, won't change");
+       quota->block_hard = old_quota;
+    }
+    output_info ("%-14s %-16llu %llu", "block hard:",
+		 BLOCKS_TO_KB(old_quota), BLOCKS_TO_KB(quota->block_hard));
+  }
+
+  if ( argdata->block_soft ) {
+    old_quota = quota->block_soft;
+    quota->block_soft= parse_size (old_quota, argdata->block_soft, PARSE_BLOCKS);
+    if ( quota->block_soft == (u_int64_t) -1 ) {
+      return ERR_ARG;
+    }
+    if ( argdata->raise_only && quota->block_soft <= old_quota) {
+       output_info ("New block soft limit not higher than current, won't change");
+       quota->block_soft = old_quota;
+    }
+    output_info ("%-14s %-16llu %-16llu", "block soft:",
+		 BLOCKS_TO_KB(old_quota), BLOCKS_TO_KB(quota->block_soft));
+  }
+
+  if ( argdata->inode_hard ) {
+    old_quota = quota->inode_hard;
+    quota->inode_hard = parse_size (old_quota, argdata->inode_hard, PARSE_INODES);
+    if ( quota->inode_hard == (u_int64_t) -1 ) {
+      return ERR_ARG;
+    }
+    if ( argdata->raise_only && quota->inode_hard <= old_quota) {
+       output_info ("New inode quota not higher than current, won't change");
+       quota->inode_hard = old_quota;
+    }
+    output_info ("%-14s %-16llu %-16llu", "inode hard:", old_quota, quota->inode_hard);
+  }
+
+  if ( argdata->inode_soft ) {
+    old_quota = quota->inode_soft;
+    quota->inode_soft = parse_size (old_quota, argdata->inode_soft, PARSE_INODES);
+    if ( quota->inode_soft == (u_int64_t) -1 ) {
+      return ERR_ARG;
+    }
+    if ( argdata->raise_only && quota->inode_soft <= old_quota) {
+       output_info ("New inode soft limit not higher than current, won't change");
+       quota->inode_soft = old_quota;
+    }
+    output_info ("%-14s %-16llu %-16llu", "inode soft:", old_quota, quota->inode_soft);
+  }
+
+
+  /* Reset grace-time? */
+  if (argdata->block_reset || argdata->inode_reset) {
+      output_info("Resetting %s grace-time for %s %d\n",
+                  (argdata->block_reset ? "block" : "inode"),
+                  QUOTA_ID_NAME(argdata->id_type),
+                  quota->_id);
+
+      if (! argdata->noaction)
+          if (! quota_reset_grace(quota, (argdata->block_reset ? GRACE_BLOCK : GRACE_INODE)))
+              return ERR_SYS;
+
+      return 0;
+  }
+
+  /* Set new quota? */
+  if (! argdata->noaction)
+      if (! quota_set (quota))
+          return ERR_SYS;
+
+  return 0;
+}
+
+
+
+/*
+ * run_range
+ * run_quota() for each id in range the kernel has a quota record
+ * for, walking its list instead of asking for every id
+ */
+static int run_range (argdata_t *argdata, quota_fs_t *fs, char *qfile,
+		      struct _run_id_t *range) {
+  quota_t *quota;
+  int found, status, err, count;
+
+  quota = quota_new (fs, argdata->id_type, (int) range->first);
+  if ( ! quota ) {
+    return ERR_SYS;
+  }
+
+  status = count = 0;
+  while ( (found = quota_get_next(quota)) > 0 && (unsigned int) quota->_id <= range->last ) {
+    count++;
+    if ( (err = run_quota(argdata, quota, qfile)) && ! status ) {
+      status = err;
+    }
+    /* a bad limit is bad for every id */
+    if ( err == ERR_ARG || (unsigned int) quota->_id == range->last ) {
+      break;
+    }
+    quota->_id++;
+  }
+
+  output_info ("%d %ss in %u-%u with a quota record on %s", count,
+	       QUOTA_ID_NAME(argdata->id_type), range->first, range->last, qfile);
+  quota_delete (quota);
+  return found < 0 ? ERR_SYS : status;
+}
+
+
+
+/*
+ * run_fs
+ * get (and optionally set) the quota of each of ids on one filesystem.
+ * Only reads argdata, so workers can share it.
+ */
+static int run_fs (argdata_t *argdata, quota_fs_t *fs, char *qfile,
+		   struct _run_id_t *ids, int id_count) {
+  quota_t *quota;
+  int status, err, i;
+
+  if ( argdata->dump_all ) {
+    return run_dump_all (argdata, fs, qfile);
+  }
+  if ( argdata->du ) {
+    return run_du (argdata, fs, qfile);
+  }
+
+  status = 0;
+  for (i = 0; i < id_count; i++) {
+    if ( ids[i].range ) {
+      err = run_range (argdata, fs, qfile, &ids[i]);
+    }
+    else if ( ! (quota = quota_new(fs, argdata->id_type, (int) ids[i].first)) ) {
+      err = ERR_SYS;
+    }
+    else {
+      err = quota_get (quota) ? run_quota (argdata, quota, qfile) : ERR_SYS;
+      quota_delete (quota);
+    }
+    if ( err && ! status ) {
+      status = err;
+    }
+    if ( err == ERR_ARG ) {
+      break;
+    }
+  }
+  return status;
+}
+
+
+
+/*
+ * run_types
+ * run_fs() for each quota type of the command line, one after the
+ * other on the same filesystem handle
+ */
+static int run_types (struct _run_type_t *types, int type_count, quota_fs_t *fs, char *qfile) {
+  int status, err, i;
+
+  status = 0;
+  for (i = 0; i < type_count; i++) {
+    err = run_fs (&types[i].argdata, fs, qfile, types[i].ids, types[i].id_count);
+    if ( err && ! status ) {
+      status = err;
+    }
+  }
+  return status;
+}
+
+
+
+/* the most filesystems worked on at once */
+#define RUN_WORKERS_MAX 4
+
+/* one filesystem of a parallel run */
+struct _run_job_t {
+  char *qfile;
+  quota_fs_t *fs;		/* NULL if there's nothing (more) to do */
+  int same_as;			/* index of the job doing this filesystem, or -1 */
+  int status;
+};
+
+struct _run_pool_t {
+  struct _run_type_t *types;
+  int type_count;
+  struct _run_job_t *jobs;
+  int count;
+  int next;			/* first job not yet taken */
+  pthread_mutex_t lock;
+};
+
+
+
+/*
+ * run_worker
+ * take jobs off the pool until there are none left. Each job
+ * syncs its own filesystem, so a slow one doesn't hold up the rest.
+ */
+static void *run_worker (void *arg) {
+  struct _run_pool_t *pool = (struct _run_pool_t *) arg;
+  struct _run_job_t *job;
+  int i;
+
+  while ( 1 ) {
+    pthread_mutex_lock (&pool->lock);
+    i = pool->next++;
+    pthread_mutex_unlock (&pool->lock);
+    if ( i >= pool->count ) {
+      break;
+    }
+
+    job = &pool->jobs[i];
+    if ( ! job->fs ) {
+      continue;
+    }
+    job->status = run_types (pool->types, pool->type_count, job->fs, job->qfile);
+    if ( ! quota_fs_sync(job->fs) && ! job->status ) {
+      job->status = ERR_SYS;
+    }
+  }
+  return NULL;
+}
+
+
+
+/*
+ * run_parallel
+ * do the same thing on several filesystems, up to RUN_WORKERS_MAX
+ * at a time. Filesystems are looked up here, before the workers start,
+ * since the mount table and the handle registry are not thread safe.
+ */
+static int run_parallel (struct _run_type_t *types, int type_count, char **qfiles, int count) {
+  struct _run_pool_t pool;
+  pthread_t workers[RUN_WORKERS_MAX];
+  int started, ok, failed, retval;
+  int i, j;
+
+  pool.types = types;
+  pool.type_count = type_count;
+  pool.count = count;
+  pool.next = 0;
+  pool.jobs = (struct _run_job_t *) calloc (count, sizeof(struct _run_job_t));
+  if ( ! pool.jobs ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  pthread_mutex_init (&pool.lock, NULL);
+
+  for (i = 0; i < count; i++) {
+    pool.jobs[i].qfile = qfiles[i];
+    pool.jobs[i].same_as = -1;
+    pool.jobs[i].fs = quota_fs_open (qfiles[i]);
+    if ( ! pool.jobs[i].fs ) {
+      pool.jobs[i].status = ERR_SYS;
+      continue;
+    }
+    /* the same filesystem twice, by another name */
+    for (j = 0; j < i; j++) {
+      if ( pool.jobs[j].fs == pool.jobs[i].fs ) {
+	output_info ("%s is the same filesystem as %s, skipping", qfiles[i], qfiles[j]);
+	pool.jobs[i].fs = NULL;
+	pool.jobs[i].same_as = j;
+	break;
+      }
+    }
+  }
+
+  for (started = 0; started < RUN_WORKERS_MAX && started < count; started++) {
+    if ( pthread_create(&workers[started], NULL, run_worker, &pool) ) {
+      output_error ("Failed starting worker thread: %s", strerror(errno));
+      break;
+    }
+  }
+  /* no threads at all, do the work here */
+  if ( ! started ) {
+    run_worker (&pool);
+  }
+  for (i = 0; i < started; i++) {
+    pthread_join (workers[i], NULL);
+  }
+  pthread_mutex_destroy (&pool.lock);
+
+  ok = failed = retval = 0;
+  for (i = 0; i < count; i++) {
+    if ( pool.jobs[i].same_as >= 0 ) {
+      pool.jobs[i].status = pool.jobs[pool.jobs[i].same_as].status;
+    }
+    if ( pool.jobs[i].status ) {
+      output_error ("%s: failed (exit code %d)", qfiles[i], pool.jobs[i].status);
+      failed++;
+      if ( ! retval ) retval = pool.jobs[i].status;
+    }
+    else {
+      output_info ("%s: ok", qfiles[i]);
+      ok++;
+    }
+  }
+  output_notice ("%d filesystems, %d ok, %d failed", count, ok, failed);
+
+  free (pool.jobs);
+  return retval;
+}
+
+
+
+/*
+ * run_reconcile
+ * apply a desired-state file to each filesystem in turn. The file is
+ * read once; one filesystem at a time, since reading it resolves names.
+ */
+static int run_reconcile (argdata_t *argdata, char **qfiles, int count) {
+  reconcile_t *state;
+  quota_fs_t **done, *fs;
+  int status, retval, i, j;
+
+  state = reconcile_load (argdata->reconcile_file, argdata->id_type);
+  if ( ! state ) {
+    return ERR_ARG;
+  }
+  done = (quota_fs_t **) calloc (count, sizeof(quota_fs_t *));
+  if ( ! done ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+
+  retval = 0;
+  for (i = 0; i < count; i++) {
+    fs = quota_fs_open (qfiles[i]);
+    if ( ! fs ) {
+      status = ERR_SYS;
+    }
+    else {
+      /* the same filesystem twice, by another name */
+      for (j = 0; j < i && done[j] != fs; j++);
+      if ( j < i ) {
+	output_info ("%s is the same filesystem as %s, skipping", qfiles[i], qfiles[j]);
+	continue;
+      }
+      done[i] = fs;
+      status = reconcile_fs (argdata, state, fs, qfiles[i]);
+    }
+    if ( status && ! retval ) {
+      retval = status;
+    }
+  }
+
+  free (done);
+  reconcile_free (state);
+  return retval;
+}
+
+
+
+/*
+ * run_argdata
+ * get (and optionally set) the quotas described by argdata,
+ * for each of its quota types, on each of its filesystems.
+ * Used once by main() for a normal run and once per line in batch mode,
+ * so nothing in here may exit() on a per-id error.
+ */
+int run_argdata (argdata_t *argdata) {
+  struct _run_type_t types[RUN_TYPES_MAX];
+  argdata_t *type;
+  quota_fs_t *fs;
+  char **qfiles = NULL;
+  int q_types[RUN_TYPES_MAX];
+  int count, type_count, status, err, i;
+  u_int64_t start;
+
+  /* everything but the ids and limits is the same for all types */
+  status = type_count = 0;
+  for (type = argdata; type && type_count < RUN_TYPES_MAX; type = type->next) {
+    types[type_count].argdata = *argdata;
+    types[type_count].argdata.id          = type->id;
+    types[type_count].argdata.id_type     = type->id_type;
+    types[type_count].argdata.block_hard  = type->block_hard;
+    types[type_count].argdata.block_soft  = type->block_soft;
+    types[type_count].argdata.block_grace = type->block_grace;
+    types[type_count].argdata.block_reset = type->block_reset;
+    types[type_count].argdata.inode_hard  = type->inode_hard;
+    types[type_count].argdata.inode_soft  = type->inode_soft;
+    types[type_count].argdata.inode_grace = type->inode_grace;
+    types[type_count].argdata.inode_reset = type->inode_reset;
+    types[type_count].ids = NULL;
+    types[type_count].id_count = 0;
+    type_count++;
+
+    if ( ! argdata->dump_all && ! argdata->du && ! argdata->reconcile_file
+	 && ! argdata->metrics_file && ! argdata->metrics_port ) {
+      start = stats_now ();
+      types[type_count - 1].id_count = run_getids (type, &types[type_count - 1].ids);
+      stats_phase (STATS_IDS, start);
+      if ( types[type_count - 1].id_count < 0 ) {
+	status = ERR_ARG;
+	break;
+      }
+    }
+  }
+  if ( status ) {
+    goto done;
+  }
+
+  if ( argdata->all_fs ) {
+    for (i = 0; i < type_count; i++) {
+      q_types[i] = types[i].argdata.id_type;
+    }
+    start = stats_now ();
+    qfiles = discover_quotafs (q_types, argdata->id_type ? type_count : 0,
+			       argdata->probe_timeout ? argdata->probe_timeout : DISCOVER_TIMEOUT,
+			       &count);
+    stats_phase (STATS_MOUNTS, start);
+    if ( ! count ) {
+      output_error ("No filesystems with quotas enabled");
+      status = ERR_SYS;
+      goto done;
+    }
+  }
+  else {
+    qfiles = argdata->qfiles;
+    count = argdata->qfile_count;
+  }
+
+  if ( argdata->reconcile_file ) {
+    status = run_reconcile (argdata, qfiles, count);
+  }
+  else if ( argdata->metrics_file || argdata->metrics_port ) {
+    status = metrics_run (argdata, qfiles, count);
+  }
+  else if ( argdata->summary ) {
+    status = summary_run (argdata, qfiles, count);
+  }
+  /* the "filesystems" are directories to put into the project */
+  else if ( argdata->tag_tree ) {
+    if ( types[0].id_count != 1 || types[0].ids[0].range ) {
+      output_error ("--tag-tree takes a single project");
+      count = 0;
+      status = ERR_ARG;
+    }
+    for (i = 0; i < count; i++) {
+      if ( (err = tree_tag(qfiles[i], types[0].ids[0].first, argdata->noaction)) ) {
+	status = err;
+      }
+    }
+  }
+  else if ( count > 1 ) {
+    status = run_parallel (types, type_count, qfiles, count);
+  }
+  /* the filesystem handle is shared across runs */
+  else if ( ! (fs = quota_fs_open(qfiles[0])) ) {
+    status = ERR_SYS;
+  }
+  else {
+    status = run_types (types, type_count, fs, qfiles[0]);
+  }
+
+ done:
+  for (i = 0; i < type_count; i++) {
+    free (types[i].ids);
+  }
+  if ( argdata->all_fs ) {
+    free (qfiles);
+  }
+  return status;
+}
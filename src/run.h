@@ -0,0 +1,21 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * run.h
+ * carry out the work described by one parsed command line
+ */
+#ifndef INCLUDE_QUOTATOOL_RUN
+#define INCLUDE_QUOTATOOL_RUN 1
+
+#include <config.h>
+
+#include "parse.h"
+
+/* returns 0 on success or one of the ERR_* codes in quotatool.h */
+int   run_argdata   (argdata_t *argdata);
+
+#endif /* INCLUDE_QUOTATOOL_RUN */
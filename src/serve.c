@@ -0,0 +1,538 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * serve.c
+ * answer quota requests on a unix socket
+ *
+ * A request is one line holding a quotatool command line without the
+ * program name, just like a --batch record:
+ *
+ *   -d -u alice /home              get
+ *   -u alice -b -q 1G -l 2G /home  set
+ *   -u alice -b -r /home           reset grace
+ *   -u -D /home                    dump
+ *
+ * The answer is what quotatool would print (-d lines, and error
+ * messages prefixed with "quotatool: "), followed by a line "OK" or
+ * "ERR <exit code>". A connection may send any number of requests,
+ * they are answered in turn. A request that set quotas is synced
+ * before it is answered.
+ *
+ * Requests run one at a time, their answer goes to a temporary file
+ * and from there to the client as fast as it reads, so a client that
+ * stops reading holds up only itself.
+ *
+ * Filesystems stay open from one request to the next, with their
+ * detected quota formats; grace periods are read again, others may
+ * have changed them. Only the mount points are let go of, umount would
+ * fail with EBUSY otherwise. When something has been mounted or
+ * unmounted, the filesystems no longer mounted as they were are closed.
+ *
+ * Only root and members of --serve-group may connect, checked with the
+ * peer credentials of the socket. Requests are parsed with PARSE_REQUEST:
+ * only the options of the four requests above are accepted, nothing that
+ * would have the daemon write files, read them or listen elsewhere.
+ */
+#define _GNU_SOURCE 1		/* struct ucred */
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "quotatool.h"
+#include "batch.h"
+#include "output.h"
+#include "parse.h"
+#include "quota.h"
+#include "record.h"
+#include "run.h"
+#include "serve.h"
+#include "system.h"
+
+struct _serve_client_t {
+  int fd;			/* -1 if the slot is free */
+  uid_t uid;
+  size_t len;			/* bytes in buf */
+  char buf[SERVE_LINE_MAX];
+  char *out;			/* answer still to be written, or NULL */
+  size_t out_len, out_done;
+  int closing;			/* close once out is written */
+};
+
+static struct _serve_client_t clients[SERVE_CLIENTS_MAX];
+static volatile sig_atomic_t serve_stop = 0;
+static int serve_out = -1;	/* temporary file taking the answer of a request */
+
+
+
+static void serve_signal (int sig) {
+  (void) sig;
+  serve_stop = 1;
+}
+
+
+
+/*
+ * serve_write
+ * write all of str to fd, give up on errors (the client is gone)
+ */
+static void serve_write (int fd, const char *str) {
+  size_t len = strlen (str);
+  ssize_t done;
+
+  while ( len ) {
+    done = write (fd, str, len);
+    if ( done < 0 && errno == EINTR ) {
+      continue;
+    }
+    if ( done <= 0 ) {
+      return;
+    }
+    str += done;
+    len -= done;
+  }
+}
+
+
+
+/*
+ * serve_reply
+ * end the answer to a request, with a message first if msg is set
+ */
+static void serve_reply (int fd, int status, const char *msg) {
+  char reply[SERVE_LINE_MAX];
+
+  if ( msg ) {
+    snprintf (reply, sizeof(reply), "%s: %s\n", PROGNAME, msg);
+    serve_write (fd, reply);
+  }
+  if ( status ) {
+    snprintf (reply, sizeof(reply), "ERR %d\n", status);
+  }
+  else {
+    snprintf (reply, sizeof(reply), "OK\n");
+  }
+  serve_write (fd, reply);
+}
+
+
+
+/*
+ * serve_peer_allowed
+ * is the process on the other end root or in group gid?
+ */
+static int serve_peer_allowed (int fd, gid_t gid, int have_group, uid_t *uid) {
+  struct passwd *pwent;
+  struct group *grent;
+  gid_t peer_gid;
+  char **member;
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+
+  if ( getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ) {
+    output_error ("Failed getting peer credentials: %s", strerror(errno));
+    return 0;
+  }
+  *uid = cred.uid;
+  peer_gid = cred.gid;
+#else /* *BSD */
+  if ( getpeereid(fd, uid, &peer_gid) < 0 ) {
+    output_error ("Failed getting peer credentials: %s", strerror(errno));
+    return 0;
+  }
+#endif
+
+  if ( *uid == 0 ) {
+    return 1;
+  }
+  if ( ! have_group ) {
+    return 0;
+  }
+  if ( peer_gid == gid ) {
+    return 1;
+  }
+  /* supplementary members */
+  pwent = getpwuid (*uid);
+  grent = getgrgid (gid);
+  if ( pwent && grent ) {
+    for (member = grent->gr_mem; *member; member++) {
+      if ( ! strcmp(*member, pwent->pw_name) ) {
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+
+/*
+ * serve_queue
+ * add len bytes of str to what client is still to be sent
+ */
+static int serve_queue (struct _serve_client_t *client, const char *str, size_t len) {
+  char *out;
+
+  out = (char *) realloc (client->out, client->out_len + len);
+  if ( ! out ) {
+    output_error ("Insufficient Memory");
+    return 0;
+  }
+  memcpy (out + client->out_len, str, len);
+  client->out = out;
+  client->out_len += len;
+  return 1;
+}
+
+
+
+/*
+ * serve_request
+ * run one request line. Everything that would have gone to
+ * stdout and stderr is queued for the client, then the status
+ */
+static void serve_request (struct _serve_client_t *client, char *line, argdata_t *defaults) {
+  char *argv[BATCH_ARGS_MAX];
+  char reply[SERVE_LINE_MAX];
+  argdata_t *data;
+  int saved_out, saved_err, saved_level, saved_format;
+  int argc, status;
+  off_t size;
+
+  /* the filesystems opened by earlier requests, if still mounted */
+  if ( system_mounts_changed() ) {
+    quota_fs_close_stale ();
+  }
+
+  /* keep our own stdout/stderr, hand the temporary file to the run */
+  fflush (stdout);
+  fflush (stderr);
+  saved_out = dup (STDOUT_FILENO);
+  saved_err = dup (STDERR_FILENO);
+  if ( saved_out < 0 || saved_err < 0
+       || lseek(serve_out, 0, SEEK_SET) < 0 || ftruncate(serve_out, 0) < 0 ) {
+    output_error ("Failed redirecting stdout/stderr: %s", strerror(errno));
+    snprintf (reply, sizeof(reply), "ERR %d\n", ERR_SYS);
+    client->closing = ! serve_queue (client, reply, strlen(reply));
+    if ( saved_out >= 0 ) close (saved_out);
+    if ( saved_err >= 0 ) close (saved_err);
+    return;
+  }
+  dup2 (serve_out, STDOUT_FILENO);
+  dup2 (serve_out, STDERR_FILENO);
+  saved_level = output_level;
+  saved_format = record_format;
+  record_restart ();
+
+  if ( (argc = batch_split(line, argv, BATCH_ARGS_MAX)) < 0 ) {
+    status = ERR_PARSE;
+  }
+  else if ( argc == 1 ) {
+    status = 0;
+  }
+  else if ( ! (data = parse_commandline(argc, argv)) ) {
+    status = ERR_PARSE;
+  }
+  else {
+    data->noaction   |= defaults->noaction;
+    data->raise_only |= defaults->raise_only;
+    quota_forget_grace ();
+    status = run_argdata (data);
+    /* answer a set only after the change is on disk */
+    if ( ! data->dump_info && ! data->dump_all && ! quota_sync_all() && ! status ) {
+      status = ERR_SYS;
+    }
+    parse_free (data);
+  }
+  quota_fs_unpin_all ();
+
+  fflush (stdout);
+  fflush (stderr);
+  dup2 (saved_out, STDOUT_FILENO);
+  dup2 (saved_err, STDERR_FILENO);
+  close (saved_out);
+  close (saved_err);
+  output_level = saved_level;
+  record_format = saved_format;
+
+  /* what the run printed, then the status */
+  size = lseek (serve_out, 0, SEEK_CUR);
+  if ( size > 0 ) {
+    if ( ! (client->out = (char *) malloc (size))
+	 || pread(serve_out, client->out, size, 0) != size ) {
+      output_error ("Failed reading the answer to a request: %s", strerror(errno));
+      free (client->out);
+      client->out = NULL;
+      status = ERR_SYS;
+    }
+    else {
+      client->out_len = size;
+    }
+  }
+  snprintf (reply, sizeof(reply), status ? "ERR %d\n" : "OK\n", status);
+  if ( ! serve_queue(client, reply, strlen(reply)) ) {
+    client->closing = 1;
+  }
+  output_info ("uid %d: %s", (int) client->uid, status ? "failed" : "ok");
+}
+
+
+
+/*
+ * serve_next
+ * run the next complete line the client sent, once
+ * the answer to the one before is written
+ */
+static void serve_next (struct _serve_client_t *client, argdata_t *defaults) {
+  char reply[SERVE_LINE_MAX];
+  char *end;
+
+  if ( client->out || client->closing ) {
+    return;
+  }
+  if ( (end = memchr(client->buf, '\n', client->len)) ) {
+    *end = '\0';
+    serve_request (client, client->buf, defaults);
+    client->len -= end + 1 - client->buf;
+    memmove (client->buf, end + 1, client->len);
+  }
+  else if ( client->len >= sizeof(client->buf) - 1 ) {
+    snprintf (reply, sizeof(reply), "%s: request too long\nERR %d\n", PROGNAME, ERR_PARSE);
+    serve_queue (client, reply, strlen(reply));
+    client->closing = 1;
+  }
+}
+
+
+
+/*
+ * serve_read
+ * read what a client sent.
+ * Returns 0 when the client is gone.
+ */
+static int serve_read (struct _serve_client_t *client) {
+  ssize_t got;
+
+  got = read (client->fd, client->buf + client->len, sizeof(client->buf) - client->len - 1);
+  if ( got < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) ) {
+    return 1;
+  }
+  if ( got <= 0 ) {
+    return 0;
+  }
+  client->len += got;
+  return 1;
+}
+
+
+
+/*
+ * serve_flush
+ * write as much of the answer as the client takes now.
+ * Returns 0 when the client is gone, or done with.
+ */
+static int serve_flush (struct _serve_client_t *client) {
+  ssize_t done;
+
+  while ( client->out_done < client->out_len ) {
+    done = write (client->fd, client->out + client->out_done, client->out_len - client->out_done);
+    if ( done < 0 && errno == EINTR ) {
+      continue;
+    }
+    if ( done < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+      return 1;
+    }
+    if ( done <= 0 ) {
+      return 0;
+    }
+    client->out_done += done;
+  }
+  free (client->out);
+  client->out = NULL;
+  client->out_len = client->out_done = 0;
+  return ! client->closing;
+}
+
+
+
+/*
+ * serve_drop
+ * hang up on a client and free its slot
+ */
+static void serve_drop (struct _serve_client_t *client) {
+  close (client->fd);
+  free (client->out);
+  client->fd = -1;
+  client->out = NULL;
+}
+
+
+
+/*
+ * serve_run
+ * listen on defaults->serve_socket until SIGTERM or SIGINT
+ */
+int serve_run (argdata_t *defaults) {
+  struct sockaddr_un addr;
+  struct pollfd fds[SERVE_CLIENTS_MAX + 1];
+  struct _serve_client_t *slot[SERVE_CLIENTS_MAX + 1];
+  struct sigaction sa;
+  struct group *grent;
+  struct stat st;
+  FILE *answers;
+  gid_t gid = 0;
+  uid_t uid = (uid_t) -1;
+  int listen_fd, fd, nfds, i;
+
+  if ( strlen(defaults->serve_socket) >= sizeof(addr.sun_path) ) {
+    output_error ("Socket path too long: %s", defaults->serve_socket);
+    return ERR_ARG;
+  }
+  if ( defaults->serve_group ) {
+    if ( ! (grent = getgrnam(defaults->serve_group)) ) {
+      output_error ("Group %s does not exist", defaults->serve_group);
+      return ERR_ARG;
+    }
+    gid = grent->gr_gid;
+  }
+
+  /* a socket left behind by an earlier run, but nothing else */
+  if ( lstat(defaults->serve_socket, &st) == 0 ) {
+    if ( ! S_ISSOCK(st.st_mode) ) {
+      output_error ("%s exists and is not a socket", defaults->serve_socket);
+      return ERR_ARG;
+    }
+    unlink (defaults->serve_socket);
+  }
+
+  listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if ( listen_fd < 0 ) {
+    output_error ("Failed creating socket: %s", strerror(errno));
+    return ERR_SYS;
+  }
+  memset (&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, defaults->serve_socket);
+  if ( bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+       || chmod(defaults->serve_socket, defaults->serve_group ? 0660 : 0600) < 0
+       || (defaults->serve_group && chown(defaults->serve_socket, (uid_t) -1, gid) < 0)
+       || listen(listen_fd, SOMAXCONN) < 0 ) {
+    output_error ("Failed listening on %s: %s", defaults->serve_socket, strerror(errno));
+    close (listen_fd);
+    unlink (defaults->serve_socket);
+    return ERR_SYS;
+  }
+
+  memset (&sa, 0, sizeof(sa));
+  sa.sa_handler = serve_signal;
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGINT, &sa, NULL);
+  sa.sa_handler = SIG_IGN;
+  sigaction (SIGPIPE, &sa, NULL);
+
+  /* answers, unlinked: nothing is left behind */
+  if ( ! (answers = tmpfile()) ) {
+    output_error ("Failed creating a temporary file: %s", strerror(errno));
+    close (listen_fd);
+    unlink (defaults->serve_socket);
+    return ERR_SYS;
+  }
+  serve_out = fileno (answers);
+
+  for (i = 0; i < SERVE_CLIENTS_MAX; i++) {
+    clients[i].fd = -1;
+  }
+  parse_records = PARSE_REQUEST;
+  output_notice ("serving requests on %s", defaults->serve_socket);
+
+  while ( ! serve_stop ) {
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    nfds = 1;
+    for (i = 0; i < SERVE_CLIENTS_MAX; i++) {
+      if ( clients[i].fd >= 0 ) {
+	fds[nfds].fd = clients[i].fd;
+	fds[nfds].events = clients[i].out ? POLLOUT : POLLIN;
+	slot[nfds++] = &clients[i];
+      }
+    }
+
+    if ( poll(fds, nfds, -1) < 0 ) {
+      if ( errno == EINTR ) {
+	continue;
+      }
+      output_error ("poll() failed: %s", strerror(errno));
+      break;
+    }
+
+    for (i = 1; i < nfds; i++) {
+      if ( ! fds[i].revents ) {
+	continue;
+      }
+      if ( slot[i]->out ? ! serve_flush(slot[i]) : ! serve_read(slot[i]) ) {
+	serve_drop (slot[i]);
+	continue;
+      }
+      serve_next (slot[i], defaults);
+      if ( slot[i]->closing && ! slot[i]->out ) {
+	serve_drop (slot[i]);
+      }
+    }
+
+    if ( fds[0].revents & POLLIN ) {
+      fd = accept (listen_fd, NULL, NULL);
+      if ( fd < 0 ) {
+	continue;
+      }
+      if ( ! serve_peer_allowed(fd, gid, defaults->serve_group != NULL, &uid) ) {
+	output_info ("refusing uid %d", (int) uid);
+	serve_reply (fd, ERR_SYS, "permission denied");
+	close (fd);
+	continue;
+      }
+      for (i = 0; i < SERVE_CLIENTS_MAX && clients[i].fd >= 0; i++);
+      if ( i == SERVE_CLIENTS_MAX ) {
+	serve_reply (fd, ERR_SYS, "too many clients");
+	close (fd);
+	continue;
+      }
+      fcntl (fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      clients[i].fd = fd;
+      clients[i].uid = uid;
+      clients[i].len = 0;
+      clients[i].out_len = clients[i].out_done = 0;
+      clients[i].closing = 0;
+      output_info ("uid %d connected", (int) uid);
+    }
+  }
+
+  for (i = 0; i < SERVE_CLIENTS_MAX; i++) {
+    if ( clients[i].fd >= 0 ) {
+      serve_drop (&clients[i]);
+    }
+  }
+  fclose (answers);
+  serve_out = -1;
+  close (listen_fd);
+  unlink (defaults->serve_socket);
+  parse_records = 0;
+  output_notice ("stopped serving on %s", defaults->serve_socket);
+  return 0;
+}
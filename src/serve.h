@@ -0,0 +1,24 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * serve.h
+ * answer quota requests on a unix socket
+ */
+#ifndef INCLUDE_QUOTATOOL_SERVE
+#define INCLUDE_QUOTATOOL_SERVE 1
+
+#include <config.h>
+
+#include "parse.h"
+
+/* clients connected at once, and the longest request line */
+#define SERVE_CLIENTS_MAX  64
+#define SERVE_LINE_MAX     4096
+
+int   serve_run   (argdata_t *defaults);
+
+#endif /* INCLUDE_QUOTATOOL_SERVE */
@@ -0,0 +1,226 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * stats.c
+ * --stats: where the time went, and how many quotactl()s it took
+ *
+ * Every phase and every quotactl() command keeps a count, a sum and a
+ * log-linear histogram of its times, so the p50 and p99 of a batch or a
+ * dump of 100k ids come out without keeping each time. Workers update
+ * the same counters, under one lock.
+ */
+#include <config.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "output.h"
+#include "record.h"
+#include "stats.h"
+
+int stats_enabled = 0;
+
+typedef struct {
+  const char *name;
+  u_int64_t total;			/* ns */
+  stats_hist_t hist;			/* ns, count is the calls */
+} stats_entry_t;
+
+static stats_entry_t stats_phases[STATS_PHASES] = {
+  { "mounts", 0, { 0, 0, { 0 } } },
+  { "ids",    0, { 0, 0, { 0 } } },
+  { "probe",  0, { 0, 0, { 0 } } },
+  { "sync",   0, { 0, 0, { 0 } } }
+};
+static stats_entry_t stats_commands[STATS_COMMANDS_MAX];
+static int stats_command_count = 0;
+
+static u_int64_t stats_started = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const stats_fields[] = {
+  "stat", "name", "calls", "total_us", "p50_us", "p99_us", "max_us", NULL
+};
+
+
+
+void stats_enable (void) {
+  stats_enabled = 1;
+  stats_started = stats_now ();
+}
+
+u_int64_t stats_now (void) {
+  struct timespec now;
+
+  if ( ! stats_enabled ) {
+    return 0;
+  }
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (u_int64_t) now.tv_sec * 1000000000 + (u_int64_t) now.tv_nsec;
+}
+
+
+
+/* values below 8 have a bucket each, above that 8 per power of two */
+static int stats_bucket (u_int64_t value) {
+  int bits = 0;
+
+  if ( value < (1 << STATS_SUB_BITS) ) {
+    return (int) value;
+  }
+  while ( bits < 63 && value >> (bits + 1) ) {
+    bits++;
+  }
+  return ((bits - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+    + (int) ((value >> (bits - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+/* the largest value that lands in bucket */
+static u_int64_t stats_bucket_max (int bucket) {
+  int bits, sub;
+
+  if ( bucket < (1 << STATS_SUB_BITS) ) {
+    return (u_int64_t) bucket;
+  }
+  bits = (bucket >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+  sub = bucket & ((1 << STATS_SUB_BITS) - 1);
+  return ((u_int64_t) ((1 << STATS_SUB_BITS) + sub + 1) << (bits - STATS_SUB_BITS)) - 1;
+}
+
+void stats_hist_add (stats_hist_t *hist, u_int64_t value) {
+  hist->count++;
+  if ( value > hist->max ) {
+    hist->max = value;
+  }
+  hist->hist[stats_bucket (value)]++;
+}
+
+void stats_hist_merge (stats_hist_t *into, const stats_hist_t *from) {
+  int i;
+
+  into->count += from->count;
+  if ( from->max > into->max ) {
+    into->max = from->max;
+  }
+  for (i = 0; i < STATS_BUCKETS; i++) {
+    into->hist[i] += from->hist[i];
+  }
+}
+
+u_int64_t stats_hist_quantile (const stats_hist_t *hist, int percent) {
+  u_int64_t rank, seen = 0;
+  int i;
+
+  rank = (hist->count * percent + 99) / 100;
+  if ( ! rank ) {
+    rank = 1;
+  }
+  for (i = 0; i < STATS_BUCKETS; i++) {
+    seen += hist->hist[i];
+    if ( seen >= rank ) {
+      break;
+    }
+  }
+  if ( i == STATS_BUCKETS || stats_bucket_max (i) > hist->max ) {
+    return hist->max;
+  }
+  return stats_bucket_max (i);
+}
+
+static void stats_add (stats_entry_t *entry, u_int64_t ns) {
+  entry->total += ns;
+  stats_hist_add (&entry->hist, ns);
+}
+
+void stats_phase (int phase, u_int64_t start) {
+  u_int64_t ns;
+
+  if ( ! stats_enabled ) {
+    return;
+  }
+  ns = stats_now () - start;
+  pthread_mutex_lock (&stats_lock);
+  stats_add (&stats_phases[phase], ns);
+  pthread_mutex_unlock (&stats_lock);
+}
+
+/* cmd is a string constant, so a pointer compare finds it again */
+void stats_quotactl (const char *cmd, u_int64_t start) {
+  u_int64_t ns;
+  int i;
+
+  if ( ! stats_enabled ) {
+    return;
+  }
+  ns = stats_now () - start;
+  pthread_mutex_lock (&stats_lock);
+  for (i = 0; i < stats_command_count && i < STATS_COMMANDS_MAX - 1; i++) {
+    if ( stats_commands[i].name == cmd ) {
+      break;
+    }
+  }
+  /* the last one collects the commands that don't fit */
+  if ( i == stats_command_count ) {
+    stats_commands[i].name = i < STATS_COMMANDS_MAX - 1 ? cmd : "other";
+    stats_command_count++;
+  }
+  stats_add (&stats_commands[i], ns);
+  pthread_mutex_unlock (&stats_lock);
+}
+
+
+
+static void stats_print_entry (const char *stat, stats_entry_t *entry) {
+  record_t rec;
+
+  if ( record_format == RECORD_TEXT ) {
+    output_notice ("%-16s %8llu %10.3f %9llu %9llu %9llu", entry->name,
+		   (unsigned long long) entry->hist.count, entry->total / 1e6,
+		   (unsigned long long) stats_hist_quantile (&entry->hist, 50) / 1000,
+		   (unsigned long long) stats_hist_quantile (&entry->hist, 99) / 1000,
+		   (unsigned long long) entry->hist.max / 1000);
+    return;
+  }
+  record_begin (&rec, stats_fields);
+  record_str (&rec, stat);
+  record_str (&rec, entry->name);
+  record_u64 (&rec, entry->hist.count);
+  record_u64 (&rec, entry->total / 1000);
+  record_u64 (&rec, stats_hist_quantile (&entry->hist, 50) / 1000);
+  record_u64 (&rec, stats_hist_quantile (&entry->hist, 99) / 1000);
+  record_u64 (&rec, entry->hist.max / 1000);
+  record_end (&rec);
+}
+
+void stats_print (void) {
+  stats_entry_t total;
+  int i;
+
+  if ( ! stats_enabled ) {
+    return;
+  }
+  memset (&total, 0, sizeof(total));
+  total.name = "total";
+  stats_add (&total, stats_now () - stats_started);
+
+  pthread_mutex_lock (&stats_lock);
+  if ( record_format == RECORD_TEXT ) {
+    output_notice ("%-16s %8s %10s %9s %9s %9s",
+		   "stats", "calls", "total ms", "p50 us", "p99 us", "max us");
+  }
+  for (i = 0; i < STATS_PHASES; i++) {
+    if ( stats_phases[i].hist.count ) {
+      stats_print_entry ("phase", &stats_phases[i]);
+    }
+  }
+  for (i = 0; i < stats_command_count; i++) {
+    stats_print_entry ("quotactl", &stats_commands[i]);
+  }
+  stats_print_entry ("total", &total);
+  pthread_mutex_unlock (&stats_lock);
+}
@@ -0,0 +1,57 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * stats.h
+ * --stats: where the time went, and how many quotactl()s it took
+ */
+#ifndef INCLUDE_QUOTATOOL_STATS
+#define INCLUDE_QUOTATOOL_STATS 1
+
+#include <config.h>
+
+#include <sys/types.h>
+
+/* phases of a run, timed wherever they happen */
+#define STATS_MOUNTS  0		/* finding filesystems in the mount table */
+#define STATS_IDS     1		/* user, group and project names to ids */
+#define STATS_PROBE   2		/* detecting quota formats */
+#define STATS_SYNC    3		/* Q_SYNC at the end */
+#define STATS_PHASES  4
+
+/* different quotactl() commands seen, more are counted as "other" */
+#define STATS_COMMANDS_MAX  16
+
+/* log-linear histogram: 8 buckets per power of two, quantiles
+ * come out within 12.5% */
+#define STATS_SUB_BITS  3
+#define STATS_BUCKETS   ((64 - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+/* of latencies in ns here, of anything elsewhere (--summary). Two are
+ * merged by adding up their buckets, the quantiles stay as exact */
+typedef struct {
+  u_int64_t count;
+  u_int64_t max;
+  u_int64_t hist[STATS_BUCKETS];
+} stats_hist_t;
+
+extern int stats_enabled;
+
+void      stats_enable   (void);
+/* monotonic nanoseconds, 0 when --stats is off */
+u_int64_t stats_now      (void);
+/* add the time since start, a stats_now(), to a phase or a command */
+void      stats_phase    (int phase, u_int64_t start);
+void      stats_quotactl (const char *cmd, u_int64_t start);
+/* the table on stderr, or records with --output csv|ndjson */
+void      stats_print    (void);
+
+void      stats_hist_add      (stats_hist_t *hist, u_int64_t value);
+void      stats_hist_merge    (stats_hist_t *into, const stats_hist_t *from);
+/* the value percent of the values are at most */
+u_int64_t stats_hist_quantile (const stats_hist_t *hist, int percent);
+
+#endif /* INCLUDE_QUOTATOOL_STATS */
@@ -0,0 +1,189 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * summary.c
+ * --summary: totals and the distribution of usage, one record per filesystem
+ *
+ * One pass over the kernel's list of ids per filesystem, as for -D,
+ * keeping only sums and a histogram of how full each id is (usage in
+ * percent of its block limit). The histogram is the one --stats uses:
+ * fixed size, and two of them add up to the histogram of both, so the
+ * record for all filesystems has real quantiles too, not an average
+ * of the per-filesystem ones.
+ */
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statvfs.h>
+
+#include "quotatool.h"
+#include "output.h"
+#include "parse.h"
+#include "quota.h"
+#include "record.h"
+#include "stats.h"
+#include "summary.h"
+
+struct _summary_t {
+  u_int64_t size_kb;		/* of the filesystem, 0 if unknown */
+  u_int64_t ids;		/* with usage or limits */
+  u_int64_t unlimited;		/* of those, with no block or inode limit */
+  u_int64_t block_used_kb;
+  u_int64_t block_hard_kb;	/* hard limits, soft where there is none */
+  u_int64_t inode_used;
+  u_int64_t inode_hard;		/* same */
+  stats_hist_t used;		/* hundredths of a percent of the block limit */
+};
+
+static const char *const summary_fields[] = {
+  "type", "filesystem", "size_kb", "ids", "ids_unlimited", "block_used_kb", "block_limit_kb",
+  "overcommit_pct", "inode_used", "inode_limit", "used_pct_p50", "used_pct_p90",
+  "used_pct_p99", "used_pct_max", NULL
+};
+
+
+
+/* hundredths of a percent to whole ones, rounded up */
+#define SUMMARY_PCT(hundredths) DIV_UP((hundredths), 100)
+
+static void summary_print (argdata_t *argdata, const char *name, struct _summary_t *sum) {
+  record_t rec;
+
+  record_begin (&rec, summary_fields);
+  record_label (&rec, QUOTA_TYPE_NAME(argdata->id_type));
+  record_str (&rec, name);
+  record_u64 (&rec, sum->size_kb);
+  record_u64 (&rec, sum->ids);
+  record_u64 (&rec, sum->unlimited);
+  record_u64 (&rec, sum->block_used_kb);
+  record_u64 (&rec, sum->block_hard_kb);
+  record_u64 (&rec, sum->size_kb ? sum->block_hard_kb * 100 / sum->size_kb : 0);
+  record_u64 (&rec, sum->inode_used);
+  record_u64 (&rec, sum->inode_hard);
+  if ( sum->used.count ) {
+    record_u64 (&rec, SUMMARY_PCT(stats_hist_quantile(&sum->used, 50)));
+    record_u64 (&rec, SUMMARY_PCT(stats_hist_quantile(&sum->used, 90)));
+    record_u64 (&rec, SUMMARY_PCT(stats_hist_quantile(&sum->used, 99)));
+    record_u64 (&rec, SUMMARY_PCT(sum->used.max));
+  }
+  else {
+    record_u64 (&rec, 0);
+    record_u64 (&rec, 0);
+    record_u64 (&rec, 0);
+    record_u64 (&rec, 0);
+  }
+  record_end (&rec);
+}
+
+
+
+/*
+ * summary_fs
+ * add up every id of argdata->id_type on fs into sum
+ */
+static int summary_fs (argdata_t *argdata, quota_fs_t *fs, struct _summary_t *sum) {
+  struct statvfs st;
+  quota_t *quota;
+  u_int64_t limit;
+  int found;
+
+  if ( statvfs(fs->_mnt.mount_pt, &st) == 0 ) {
+    sum->size_kb = (u_int64_t) st.f_blocks * st.f_frsize / 1024;
+  }
+
+  quota = quota_new (fs, argdata->id_type, 0);
+  if ( ! quota ) {
+    return ERR_SYS;
+  }
+  while ( (found = quota_get_next(quota)) > 0 ) {
+    if ( quota->diskspace_used || quota->block_soft || quota->block_hard
+	 || quota->inode_used || quota->inode_soft || quota->inode_hard ) {
+      sum->ids++;
+      if ( ! quota->block_soft && ! quota->block_hard
+	   && ! quota->inode_soft && ! quota->inode_hard ) {
+	sum->unlimited++;
+      }
+      sum->block_used_kb += DIV_UP(quota->diskspace_used, 1024);
+      limit = quota->block_hard ? quota->block_hard : quota->block_soft;
+      if ( limit ) {
+	sum->block_hard_kb += BLOCKS_TO_KB(limit);
+	stats_hist_add (&sum->used, BYTES_TO_BLOCKS(quota->diskspace_used) * 10000 / limit);
+      }
+      sum->inode_used += quota->inode_used;
+      sum->inode_hard += quota->inode_hard ? quota->inode_hard : quota->inode_soft;
+    }
+    /* the highest possible id, don't wrap around to 0 */
+    if ( (unsigned int) quota->_id == (unsigned int) -1 ) {
+      break;
+    }
+    quota->_id++;
+  }
+  quota_delete (quota);
+  return found < 0 ? ERR_SYS : 0;
+}
+
+
+
+int summary_run (argdata_t *argdata, char **qfiles, int count) {
+  struct _summary_t *sum, *total;
+  quota_fs_t **done, *fs;
+  int retval, status, summed, i, j;
+
+  /* two histograms are 8k, keep them off the stack */
+  sum = (struct _summary_t *) malloc (sizeof(struct _summary_t));
+  total = (struct _summary_t *) calloc (1, sizeof(struct _summary_t));
+  done = (quota_fs_t **) calloc (count, sizeof(quota_fs_t *));
+  if ( ! sum || ! total || ! done ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+
+  output_info ("");
+  output_info ("Filesystem size ids unlimited blocks limits overcommit%% files limits "
+	       "used%%p50 p90 p99 max");
+
+  retval = summed = 0;
+  for (i = 0; i < count; i++) {
+    if ( ! (fs = quota_fs_open(qfiles[i])) ) {
+      retval = ERR_SYS;
+      continue;
+    }
+    /* the same filesystem twice, by another name */
+    for (j = 0; j < i && done[j] != fs; j++);
+    if ( j < i ) {
+      output_info ("%s is the same filesystem as %s, skipping", qfiles[i], qfiles[j]);
+      continue;
+    }
+    done[i] = fs;
+
+    memset (sum, 0, sizeof(struct _summary_t));
+    if ( (status = summary_fs(argdata, fs, sum)) ) {
+      if ( ! retval ) retval = status;
+      continue;
+    }
+    summary_print (argdata, qfiles[i], sum);
+
+    total->size_kb       += sum->size_kb;
+    total->ids           += sum->ids;
+    total->unlimited     += sum->unlimited;
+    total->block_used_kb += sum->block_used_kb;
+    total->block_hard_kb += sum->block_hard_kb;
+    total->inode_used    += sum->inode_used;
+    total->inode_hard    += sum->inode_hard;
+    stats_hist_merge (&total->used, &sum->used);
+    summed++;
+  }
+  if ( summed > 1 ) {
+    summary_print (argdata, "total", total);
+  }
+
+  free (done);
+  free (total);
+  free (sum);
+  return retval;
+}
@@ -0,0 +1,22 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * summary.h
+ * --summary: totals and the distribution of usage, one record per filesystem
+ */
+#ifndef INCLUDE_QUOTATOOL_SUMMARY
+#define INCLUDE_QUOTATOOL_SUMMARY 1
+
+#include <config.h>
+
+#include "parse.h"
+
+/* a record for each of the filesystems qfiles, summing up all ids of
+ * argdata->id_type, and one for all of them if there are several */
+int   summary_run   (argdata_t *argdata, char **qfiles, int count);
+
+#endif /* INCLUDE_QUOTATOOL_SUMMARY */
@@ -38,19 +38,186 @@ struct mntent {
 #endif /* *BSD */
 
 #include <sys/types.h>
+#include <sys/stat.h>
+
+#if PLATFORM_LINUX
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <sys/sysmacros.h>	/* makedev() */
+#  define MOUNTINFO "/proc/self/mountinfo"
+#endif
 
 #include "output.h"
 #include "quotatool.h"
 #include "system.h"
+#if PLATFORM_LINUX
+#  include "fakequota.h"
+#endif
+
+
+
+/* filesystems we have already found, so that batch mode
+ * only scans the mount table once per filesystem */
+struct _fs_cache_t {
+  char *fs_spec;
+  fs_t fs;
+  struct _fs_cache_t *next;
+};
+static struct _fs_cache_t *fs_cache = NULL;
+
+static fs_t *_system_findfs (char *fs_spec);
+static unsigned int _system_hash (const char *str, unsigned int size);
+
+
+
+#if PLATFORM_LINUX
+/* one line of /proc/self/mountinfo */
+struct _mount_t {
+  char *source;			/* device, as the kernel reports it */
+  char *mount_pt;
+  char *fstype;
+  char *opts;			/* per-mount options, then superblock options */
+  dev_t dev;
+  int mnt_id;
+  int next_mnt, next_src, next_dev;	/* hash chains, -1 ends them */
+};
+
+/* the mount table, read once and indexed by mount point,
+ * source device and device number */
+static struct _mount_t *mounts = NULL;
+static int mounts_count = 0;
+static int *mnt_hash, *src_hash, *dev_hash;
+static unsigned int hash_size = 0;
+static int mountinfo_state = 0;	/* 0: not read, 1: indexed, -1: unavailable */
+static int mountinfo_watch = -1;	/* MOUNTINFO kept open, see system_mounts_changed() */
+
+static int _system_mountinfo_load (void);
+static void _system_quotaopts (const char *opts, char *buf, size_t size);
+static int _system_mountinfo_reload (void);
+static void _system_mountinfo_free (void);
+static fs_t *_system_mountinfo_findfs (char *fs_spec);
+#endif /* PLATFORM_LINUX */
 
 
 
 /*
  * system_getfs
  * find and verify the device file for
- * a given filesystem
+ * a given filesystem. The caller frees the result.
  */
 fs_t *system_getfs (char *fs_spec) {
+  struct _fs_cache_t *cached;
+  fs_t *ent;
+
+  for (cached = fs_cache; cached; cached = cached->next) {
+    if ( ! strcmp(cached->fs_spec, fs_spec) ) {
+      output_debug ("Using cached device node %s for %s", cached->fs.device, fs_spec);
+      break;
+    }
+  }
+
+  if ( ! cached ) {
+    ent = _system_findfs (fs_spec);
+    if ( ! ent ) {
+      return NULL;
+    }
+    /* not cached if there's no memory for it, just found again next time */
+    cached = (struct _fs_cache_t *) malloc (sizeof(struct _fs_cache_t));
+    if ( ! cached || ! (cached->fs_spec = strdup(fs_spec)) ) {
+      free (cached);
+      return ent;
+    }
+    memcpy (&cached->fs, ent, sizeof(fs_t));
+    cached->next = fs_cache;
+    fs_cache = cached;
+    return ent;
+  }
+
+  ent = (fs_t *) malloc (sizeof(fs_t));
+  if ( ! ent ) {
+    output_error ("Insufficient Memory");
+    errno = ENOMEM;
+    return NULL;
+  }
+  memcpy (ent, &cached->fs, sizeof(fs_t));
+  return ent;
+}
+
+
+
+/*
+ * system_mounts_changed
+ * has anything been mounted or unmounted since the last call?
+ * If so, the filesystems found so far and the mount table are
+ * forgotten, the next lookups see what is mounted now (--serve).
+ * The first call, and any call where it can't be told, says yes.
+ */
+int system_mounts_changed (void) {
+  struct _fs_cache_t *cached;
+#if PLATFORM_LINUX
+  struct pollfd pfd;
+
+  if ( fake_quota_active() ) {
+    return 0;			/* the seed file doesn't change */
+  }
+  /* mountinfo polls POLLPRI once for every change since the last poll */
+  if ( mountinfo_watch >= 0 ) {
+    pfd.fd = mountinfo_watch;
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+    if ( poll(&pfd, 1, 0) == 0 ) {
+      return 0;
+    }
+  }
+  else {
+    mountinfo_watch = open (MOUNTINFO, O_RDONLY | O_CLOEXEC);
+  }
+  _system_mountinfo_free ();
+#endif /* PLATFORM_LINUX */
+
+  while ( (cached = fs_cache) ) {
+    fs_cache = cached->next;
+    free (cached->fs_spec);
+    free (cached);
+  }
+  output_debug ("Mounts changed, looking up filesystems again");
+  return 1;
+}
+
+
+
+/*
+ * system_mount_current
+ * is fs still the filesystem mounted at its mount point?
+ * Anything else (unmounted, mounted over, another device
+ * mounted there) makes a handle on it stale. Without the
+ * mountinfo index (*BSD) that can't be told, the answer is no.
+ */
+int system_mount_current (const fs_t *fs) {
+#if PLATFORM_LINUX
+  int i;
+
+  if ( _system_mountinfo_load() <= 0 || fs->mnt_id < 0 ) {
+    return 0;
+  }
+  /* the latest mount on a mount point comes first in its chain */
+  for (i = mnt_hash[_system_hash(fs->mount_pt, hash_size)]; i >= 0; i = mounts[i].next_mnt) {
+    if ( ! strcmp(mounts[i].mount_pt, fs->mount_pt) ) {
+      return mounts[i].mnt_id == fs->mnt_id && mounts[i].dev == fs->dev;
+    }
+  }
+#endif /* PLATFORM_LINUX */
+  (void) fs;
+  return 0;
+}
+
+
+
+/*
+ * _system_findfs
+ * scan the mount table for fs_spec
+ */
+static fs_t *_system_findfs (char *fs_spec) {
   struct mntent *current_fs;
   FILE *etc_mtab;
   fs_t *ent;
@@ -58,11 +225,19 @@ fs_t *system_getfs (char *fs_spec) {
 #if HAVE_FSTAB_H /* *BSD */
   struct fstab *entry;
 #endif
+#if PLATFORM_LINUX
+  int loaded;
+
+  if ( (loaded = _system_mountinfo_load()) ) {
+    return loaded > 0 ? _system_mountinfo_findfs (fs_spec) : NULL;
+  }
+#endif
 
   ent = (fs_t *) malloc (sizeof(fs_t));
   if ( ! ent ) {
     output_error ("Insufficient Memory");
-    exit (ERR_MEM);
+    errno = ENOMEM;
+    return NULL;
   }
 
 
@@ -74,7 +249,10 @@ fs_t *system_getfs (char *fs_spec) {
   current_fs = (struct mntent*) malloc(sizeof(struct mntent));
   if (! current_fs) {
     output_error("Out of memory");
-    exit (ERR_MEM);
+    free (ent);
+    endfsent();
+    errno = ENOMEM;
+    return NULL;
   }
 #else
   etc_mtab = setmntent (MOUNTFILE, "r");
@@ -134,6 +312,9 @@ fs_t *system_getfs (char *fs_spec) {
       #if PLATFORM_LINUX
       strncpy(ent->mnt_type, current_fs->mnt_type, PATH_MAX-1);
       ent->mnt_type[PATH_MAX-1] = '\0';
+      ent->mnt_id = -1;
+      ent->dev = 0;
+      ent->quota_opts[0] = '\0';
       #endif
 
       if ((loopd_start = strstr(current_fs->mnt_opts, LOOP_PREFIX "/")) != NULL) {
@@ -187,6 +368,8 @@ fs_t *system_getfs (char *fs_spec) {
     output_error ("Filesystem %s is mounted read-only\n", fs_spec);
     endmntent (etc_mtab);
 #endif
+    free (ent);
+    errno = EROFS;
     return NULL;
   }
 
@@ -205,6 +388,829 @@ fs_t *system_getfs (char *fs_spec) {
 
 
 
+/*
+ * _system_hash
+ * FNV-1a, for the mount and id indexes. size is a power of two.
+ */
+static unsigned int _system_hash (const char *str, unsigned int size) {
+  unsigned int hash = 2166136261u;
+
+  while ( *str ) {
+    hash ^= (unsigned char) *str++;
+    hash *= 16777619u;
+  }
+  return hash & (size - 1);
+}
+
+
+
+static char *_system_strdup (const char *str) {
+  char *copy = strdup (str);
+
+  if ( ! copy ) {
+    output_error ("Insufficient Memory");
+    exit (ERR_MEM);
+  }
+  return copy;
+}
+
+
+
+/*
+ * _system_hasopt
+ * is opt one of the comma separated words in opts?
+ */
+static int _system_hasopt (const char *opts, const char *opt) {
+  size_t len = strlen (opt);
+  const char *cp;
+
+  for (cp = opts; cp; cp = strchr(cp, ',')) {
+    if ( *cp == ',' ) cp++;
+    if ( ! strncmp(cp, opt, len) && (cp[len] == ',' || cp[len] == '\0') ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+
+#if PLATFORM_LINUX
+static unsigned int _system_hash_dev (dev_t dev) {
+  return (major(dev) * 31u + minor(dev)) & (hash_size - 1);
+}
+
+
+
+/*
+ * _system_unescape
+ * undo the kernel's octal escapes (\040 for space etc), in place
+ */
+static char *_system_unescape (char *str) {
+  char *in, *out;
+
+  for (in = out = str; *in; out++) {
+    if ( in[0] == '\\'
+	 && in[1] >= '0' && in[1] <= '3'
+	 && in[2] >= '0' && in[2] <= '7'
+	 && in[3] >= '0' && in[3] <= '7' ) {
+      *out = (char) (((in[1] - '0') << 6) | ((in[2] - '0') << 3) | (in[3] - '0'));
+      in += 4;
+    }
+    else {
+      *out = *in++;
+    }
+  }
+  *out = '\0';
+  return str;
+}
+
+
+
+/*
+ * _system_mount_new
+ * room for one more mount in the table
+ */
+static struct _mount_t *_system_mount_new (int *allocated) {
+  struct _mount_t *grown;
+
+  if ( mounts_count == *allocated ) {
+    grown = (struct _mount_t *) realloc (mounts, (*allocated ? *allocated * 2 : 256)
+					 * sizeof(struct _mount_t));
+    if ( ! grown ) {
+      return NULL;
+    }
+    mounts = grown;
+    *allocated = *allocated ? *allocated * 2 : 256;
+  }
+  memset (&mounts[mounts_count], 0, sizeof(struct _mount_t));
+  return &mounts[mounts_count++];
+}
+
+
+
+/*
+ * _system_mountinfo_load
+ * read /proc/self/mountinfo once and index it, or the mounts
+ * of the fake quota backend (QUOTATOOL_FAKE) instead.
+ * Returns 0 if it can't be read, the caller falls back to MOUNTFILE,
+ * -1 if there is no memory for it.
+ * Line format, see proc(5):
+ * 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+ */
+static int _system_mountinfo_load (void) {
+  FILE *fp = NULL;
+  char *line = NULL;
+  size_t line_size = 0;
+  char *field[6], *fstype, *source, *super_opts, *cp;
+  unsigned int maj, min, h;
+  int allocated, i, nfields, fake, mnt_id;
+  const fake_mount_t *fake_mnt;
+  struct _mount_t *mnt;
+
+  if ( mountinfo_state ) {
+    return mountinfo_state > 0;
+  }
+
+  mountinfo_state = -1;
+  allocated = 0;
+  fake = fake_quota_active ();
+  if ( fake ) {
+    for (i = 0; (fake_mnt = fake_quota_mount(i)); i++) {
+      if ( ! (mnt = _system_mount_new(&allocated))
+	   || ! (mnt->source   = strdup(fake_mnt->source))
+	   || ! (mnt->mount_pt = strdup(fake_mnt->mount_pt))
+	   || ! (mnt->fstype   = strdup(fake_mnt->fstype))
+	   || ! (mnt->opts     = strdup(fake_mnt->opts)) ) {
+	goto nomem;
+      }
+      mnt->dev      = fake_mnt->dev;
+      mnt->mnt_id   = i + 1;
+    }
+  }
+  else if ( ! (fp = fopen(MOUNTINFO, "r")) ) {
+    output_debug ("Failed opening %s: %s, using %s", MOUNTINFO,
+		  strerror(errno), MOUNTFILE);
+    return 0;
+  }
+
+  while ( fp && getline(&line, &line_size, fp) > 0 ) {
+    /* the six fixed fields */
+    cp = line;
+    for (nfields = 0; nfields < 6; nfields++) {
+      if ( ! (field[nfields] = strsep(&cp, " \n")) || ! cp ) break;
+    }
+    /* optional fields up to the separator */
+    while ( cp && (fstype = strsep(&cp, " \n")) && strcmp(fstype, "-") );
+    fstype     = cp ? strsep(&cp, " \n") : NULL;
+    source     = cp ? strsep(&cp, " \n") : NULL;
+    super_opts = cp ? strsep(&cp, " \n") : NULL;
+    if ( nfields < 6 || ! super_opts
+	 || sscanf(field[2], "%u:%u", &maj, &min) != 2 || sscanf(field[0], "%d", &mnt_id) != 1 ) {
+      output_debug ("Skipping unparsable line in %s", MOUNTINFO);
+      continue;
+    }
+
+    if ( ! (mnt = _system_mount_new(&allocated))
+	 || ! (mnt->source   = strdup(_system_unescape(source)))
+	 || ! (mnt->mount_pt = strdup(_system_unescape(field[4])))
+	 || ! (mnt->fstype   = strdup(fstype))
+	 || ! (mnt->opts = (char *) malloc (strlen(field[5]) + strlen(super_opts) + 2)) ) {
+      goto nomem;
+    }
+    sprintf (mnt->opts, "%s,%s", field[5], super_opts);
+    mnt->dev = makedev (maj, min);
+    mnt->mnt_id = mnt_id;
+  }
+  free (line);
+  if ( fp ) {
+    fclose (fp);
+  }
+
+  if ( ! mounts_count && ! fake ) {
+    output_debug ("No mounts in %s, using %s", MOUNTINFO, MOUNTFILE);
+    return 0;
+  }
+
+  /* power of two, at least twice the number of mounts */
+  for (hash_size = 64; hash_size < 2u * mounts_count; hash_size <<= 1);
+  mnt_hash = (int *) malloc (3 * hash_size * sizeof(int));
+  if ( ! mnt_hash ) {
+    goto nomem;
+  }
+  src_hash = mnt_hash + hash_size;
+  dev_hash = src_hash + hash_size;
+  memset (mnt_hash, 0xff, 3 * hash_size * sizeof(int));	/* all -1 */
+
+  /* the latest mount on a mount point hides the earlier ones,
+   * so it goes first in its chain; a device mounted several
+   * times is found at its first mount, like in MOUNTFILE */
+  for (i = 0; i < mounts_count; i++) {
+    h = _system_hash (mounts[i].mount_pt, hash_size);
+    mounts[i].next_mnt = mnt_hash[h];
+    mnt_hash[h] = i;
+    h = _system_hash_dev (mounts[i].dev);
+    mounts[i].next_dev = dev_hash[h];
+    dev_hash[h] = i;
+  }
+  for (i = mounts_count - 1; i >= 0; i--) {
+    h = _system_hash (mounts[i].source, hash_size);
+    mounts[i].next_src = src_hash[h];
+    src_hash[h] = i;
+  }
+
+  output_debug ("Indexed %d mounts from %s", mounts_count, fake ? FAKE_QUOTA_ENV : MOUNTINFO);
+  mountinfo_state = 1;
+  return 1;
+
+ nomem:
+  output_error ("Insufficient Memory");
+  free (line);
+  if ( fp ) {
+    fclose (fp);
+  }
+  _system_mountinfo_free ();	/* and try again next time */
+  errno = ENOMEM;
+  return -1;
+}
+
+
+
+/*
+ * _system_mountinfo_free
+ * forget the mount table and its index
+ */
+static void _system_mountinfo_free (void) {
+  int i;
+
+  for (i = 0; i < mounts_count; i++) {
+    free (mounts[i].source);
+    free (mounts[i].mount_pt);
+    free (mounts[i].fstype);
+    free (mounts[i].opts);
+  }
+  free (mounts);
+  free (mnt_hash);
+  mounts = NULL;
+  mnt_hash = src_hash = dev_hash = NULL;
+  mounts_count = 0;
+  mountinfo_state = 0;
+}
+
+
+
+/*
+ * _system_mountinfo_reload
+ * forget the index and read mountinfo again, for
+ * filesystems mounted since (a long running --serve)
+ */
+static int _system_mountinfo_reload (void) {
+  _system_mountinfo_free ();
+  return _system_mountinfo_load ();
+}
+
+
+
+/*
+ * _system_mountinfo_lookup
+ * find the mount for fs_spec: a mount point, a device, or
+ * any path on a mounted filesystem (matched by device number)
+ */
+static struct _mount_t *_system_mountinfo_lookup (char *fs_spec) {
+  struct stat st;
+  char path[PATH_MAX];
+  struct _mount_t *best;
+  size_t len, best_len;
+  dev_t dev;
+  int i, is_root;
+
+  /* Ignore 'rootfs' if looking for mountpoint '/' - created and mounted by Linux initramfs */
+  is_root = ! strcmp("/", fs_spec);
+
+  for (i = mnt_hash[_system_hash(fs_spec, hash_size)]; i >= 0; i = mounts[i].next_mnt) {
+    if ( ! strcmp(mounts[i].mount_pt, fs_spec)
+	 && ! (is_root && ! strcmp(mounts[i].source, "rootfs")) ) {
+      return &mounts[i];
+    }
+  }
+  for (i = src_hash[_system_hash(fs_spec, hash_size)]; i >= 0; i = mounts[i].next_src) {
+    if ( ! strcmp(mounts[i].source, fs_spec) ) {
+      return &mounts[i];
+    }
+  }
+
+  if ( stat(fs_spec, &st) < 0 ) {
+    output_debug ("Cannot stat %s: %s", fs_spec, strerror(errno));
+    return NULL;
+  }
+  dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+  if ( S_ISBLK(st.st_mode) || ! realpath(fs_spec, path) ) {
+    path[0] = '\0';
+  }
+
+  /* bind mounts share a device number: prefer the deepest
+   * mount point above the path, else the first/latest mount */
+  best = NULL;
+  best_len = 0;
+  for (i = dev_hash[_system_hash_dev(dev)]; i >= 0; i = mounts[i].next_dev) {
+    if ( mounts[i].dev != dev || ! strcmp(mounts[i].source, "rootfs") ) {
+      continue;
+    }
+    len = strlen (mounts[i].mount_pt);
+    if ( path[0] && ! strncmp(mounts[i].mount_pt, path, len)
+	 && (path[len] == '/' || path[len] == '\0' || len == 1) ) {
+      if ( len > best_len ) {
+	best = &mounts[i];
+	best_len = len;
+      }
+    }
+    else if ( ! best_len && (! best || S_ISBLK(st.st_mode)) ) {
+      best = &mounts[i];
+    }
+  }
+  if ( best ) {
+    output_debug ("%s is on device %u:%u, mounted at '%s'", fs_spec,
+		  major(dev), minor(dev), best->mount_pt);
+  }
+  return best;
+}
+
+
+
+/*
+ * _system_mountinfo_findfs
+ * _system_findfs() using the mountinfo index
+ */
+static fs_t *_system_mountinfo_findfs (char *fs_spec) {
+  #define LOOP_PREFIX "loop="
+  struct _mount_t *mnt;
+  char *loopd_start, *loopd_end;
+  fs_t *ent;
+
+  output_debug ("Looking for fs_spec '%s'", fs_spec);
+
+  mnt = _system_mountinfo_lookup (fs_spec);
+  if ( ! mnt ) {
+    output_debug ("Not found, re-reading %s", MOUNTINFO);
+    switch ( _system_mountinfo_reload() ) {
+    case 1:
+      mnt = _system_mountinfo_lookup (fs_spec);
+      break;
+    case -1:
+      return NULL;
+    }
+  }
+  if ( ! mnt ) {
+    output_error ("Filesystem %s does not exist", fs_spec);
+    return NULL;
+  }
+  output_debug ("Found device '%s', mounted at '%s'", mnt->source, mnt->mount_pt);
+
+  ent = (fs_t *) malloc (sizeof(fs_t));
+  if ( ! ent ) {
+    output_error ("Insufficient Memory");
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  strncpy (ent->mnt_type, mnt->fstype, PATH_MAX-1);
+  ent->mnt_type[PATH_MAX-1] = '\0';
+  strncpy (ent->mount_pt, mnt->mount_pt, PATH_MAX-1);
+  ent->mount_pt[PATH_MAX-1] = '\0';
+  ent->mnt_id = mnt->mnt_id;
+  ent->dev = mnt->dev;
+  _system_quotaopts (mnt->opts, ent->quota_opts, sizeof(ent->quota_opts));
+
+  if ((loopd_start = strstr(mnt->opts, LOOP_PREFIX "/")) != NULL) {
+    loopd_start += strlen(LOOP_PREFIX);
+    output_debug("%s looks like a loop device, trying to grok opts: %s",
+		 mnt->source, mnt->opts);
+    for (loopd_end = loopd_start;
+	 *loopd_end != '\0' && *loopd_end != ',' && loopd_end - loopd_start < PATH_MAX-1;
+	 loopd_end++);
+    strncpy(ent->device, loopd_start, loopd_end - loopd_start);
+    ent->device[loopd_end - loopd_start] = '\0';
+    output_debug("found loop device %s", ent->device);
+  }
+  else {
+    strncpy (ent->device, mnt->source, PATH_MAX-1);
+    ent->device[PATH_MAX-1] = '\0';
+  }
+
+  /* can we write to the device? */
+  if ( _system_hasopt(mnt->opts, "ro") ) {
+    output_error ("Filesystem %s is mounted read-only", fs_spec);
+    free (ent);
+    errno = EROFS;
+    return NULL;
+  }
+
+  output_info ("filesystem %s has device node %s", fs_spec, ent->device);
+  return ent;
+}
+#endif /* PLATFORM_LINUX */
+
+
+/* mount options that mean quotas are on, as "opt" or "opt=value" */
+static const char *quota_mount_opts[] = {
+  "quota", "usrquota", "grpquota", "prjquota", "usrjquota", "grpjquota",
+  "uquota", "gquota", "pquota", "uqnoenforce", "gqnoenforce", "pqnoenforce",
+  "qnoenforce", "userquota", "groupquota", NULL
+};
+
+static int _system_hasquotaopt (const char *opts) {
+  const char *cp;
+  size_t len;
+  int i;
+
+  for (cp = opts; cp; cp = strchr(cp, ',')) {
+    if ( *cp == ',' ) cp++;
+    len = strcspn (cp, ",=");
+    for (i = 0; quota_mount_opts[i]; i++) {
+      if ( strlen(quota_mount_opts[i]) == len && ! strncmp(cp, quota_mount_opts[i], len) ) {
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+
+#if PLATFORM_LINUX
+/*
+ * _system_quotaopts
+ * the quota options in opts (and the journalled quota format, jqfmt)
+ * into buf, comma separated, for quota.c's format cache
+ */
+static void _system_quotaopts (const char *opts, char *buf, size_t size) {
+  const char *cp;
+  size_t len, name_len, used;
+  int i;
+
+  used = 0;
+  buf[0] = '\0';
+  for (cp = opts; cp; cp = strchr(cp, ',')) {
+    if ( *cp == ',' ) cp++;
+    len = strcspn (cp, ",");
+    name_len = strcspn (cp, ",=");
+    for (i = 0; quota_mount_opts[i]; i++) {
+      if ( strlen(quota_mount_opts[i]) == name_len && ! strncmp(cp, quota_mount_opts[i], name_len) ) {
+	break;
+      }
+    }
+    if ( ! quota_mount_opts[i] && ! (name_len == 5 && ! strncmp(cp, "jqfmt", 5)) ) {
+      continue;
+    }
+    if ( used + len + 2 > size ) {
+      break;
+    }
+    if ( used ) {
+      buf[used++] = ',';
+    }
+    memcpy (buf + used, cp, len);
+    used += len;
+    buf[used] = '\0';
+  }
+}
+#endif /* PLATFORM_LINUX */
+
+
+
+/*
+ * system_getquotafs
+ * mount points of all read-write filesystems mounted with quota
+ * options, each filesystem only once, as mounted now. count is set
+ * to its length. The caller frees the list; the strings in it are
+ * kept for the life of the process (threads may still hold them).
+ */
+char **system_getquotafs (int *count) {
+  char **list = NULL;
+  int listed = 0;
+  int allocated = 0;
+#if HAVE_MNTENT_H
+  struct mntent *current_fs;
+  FILE *etc_mtab;
+#elif HAVE_FSTAB_H /* *BSD */
+  struct fstab *entry;
+#endif
+#if PLATFORM_LINUX
+  int i, j;
+#endif
+
+#define _SYSTEM_LIST_ADD(mount_pt) do {					\
+    if ( listed + 1 >= allocated ) {					\
+      allocated = allocated ? allocated * 2 : 16;			\
+      list = (char **) realloc (list, allocated * sizeof(char *));	\
+      if ( ! list ) {							\
+	output_error ("Insufficient Memory");				\
+	exit (ERR_MEM);							\
+      }									\
+    }									\
+    list[listed++] = (mount_pt);					\
+    list[listed] = NULL;						\
+  } while (0)
+
+#if PLATFORM_LINUX
+  if ( _system_mountinfo_load() > 0 ) {
+    for (i = 0; i < mounts_count; i++) {
+      if ( ! _system_hasquotaopt(mounts[i].opts) || _system_hasopt(mounts[i].opts, "ro") ) {
+	continue;
+      }
+      /* bind mounts of a filesystem already listed */
+      for (j = 0; j < i; j++) {
+	if ( mounts[j].dev == mounts[i].dev && _system_hasquotaopt(mounts[j].opts)
+	     && ! _system_hasopt(mounts[j].opts, "ro") ) {
+	  break;
+	}
+      }
+      if ( j < i ) {
+	continue;
+      }
+      output_debug ("%s has quotas enabled", mounts[i].mount_pt);
+      _SYSTEM_LIST_ADD (_system_strdup(mounts[i].mount_pt));
+    }
+    *count = listed;
+    return list;
+  }
+#endif /* PLATFORM_LINUX */
+
+#if HAVE_MNTENT_H
+  etc_mtab = setmntent (MOUNTFILE, "r");
+  if ( ! etc_mtab ) {
+    output_error ("Failed opening %s for reading: %s", MOUNTFILE,
+		  strerror(errno));
+    *count = 0;
+    return NULL;
+  }
+  while ( (current_fs = getmntent(etc_mtab)) ) {
+    if ( _system_hasquotaopt(current_fs->mnt_opts) && ! hasmntopt(current_fs, "ro") ) {
+      output_debug ("%s has quotas enabled", current_fs->mnt_dir);
+      _SYSTEM_LIST_ADD (_system_strdup(current_fs->mnt_dir));
+    }
+  }
+  endmntent (etc_mtab);
+#elif HAVE_FSTAB_H /* *BSD */
+  if (! setfsent()) {
+    output_error("Failed opening fstab: %s", strerror(errno));
+    *count = 0;
+    return NULL;
+  }
+  while ( (entry = getfsent()) ) {
+    // BSD: fs_type can be 'ro', 'rw', 'sw' (swap) or 'xx' (ignore) - we want 'rw'
+    if ( _system_hasquotaopt(entry->fs_mntops) && strstr(entry->fs_type, "rw") ) {
+      output_debug ("%s has quotas enabled", entry->fs_file);
+      _SYSTEM_LIST_ADD (_system_strdup(entry->fs_file));
+    }
+  }
+  endfsent();
+#endif
+#undef _SYSTEM_LIST_ADD
+
+  *count = listed;
+  return list;
+}
+
+
+
+/* passwd or group database, enumerated once and hashed both ways */
+struct _idmap_ent_t {
+  char *name;
+  unsigned int id;
+  int next_name, next_id;	/* hash chains, -1 ends them */
+};
+
+struct _idmap_t {
+  const char *db;		/* "passwd" or "group" */
+  const char *file;		/* its file, for files-only setups */
+  int loaded;			/* 0: not yet, 1: yes, -1: failed */
+  struct _idmap_ent_t *ents;
+  int count, allocated;
+  int *name_hash, *id_hash;
+  unsigned int size;
+};
+
+static struct _idmap_t users  = { "passwd", "/etc/passwd", 0, NULL, 0, 0, NULL, NULL, 0 };
+static struct _idmap_t groups = { "group",  "/etc/group",  0, NULL, 0, 0, NULL, NULL, 0 };
+static int idcache_enabled = 0;
+static int idcache_hits = 0, idcache_misses = 0;
+
+
+
+/*
+ * system_idcache_enable
+ * many ids are about to be looked up: from now on, read the
+ * passwd and group databases once instead of asking NSS per name
+ */
+void system_idcache_enable (void) {
+  idcache_enabled = 1;
+}
+
+
+
+/*
+ * system_idcache_stats
+ * lookups answered from the cache, and those that went to NSS
+ */
+void system_idcache_stats (int *hits, int *misses) {
+  *hits = idcache_hits;
+  *misses = idcache_misses;
+}
+
+
+
+static void _system_idmap_add (struct _idmap_t *map, const char *name, unsigned int id) {
+  if ( map->count == map->allocated ) {
+    map->allocated = map->allocated ? map->allocated * 2 : 256;
+    map->ents = (struct _idmap_ent_t *) realloc (map->ents,
+		   map->allocated * sizeof(struct _idmap_ent_t));
+    if ( ! map->ents ) {
+      output_error ("Insufficient Memory");
+      exit (ERR_MEM);
+    }
+  }
+  map->ents[map->count].name = _system_strdup (name);
+  map->ents[map->count].id = id;
+  map->count++;
+}
+
+
+
+/*
+ * _system_nss_files_only
+ * does nsswitch.conf list nothing but "files" for db?
+ * Then the file can be read directly, without going through NSS.
+ */
+static int _system_nss_files_only (const char *db) {
+  FILE *fp;
+  char line[1024];
+  char *cp, *word;
+  size_t len = strlen (db);
+  int files_only = 0;
+
+  if ( ! (fp = fopen("/etc/nsswitch.conf", "r")) ) {
+    return 0;
+  }
+  while ( fgets(line, sizeof(line), fp) ) {
+    if ( strncmp(line, db, len) || line[len] != ':' ) {
+      continue;
+    }
+    if ( (cp = strchr(line, '#')) ) *cp = '\0';
+    cp = line + len + 1;
+    files_only = 1;
+    while ( (word = strsep(&cp, " \t\r\n")) ) {
+      if ( *word && strcmp(word, "files") ) {
+	files_only = 0;
+      }
+    }
+    break;
+  }
+  fclose (fp);
+  return files_only;
+}
+
+
+
+/*
+ * _system_idmap_load
+ * read a whole database into map. The first entry for
+ * a name or id wins, like with getpwnam()/getpwuid().
+ */
+static int _system_idmap_load (struct _idmap_t *map) {
+  FILE *fp = NULL;
+  char line[4096];
+  char *cp, *name, *id;
+  struct passwd *pwent;
+  struct group *grent;
+  unsigned int h;
+  int i;
+
+  if ( map->loaded ) {
+    return map->loaded > 0;
+  }
+  map->loaded = -1;
+
+  if ( _system_nss_files_only(map->db) && (fp = fopen(map->file, "r")) ) {
+    /* name:password:id:... */
+    while ( fgets(line, sizeof(line), fp) ) {
+      cp = line;
+      name = strsep (&cp, ":");
+      if ( ! cp || ! *name || *name == '#' || *name == '+' || *name == '-' ) {
+	continue;
+      }
+      strsep (&cp, ":");
+      if ( ! cp || ! (id = strsep(&cp, ":\n")) || ! *id ) {
+	continue;
+      }
+      _system_idmap_add (map, name, (unsigned int) strtoul(id, NULL, 10));
+    }
+    fclose (fp);
+    output_debug ("Read %d entries from %s", map->count, map->file);
+  }
+  else if ( map == &users ) {
+    setpwent ();
+    while ( (pwent = getpwent()) ) {
+      _system_idmap_add (map, pwent->pw_name, pwent->pw_uid);
+    }
+    endpwent ();
+    output_debug ("Enumerated %d users", map->count);
+  }
+  else {
+    setgrent ();
+    while ( (grent = getgrent()) ) {
+      _system_idmap_add (map, grent->gr_name, grent->gr_gid);
+    }
+    endgrent ();
+    output_debug ("Enumerated %d groups", map->count);
+  }
+
+  /* power of two, at least twice the number of entries */
+  for (map->size = 64; map->size < 2u * map->count; map->size <<= 1);
+  map->name_hash = (int *) malloc (2 * map->size * sizeof(int));
+  if ( ! map->name_hash ) {
+    output_error ("Insufficient Memory");
+    exit (ERR_MEM);
+  }
+  map->id_hash = map->name_hash + map->size;
+  memset (map->name_hash, 0xff, 2 * map->size * sizeof(int));	/* all -1 */
+
+  for (i = map->count - 1; i >= 0; i--) {
+    h = _system_hash (map->ents[i].name, map->size);
+    map->ents[i].next_name = map->name_hash[h];
+    map->name_hash[h] = i;
+    h = map->ents[i].id & (map->size - 1);
+    map->ents[i].next_id = map->id_hash[h];
+    map->id_hash[h] = i;
+  }
+
+  map->loaded = 1;
+  return 1;
+}
+
+
+
+static struct _idmap_ent_t *_system_idmap_byname (struct _idmap_t *map, const char *name) {
+  int i;
+
+  for (i = map->name_hash[_system_hash(name, map->size)]; i >= 0; i = map->ents[i].next_name) {
+    if ( ! strcmp(map->ents[i].name, name) ) {
+      return &map->ents[i];
+    }
+  }
+  return NULL;
+}
+
+static struct _idmap_ent_t *_system_idmap_byid (struct _idmap_t *map, unsigned int id) {
+  int i;
+
+  for (i = map->id_hash[id & (map->size - 1)]; i >= 0; i = map->ents[i].next_id) {
+    if ( map->ents[i].id == id ) {
+      return &map->ents[i];
+    }
+  }
+  return NULL;
+}
+
+
+
+/*
+ * _system_idcache_getid
+ * name (or numerical id) to id from the cache.
+ * Returns 0 if the caller has to ask NSS.
+ */
+static int _system_idcache_getid (struct _idmap_t *map, char *name, unsigned int *id) {
+  struct _idmap_ent_t *ent;
+  char *temp_str;
+  unsigned long num;
+
+  if ( ! idcache_enabled ) {
+    return 0;
+  }
+  ent = NULL;
+  if ( _system_idmap_load(map) ) {
+    ent = _system_idmap_byname (map, name);
+    if ( ! ent ) {
+      num = strtoul (name, &temp_str, 10);
+      if ( temp_str != name && ! *temp_str ) {
+	ent = _system_idmap_byid (map, (unsigned int) num);
+      }
+    }
+  }
+  if ( ! ent ) {
+    idcache_misses++;
+    return 0;
+  }
+  idcache_hits++;
+  *id = ent->id;
+  return 1;
+}
+
+/*
+ * _system_idcache_getname
+ * id to name from the cache, else from NSS. NULL if there is none.
+ */
+static char *_system_idcache_getname (struct _idmap_t *map, unsigned int id) {
+  struct _idmap_ent_t *ent;
+  struct passwd *pwent;
+  struct group *grent;
+
+  if ( idcache_enabled && _system_idmap_load(map) && (ent = _system_idmap_byid(map, id)) ) {
+    idcache_hits++;
+    return ent->name;
+  }
+  if ( idcache_enabled ) {
+    idcache_misses++;
+  }
+  if ( map == &users ) {
+    pwent = getpwuid ((uid_t) id);
+    return pwent ? pwent->pw_name : NULL;
+  }
+  grent = getgrgid ((gid_t) id);
+  return grent ? grent->gr_name : NULL;
+}
+
+
+
 /*
  * system_getuser
  * get the uid of the given user (or uid)
@@ -212,7 +1218,13 @@ fs_t *system_getfs (char *fs_spec) {
 uid_t system_getuid (char *user) {
   struct passwd *pwent;
   int uid;
+  unsigned int cached;
   char *temp_str;
+
+  if ( _system_idcache_getid(&users, user, &cached) ) {
+    output_info ("user '%s' has uid %d", user, cached);
+    return (uid_t) cached;
+  }
   /* seach by name first */
    pwent = getpwnam (user);
 
@@ -235,8 +1247,14 @@ uid_t system_getuid (char *user) {
 gid_t system_getgid (char *group) {
   struct group  *grent;
   int gid;
+  unsigned int cached;
   char *temp_str;
 
+  if ( _system_idcache_getid(&groups, group, &cached) ) {
+    output_info ("group '%s' has gid %d", group, cached);
+    return (gid_t) cached;
+  }
+
   /* check for group name first */
   grent = getgrnam (group);
   if ( grent == NULL ) {
@@ -251,3 +1269,141 @@ gid_t system_getgid (char *group) {
   output_info ("group '%s' has gid %d", group, grent->gr_gid);
   return (grent->gr_gid);
 }
+
+
+
+/*
+ * system_getprjid
+ * project ids need no name: a number is taken as it is,
+ * else the name is looked up in /etc/projid ("name:id" lines)
+ */
+int system_getprjid (char *project) {
+  FILE *f;
+  char line[PATH_MAX];
+  char *cp, *temp_str;
+  long prjid;
+
+  prjid = strtol (project, &temp_str, 10);
+  if ( project != temp_str && ! *temp_str && prjid >= 0 ) {
+    return (int) prjid;
+  }
+
+  if ( (f = fopen(PROJID_FILE, "r")) ) {
+    while ( fgets(line, sizeof(line), f) ) {
+      if ( line[0] == '#' || ! (cp = strchr(line, ':')) ) {
+	continue;
+      }
+      *cp++ = '\0';
+      if ( ! strcmp(line, project) ) {
+	prjid = strtol (cp, &temp_str, 10);
+	if ( cp != temp_str && prjid >= 0 ) {
+	  fclose (f);
+	  output_info ("project '%s' has id %ld", project, prjid);
+	  return (int) prjid;
+	}
+      }
+    }
+    fclose (f);
+  }
+  output_error ("Project %s does not exist in %s", project, PROJID_FILE);
+  return -1;
+}
+
+
+
+static int _system_project_cmp (const void *a, const void *b) {
+  const system_project_t *x = a, *y = b;
+
+  if ( x->prjid != y->prjid ) {
+    return x->prjid < y->prjid ? -1 : 1;
+  }
+  return strcmp (x->path, y->path);
+}
+
+
+
+/*
+ * system_getprojects
+ * the directories in /etc/projects, sorted by project id.
+ * Directories that don't exist are left out. count is -1 if the
+ * file can't be read. Free the list with system_freeprojects()
+ */
+system_project_t *system_getprojects (int *count) {
+  system_project_t *list = NULL;
+  struct stat st;
+  FILE *f;
+  char line[PATH_MAX + 32];
+  char *cp, *path;
+  int allocated = 0, lineno = 0, prjid;
+
+  *count = 0;
+  if ( ! (f = fopen(PROJECTS_FILE, "r")) ) {
+    output_error ("Failed opening %s for reading: %s", PROJECTS_FILE, strerror(errno));
+    *count = -1;
+    return NULL;
+  }
+
+  while ( fgets(line, sizeof(line), f) ) {
+    lineno++;
+    line[strcspn(line, "\r\n")] = '\0';
+    if ( line[0] == '#' || ! line[0] ) {
+      continue;
+    }
+    if ( ! (cp = strchr(line, ':')) || ! cp[1] ) {
+      output_error ("%s line %d: expected id:path", PROJECTS_FILE, lineno);
+      continue;
+    }
+    *cp = '\0';
+    path = cp + 1;
+    if ( (prjid = system_getprjid(line)) < 0 ) {
+      continue;
+    }
+    if ( stat(path, &st) < 0 ) {
+      output_info ("%s line %d: %s: %s", PROJECTS_FILE, lineno, path, strerror(errno));
+      continue;
+    }
+
+    if ( *count == allocated ) {
+      allocated = allocated ? allocated * 2 : 64;
+      list = (system_project_t *) realloc (list, allocated * sizeof(system_project_t));
+      if ( ! list ) {
+	output_error ("Insufficient Memory");
+	exit (ERR_MEM);
+      }
+    }
+    list[*count].prjid = (unsigned int) prjid;
+    list[*count].dev = st.st_dev;
+    list[*count].path = _system_strdup (path);
+    (*count)++;
+  }
+  fclose (f);
+
+  if ( *count ) {
+    qsort (list, *count, sizeof(system_project_t), _system_project_cmp);
+  }
+  return list;
+}
+
+void system_freeprojects (system_project_t *projects, int count) {
+  int i;
+
+  for (i = 0; i < count; i++) {
+    free (projects[i].path);
+  }
+  free (projects);
+}
+
+
+
+/*
+ * system_getusername, system_getgroupname
+ * the name for an id, NULL if it has none.
+ * The result is only valid until the next call.
+ */
+char *system_getusername (uid_t uid) {
+  return _system_idcache_getname (&users, (unsigned int) uid);
+}
+
+char *system_getgroupname (gid_t gid) {
+  return _system_idcache_getname (&groups, (unsigned int) gid);
+}
@@ -22,18 +22,44 @@
 
 #include <sys/types.h>		/* for [gu]id_t */
 
+/* project names, "name:id" lines */
+#define PROJID_FILE   "/etc/projid"
+/* project directories, "id:path" lines */
+#define PROJECTS_FILE "/etc/projects"
+
 struct _fs_t {
   char device[PATH_MAX];
   char mount_pt[PATH_MAX];
 #if PLATFORM_LINUX
    char mnt_type[PATH_MAX]; /* xfs, reiserfs, ext2 etc */
+   int mnt_id;              /* mount id from mountinfo, -1 if not known */
+   dev_t dev;
+   char quota_opts[256];    /* its quota mount options, e.g. "usrjquota=aquota.user,jqfmt=vfsv1" */
 #endif /* PLATFORM_LINUX */
 };
 typedef struct _fs_t fs_t;
 
+/* a directory in PROJECTS_FILE */
+struct _system_project_t {
+  unsigned int prjid;
+  dev_t dev;			/* the filesystem it is on */
+  char *path;
+};
+typedef struct _system_project_t system_project_t;
+
 fs_t *  system_getfs    (char *fs_spec);
+int     system_mounts_changed (void);
+int     system_mount_current  (const fs_t *fs);
+char ** system_getquotafs (int *count);
 uid_t   system_getuid   (char *user);
 gid_t   system_getgid   (char *group);
+int     system_getprjid (char *project);
+system_project_t *system_getprojects (int *count);
+void    system_freeprojects (system_project_t *projects, int count);
+char *  system_getusername  (uid_t uid);
+char *  system_getgroupname (gid_t gid);
+void    system_idcache_enable (void);
+void    system_idcache_stats  (int *hits, int *misses);
 
 
 #endif /* INCLUDE_SYSTEM */
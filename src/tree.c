@@ -0,0 +1,517 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * tree.c
+ * put every inode of a directory tree into a project
+ *
+ * Project quotas count what is in a project, and which project an
+ * inode is in is an attribute of the inode (FS_IOC_FSSETXATTR). New
+ * inodes inherit it from a directory with FS_XFLAG_PROJINHERIT, but an
+ * existing tree has to be walked once.
+ *
+ * The walk is done by several workers, each with its own queue of
+ * directories still to read. A worker reads directories from the end
+ * of its own queue (depth first, few open directories), and when that
+ * is empty takes one from the front of another worker's queue, so one
+ * huge subtree is shared out instead of keeping a single worker busy.
+ * Everything is opened with openat() relative to the directory it is
+ * in; no path is ever put together.
+ */
+#include <config.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if HAVE_LINUX_FS_H
+#  include <linux/fs.h>
+#endif
+
+#include "quotatool.h"
+#include "output.h"
+#include "tree.h"
+
+#if PLATFORM_LINUX
+
+/* from <linux/fs.h>, not in older headers */
+#ifndef FS_IOC_FSSETXATTR
+struct fsxattr {
+  u_int32_t     fsx_xflags;
+  u_int32_t     fsx_extsize;
+  u_int32_t     fsx_nextents;
+  u_int32_t     fsx_projid;
+  u_int32_t     fsx_cowextsize;
+  unsigned char fsx_pad[8];
+};
+#  define FS_IOC_FSGETXATTR  _IOR('X', 31, struct fsxattr)
+#  define FS_IOC_FSSETXATTR  _IOW('X', 32, struct fsxattr)
+#endif
+#ifndef FS_XFLAG_PROJINHERIT
+#  define FS_XFLAG_PROJINHERIT 0x00000200
+#endif
+
+/* subdirectories queued at once, and errors shown before going quiet */
+#define TREE_BATCH        64
+#define TREE_ERRORS_SHOWN 10
+
+/* an open directory, kept until every subdirectory in it is opened */
+struct _tree_dir_t {
+  int fd;
+  int refs;			/* queued subdirectories, + 1 while being read */
+};
+
+/* a directory still to be read */
+struct _tree_item_t {
+  struct _tree_dir_t *parent;	/* NULL for the top of the tree */
+  char *name;
+};
+
+struct _tree_queue_t {
+  pthread_mutex_t lock;
+  struct _tree_item_t *items;	/* ring buffer */
+  int first, count, size;
+};
+
+struct _tree_pool_t;
+
+struct _tree_worker_t {
+  struct _tree_pool_t *pool;
+  int index;
+  struct _tree_queue_t queue;
+  unsigned long tagged, unchanged, skipped, failed;
+};
+
+struct _tree_pool_t {
+  struct _tree_worker_t workers[TREE_WORKERS_MAX];
+  int count;
+  pthread_mutex_t lock;		/* pending, pushes, reported, and all refs */
+  pthread_cond_t wake;
+  long pending;			/* directories queued or being read */
+  unsigned long pushes;		/* bumped whenever work is queued */
+  int reported;
+  dev_t dev;
+  unsigned int prjid;
+  int noaction;
+};
+
+
+
+/*
+ * tree_push, tree_pop, tree_steal
+ * the end of a queue is its owner's, the front is for the others
+ */
+static void tree_push (struct _tree_queue_t *q, struct _tree_item_t *items, int n) {
+  struct _tree_item_t *grown;
+  int i, size;
+
+  pthread_mutex_lock (&q->lock);
+  if ( q->count + n > q->size ) {
+    size = q->size ? q->size * 2 : 256;
+    while ( size < q->count + n ) size *= 2;
+    grown = (struct _tree_item_t *) malloc (size * sizeof(struct _tree_item_t));
+    if ( ! grown ) {
+      output_error ("Insufficient memory");
+      exit (ERR_MEM);
+    }
+    for (i = 0; i < q->count; i++) {
+      grown[i] = q->items[(q->first + i) % q->size];
+    }
+    free (q->items);
+    q->items = grown;
+    q->size = size;
+    q->first = 0;
+  }
+  for (i = 0; i < n; i++) {
+    q->items[(q->first + q->count++) % q->size] = items[i];
+  }
+  pthread_mutex_unlock (&q->lock);
+}
+
+static int tree_pop (struct _tree_queue_t *q, struct _tree_item_t *item) {
+  int found = 0;
+
+  pthread_mutex_lock (&q->lock);
+  if ( q->count ) {
+    *item = q->items[(q->first + --q->count) % q->size];
+    found = 1;
+  }
+  pthread_mutex_unlock (&q->lock);
+  return found;
+}
+
+static int tree_steal (struct _tree_worker_t *w, struct _tree_item_t *item) {
+  struct _tree_queue_t *q;
+  int i, found;
+
+  for (i = 1; i < w->pool->count; i++) {
+    q = &w->pool->workers[(w->index + i) % w->pool->count].queue;
+    found = 0;
+    pthread_mutex_lock (&q->lock);
+    if ( q->count ) {
+      *item = q->items[q->first];
+      q->first = (q->first + 1) % q->size;
+      q->count--;
+      found = 1;
+    }
+    pthread_mutex_unlock (&q->lock);
+    if ( found ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+
+/* drop one reference to dir, the last one closes it. Needs pool->lock */
+static void tree_unref (struct _tree_dir_t *dir) {
+  if ( dir && --dir->refs == 0 ) {
+    close (dir->fd);
+    free (dir);
+  }
+}
+
+/* done with a queued directory */
+static void tree_done (struct _tree_pool_t *pool, struct _tree_dir_t *dir) {
+  pthread_mutex_lock (&pool->lock);
+  tree_unref (dir);
+  if ( --pool->pending == 0 ) {
+    pthread_cond_broadcast (&pool->wake);
+  }
+  pthread_mutex_unlock (&pool->lock);
+}
+
+/* queue n subdirectories of dir on w */
+static void tree_queue (struct _tree_worker_t *w, struct _tree_dir_t *dir,
+			struct _tree_item_t *items, int n) {
+  struct _tree_pool_t *pool = w->pool;
+
+  /* counted before anyone can take them */
+  pthread_mutex_lock (&pool->lock);
+  dir->refs += n;
+  pool->pending += n;
+  pthread_mutex_unlock (&pool->lock);
+
+  tree_push (&w->queue, items, n);
+
+  pthread_mutex_lock (&pool->lock);
+  pool->pushes++;
+  pthread_cond_broadcast (&pool->wake);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+
+
+static void tree_fail (struct _tree_worker_t *w, const char *name, const char *what) {
+  int err = errno;
+
+  w->failed++;
+  pthread_mutex_lock (&w->pool->lock);
+  if ( w->pool->reported++ < TREE_ERRORS_SHOWN ) {
+    output_error ("Failed %s %s: %s", what, name, strerror(err));
+  }
+  else if ( w->pool->reported == TREE_ERRORS_SHOWN + 1 ) {
+    output_error ("More errors, not shown");
+  }
+  pthread_mutex_unlock (&w->pool->lock);
+  errno = err;
+}
+
+
+
+/*
+ * tree_set
+ * put the inode open on fd into the project, unless it is already
+ */
+static void tree_set (struct _tree_worker_t *w, int fd, const char *name, int is_dir) {
+  struct fsxattr fsx;
+
+  if ( ioctl(fd, FS_IOC_FSGETXATTR, &fsx) < 0 ) {
+    tree_fail (w, name, "reading project of");
+    return;
+  }
+  if ( fsx.fsx_projid == w->pool->prjid
+       && (! is_dir || (fsx.fsx_xflags & FS_XFLAG_PROJINHERIT)) ) {
+    w->unchanged++;
+    return;
+  }
+
+  fsx.fsx_projid = w->pool->prjid;
+  if ( is_dir ) {
+    fsx.fsx_xflags |= FS_XFLAG_PROJINHERIT;
+  }
+  if ( ! w->pool->noaction && ioctl(fd, FS_IOC_FSSETXATTR, &fsx) < 0 ) {
+    tree_fail (w, name, "setting project of");
+    return;
+  }
+  w->tagged++;
+}
+
+
+
+/*
+ * tree_read
+ * open a queued directory, tag it and its files,
+ * and queue its subdirectories
+ */
+static void tree_read (struct _tree_worker_t *w, struct _tree_item_t *item) {
+  struct _tree_pool_t *pool = w->pool;
+  struct _tree_item_t batch[TREE_BATCH];
+  struct _tree_dir_t *dir;
+  struct dirent *ent;
+  struct stat st;
+  DIR *d;
+  int fd, dfd, n, type;
+
+  fd = openat (item->parent ? item->parent->fd : AT_FDCWD, item->name,
+	       O_RDONLY | O_DIRECTORY | O_CLOEXEC | (item->parent ? O_NOFOLLOW : 0));
+  if ( fd < 0 ) {
+    tree_fail (w, item->name, "opening directory");
+  }
+  else if ( fstat(fd, &st) < 0 ) {
+    tree_fail (w, item->name, "reading");
+    close (fd);
+    fd = -1;
+  }
+  else if ( st.st_dev != pool->dev ) {
+    output_info ("%s is another filesystem, skipping", item->name);
+    w->skipped++;
+    close (fd);
+    fd = -1;
+  }
+  if ( fd < 0 ) {
+    free (item->name);
+    tree_done (pool, item->parent);
+    return;
+  }
+
+  /* the top was done by tree_tag() */
+  if ( item->parent ) {
+    tree_set (w, fd, item->name, 1);
+  }
+
+  dir = (struct _tree_dir_t *) malloc (sizeof(struct _tree_dir_t));
+  if ( ! dir ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  dir->fd = fd;
+  dir->refs = 1;
+
+  /* the parent is no longer needed for this one */
+  pthread_mutex_lock (&pool->lock);
+  tree_unref (item->parent);
+  pthread_mutex_unlock (&pool->lock);
+
+  /* fdopendir() takes over its fd, subdirectories need ours */
+  if ( (dfd = dup(fd)) < 0 || ! (d = fdopendir(dfd)) ) {
+    tree_fail (w, item->name, "reading directory");
+    if ( dfd >= 0 ) close (dfd);
+    free (item->name);
+    tree_done (pool, dir);
+    return;
+  }
+
+  n = 0;
+  while ( (ent = readdir(d)) ) {
+    if ( ent->d_name[0] == '.'
+	 && (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0')) ) {
+      continue;
+    }
+
+    type = ent->d_type;
+    if ( type == DT_UNKNOWN ) {
+      if ( fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 ) {
+	tree_fail (w, ent->d_name, "reading");
+	continue;
+      }
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+    }
+
+    if ( type == DT_DIR ) {
+      batch[n].parent = dir;
+      batch[n].name = strdup (ent->d_name);
+      if ( ! batch[n].name ) {
+	output_error ("Insufficient memory");
+	exit (ERR_MEM);
+      }
+      if ( ++n == TREE_BATCH ) {
+	tree_queue (w, dir, batch, n);
+	n = 0;
+      }
+    }
+    else if ( type == DT_REG ) {
+      dfd = openat (fd, ent->d_name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+      if ( dfd < 0 ) {
+	tree_fail (w, ent->d_name, "opening");
+	continue;
+      }
+      tree_set (w, dfd, ent->d_name, 0);
+      close (dfd);
+    }
+    else {
+      /* symlinks and device nodes can't be opened to be tagged */
+      w->skipped++;
+    }
+  }
+  if ( n ) {
+    tree_queue (w, dir, batch, n);
+  }
+
+  closedir (d);
+  free (item->name);
+  tree_done (pool, dir);
+}
+
+
+
+static void *tree_worker (void *arg) {
+  struct _tree_worker_t *w = (struct _tree_worker_t *) arg;
+  struct _tree_pool_t *pool = w->pool;
+  struct _tree_item_t item;
+  unsigned long seen;
+  int finished;
+
+  while ( 1 ) {
+    pthread_mutex_lock (&pool->lock);
+    seen = pool->pushes;
+    pthread_mutex_unlock (&pool->lock);
+
+    if ( tree_pop(&w->queue, &item) || tree_steal(w, &item) ) {
+      tree_read (w, &item);
+      continue;
+    }
+
+    /* nothing to take: wait for more, or for the last one to finish */
+    pthread_mutex_lock (&pool->lock);
+    while ( pool->pending && pool->pushes == seen ) {
+      pthread_cond_wait (&pool->wake, &pool->lock);
+    }
+    finished = ! pool->pending;
+    pthread_mutex_unlock (&pool->lock);
+    if ( finished ) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+
+
+int tree_tag (char *top, unsigned int prjid, int noaction) {
+  struct _tree_pool_t *pool;
+  struct _tree_item_t item;
+  pthread_t threads[TREE_WORKERS_MAX];
+  unsigned long tagged, unchanged, skipped, failed;
+  struct stat st;
+  int started, fd, i;
+
+  if ( stat(top, &st) < 0 ) {
+    output_error ("Cannot stat %s: %s", top, strerror(errno));
+    return ERR_ARG;
+  }
+  if ( ! S_ISDIR(st.st_mode) ) {
+    output_error ("%s is not a directory", top);
+    return ERR_ARG;
+  }
+
+  pool = (struct _tree_pool_t *) calloc (1, sizeof(struct _tree_pool_t));
+  if ( ! pool ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  pool->count = TREE_WORKERS_MAX;
+  pool->dev = st.st_dev;
+  pool->prjid = prjid;
+  pool->noaction = noaction;
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->wake, NULL);
+  for (i = 0; i < pool->count; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+    pthread_mutex_init (&pool->workers[i].queue.lock, NULL);
+  }
+
+  /* the top first: a filesystem without project ids fails here, once */
+  if ( (fd = open(top, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 ) {
+    output_error ("Failed opening directory %s: %s", top, strerror(errno));
+    free (pool);
+    return ERR_SYS;
+  }
+  tree_set (&pool->workers[0], fd, top, 1);
+  if ( pool->workers[0].failed ) {
+    if ( errno == EOPNOTSUPP || errno == ENOTTY ) {
+      output_error ("%s: filesystem has no project ids (ext4 needs the project feature)", top);
+    }
+    close (fd);
+    free (pool);
+    return ERR_SYS;
+  }
+  close (fd);
+
+  item.parent = NULL;
+  item.name = strdup (top);
+  if ( ! item.name ) {
+    output_error ("Insufficient memory");
+    exit (ERR_MEM);
+  }
+  pool->pending = 1;
+  tree_push (&pool->workers[0].queue, &item, 1);
+
+  output_info ("putting %s into project %u, %d workers", top, prjid, pool->count);
+  for (started = 0; started < pool->count; started++) {
+    if ( pthread_create(&threads[started], NULL, tree_worker, &pool->workers[started]) ) {
+      output_error ("Failed starting worker thread: %s", strerror(errno));
+      break;
+    }
+  }
+  /* no threads at all, do the work here */
+  if ( ! started ) {
+    tree_worker (&pool->workers[0]);
+  }
+  for (i = 0; i < started; i++) {
+    pthread_join (threads[i], NULL);
+  }
+
+  tagged = unchanged = skipped = failed = 0;
+  for (i = 0; i < pool->count; i++) {
+    tagged    += pool->workers[i].tagged;
+    unchanged += pool->workers[i].unchanged;
+    skipped   += pool->workers[i].skipped;
+    failed    += pool->workers[i].failed;
+    free (pool->workers[i].queue.items);
+    pthread_mutex_destroy (&pool->workers[i].queue.lock);
+  }
+  pthread_cond_destroy (&pool->wake);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool);
+
+  output_notice ("%s: %lu inodes %s project %u, %lu already were, %lu skipped, %lu failed",
+		 top, tagged, noaction ? "would be put into" : "put into", prjid,
+		 unchanged, skipped, failed);
+  return failed ? ERR_SYS : 0;
+}
+
+#else /* *BSD */
+
+int tree_tag (char *top, unsigned int prjid, int noaction) {
+  (void) top;
+  (void) prjid;
+  (void) noaction;
+  output_error ("Project quotas are not supported on this platform");
+  return ERR_ARG;
+}
+
+#endif /* PLATFORM_LINUX */
@@ -0,0 +1,25 @@
+/*
+ * Mike Glover
+ * mpg4@duluoz.net
+ *
+ * Johan Ekenberg
+ * johan@ekenberg.se
+ *
+ * tree.h
+ * put every inode of a directory tree into a project
+ */
+#ifndef INCLUDE_QUOTATOOL_TREE
+#define INCLUDE_QUOTATOOL_TREE 1
+
+#include <config.h>
+
+/* directories read at the same time */
+#define TREE_WORKERS_MAX  8
+
+/* set project id prjid, and for directories the inherit flag, on top
+ * and everything below it on the same filesystem. With noaction only
+ * count what would change.
+ * Returns 0 on success or one of the ERR_* codes in quotatool.h */
+int   tree_tag   (char *top, unsigned int prjid, int noaction);
+
+#endif /* INCLUDE_QUOTATOOL_TREE */
@@ -0,0 +1,73 @@
+#!/bin/bash
+# guest-run-bench.sh — benchmark tier: times quotatool on many ids
+#
+# Runs INSIDE the VM. Called by run-tests --bench via boot_kernel.
+# Creates ext4 (vfsv0), ext4 (vfsv1) and XFS filesystems and times the
+# set, get, dump and grace-reset paths for each id count, printing one
+# "BENCH {json}" line per result for run-tests to collect.
+#
+# Usage: guest-run-bench.sh [--fake] [IDS]
+#   IDS     comma-separated id counts (default: 1000,10000,100000)
+#   --fake  no VM, no root: the same filesystems on the fake quota
+#           backend (QUOTATOOL_FAKE), for the call counts and quotatool's
+#           own overhead. QUOTATOOL_FAKE_LATENCY stands in for the kernel.
+
+set -uo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+
+source "$SCRIPT_DIR/lib/bench.sh"
+
+FAKE=0
+if [[ "${1:-}" == "--fake" ]]; then
+    FAKE=1
+    shift
+fi
+IDS="${1:-1000,10000,100000}"
+FSTYPES="ext4-vfsv0 ext4-vfsv1 xfs"
+FAIL=0
+
+_bench_fs() {
+    local label="$1" mnt="$2" n
+    for n in ${IDS//,/ }; do
+        echo "--- $label: $n ids ---" >&2
+        bench_run "$label" "$mnt" "$n" || FAIL=$((FAIL + 1))
+    done
+}
+
+if [[ $FAKE -eq 1 ]]; then
+    export QUOTATOOL_FAKE
+    QUOTATOOL_FAKE=$(mktemp)
+    trap 'rm -f "$QUOTATOOL_FAKE"' EXIT
+    echo "BENCH-KERNEL fake"
+    for label in $FSTYPES; do
+        fmt="${label#*-}"
+        echo "mount /bench/$label ${label%%-*} $fmt" >> "$QUOTATOOL_FAKE"
+    done
+    for label in $FSTYPES; do
+        _bench_fs "$label" "/bench/$label"
+    done
+else
+    source "$SCRIPT_DIR/lib/fs-setup.sh"
+    # fs-setup.sh enables set -e, see guest-run-all.sh
+    set +e
+
+    modprobe loop 2>/dev/null || true
+    modprobe quota_v2 2>/dev/null || true
+    modprobe quota_tree 2>/dev/null || true
+
+    echo "BENCH-KERNEL $(uname -r)"
+    for label in $FSTYPES; do
+        mnt="/tmp/bench-$label"
+        case "$label" in
+            xfs)  fs_create_xfs "$mnt" 512M ;;
+            *)    fs_create_ext4 "$mnt" 512M "${label#*-}" ;;
+        esac || { echo "BENCH-SKIP $label: filesystem setup failed" >&2; FAIL=$((FAIL + 1)); continue; }
+        _bench_fs "$label" "$mnt"
+        fs_teardown "$mnt"
+    done
+fi
+
+echo ""
+echo "Benchmark: $FAIL failed"
+[[ $FAIL -eq 0 ]]
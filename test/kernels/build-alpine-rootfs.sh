@@ -333,6 +333,7 @@ log "Installed static quotatool"
 # Step 8: Install test scripts
 mkdir -p "$STAGING/test"
 cp -a "$TEST_DIR/guest-run-all.sh" "$STAGING/test/"
+cp -a "$TEST_DIR/guest-run-bench.sh" "$STAGING/test/"
 cp -a "$TEST_DIR/guest-interactive.sh" "$STAGING/test/"
 cp -a "$TEST_DIR/lib" "$STAGING/test/"
 cp -a "$TEST_DIR/tests" "$STAGING/test/"
@@ -0,0 +1,150 @@
+#!/bin/bash
+# bench.sh — time quotatool's set, get, dump and grace-reset paths
+#
+# Public API:
+#   bench_run LABEL MNT N         — run the four operations on N ids,
+#                                   print one "BENCH {json}" line each
+#   bench_collect LOG NAME OUT    — gather a run's BENCH lines into OUT
+#   bench_compare RESULT BASELINE PCT
+#                                 — fail on more quotactl()s or syncs than
+#                                   the baseline, or PCT% more time
+#
+# Times and call counts come from quotatool --stats, so nothing here
+# depends on the guest's date(1) or bash version. Each result is one
+# line of the JSON file, so awk can compare files without a JSON parser:
+#   {"fs":"ext4-vfsv1","ids":1000,"op":"set","ms":12.345,"quotactl":1003,"syncs":1}
+#
+# Call counts don't vary between runs: a change that adds a quotactl()
+# per id or a sync fails the comparison at any threshold. Times do, so
+# each operation runs BENCH_REPEAT times and keeps the fastest, and
+# differences below BENCH_NOISE_MS never count.
+
+BENCH_ID_BASE="${BENCH_ID_BASE:-200000}"
+BENCH_REPEAT="${BENCH_REPEAT:-3}"
+BENCH_NOISE_MS="${BENCH_NOISE_MS:-10}"
+
+_bench_quotatool() {
+    local dir
+    dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+    if [[ -x "$dir/quotatool" ]]; then
+        echo "$dir/quotatool"
+    else
+        echo "/usr/bin/quotatool"
+    fi
+}
+
+# quotatool --stats --output ndjson ARGS..., reduced to "ms quotactl syncs"
+_bench_stats() {
+    "$BENCH_QUOTATOOL" --stats --output ndjson "$@" 2>/dev/null | awk '
+        function field(name,   v) {
+            if (!match($0, "\"" name "\":[^,}]*")) return ""
+            v = substr($0, RSTART + length(name) + 3, RLENGTH - length(name) - 3)
+            gsub(/"/, "", v)
+            return v
+        }
+        field("stat") == "quotactl" {
+            calls += field("calls")
+            if (field("name") ~ /SYNC$/) syncs += field("calls")
+        }
+        field("stat") == "total" { us = field("total_us") }
+        END { if (us == "") exit 1; printf "%.3f %d %d\n", us / 1000, calls, syncs }'
+    # quotatool's own exit code, not awk's
+    return "${PIPESTATUS[0]}"
+}
+
+# one batch line per id: the line with %d for the id
+_bench_batch() {
+    local n="$1" line="$2" file="$3"
+    awk -v n="$n" -v base="$BENCH_ID_BASE" -v line="$line" \
+        'BEGIN { for (i = 0; i < n; i++) printf line "\n", base + i }' > "$file"
+}
+
+_bench_result() {
+    local label="$1" n="$2" op="$3"
+    shift 3
+    local stats best="" i
+    for ((i = 0; i < BENCH_REPEAT; i++)); do
+        if ! stats=$(_bench_stats "$@"); then
+            echo "BENCH-SKIP $label $n $op: quotatool failed" >&2
+            return 1
+        fi
+        best=$(echo "$stats $best" | awk 'NF < 6 || $1 < $4 { print $1, $2, $3; next } { print $4, $5, $6 }')
+    done
+    set -- $best
+    printf 'BENCH {"fs":"%s","ids":%d,"op":"%s","ms":%s,"quotactl":%d,"syncs":%d}\n' \
+        "$label" "$n" "$op" "$1" "$2" "$3"
+}
+
+bench_run() {
+    local label="$1" mnt="$2" n="$3"
+    local batch rc=0
+    BENCH_QUOTATOOL="${BENCH_QUOTATOOL:-$(_bench_quotatool)}"
+    batch=$(mktemp)
+
+    _bench_batch "$n" "-u :%d -b -q 10M -l 20M $mnt" "$batch"
+    _bench_result "$label" "$n" set --batch "$batch" || rc=1
+
+    # the fake backend forgets between processes: seed the ids instead
+    if [[ -n "${QUOTATOOL_FAKE:-}" ]]; then
+        cp "$QUOTATOOL_FAKE" "$batch.seed"
+        _bench_batch "$n" "user %d $mnt 0 10240 20480 0 0 0 0 0" "$batch"
+        cat "$batch" >> "$QUOTATOOL_FAKE"
+    fi
+
+    _bench_batch "$n" "-d -u :%d $mnt" "$batch"
+    _bench_result "$label" "$n" get --batch "$batch" || rc=1
+
+    _bench_result "$label" "$n" dump -u -D "$mnt" || rc=1
+
+    _bench_batch "$n" "-u :%d -b -r $mnt" "$batch"
+    _bench_result "$label" "$n" grace-reset --batch "$batch" || rc=1
+
+    [[ -f "$batch.seed" ]] && mv "$batch.seed" "$QUOTATOOL_FAKE"
+    rm -f "$batch"
+    return $rc
+}
+
+bench_collect() {
+    local log="$1" name="$2" out="$3"
+    local release
+    release=$(sed -n 's/^BENCH-KERNEL //p' "$log" | tail -1)
+    {
+        printf '{\n"kernel": "%s",\n"release": "%s",\n"results": [\n' "$name" "$release"
+        sed -n 's/^BENCH //p' "$log" | sed '$!s/$/,/'
+        printf ']\n}\n'
+    } > "$out"
+    grep -q '^{"fs"' "$out"
+}
+
+bench_compare() {
+    local result="$1" baseline="$2" pct="$3"
+    awk -v pct="$pct" -v noise="$BENCH_NOISE_MS" '
+        function field(name,   v) {
+            if (!match($0, "\"" name "\":[^,}]*")) return ""
+            v = substr($0, RSTART + length(name) + 3, RLENGTH - length(name) - 3)
+            gsub(/"/, "", v)
+            return v
+        }
+        !/^\{"fs"/ { next }
+        {
+            key = field("fs") " " field("ids") " " field("op")
+        }
+        FNR == NR {
+            ms[key] = field("ms"); calls[key] = field("quotactl"); syncs[key] = field("syncs")
+            next
+        }
+        !(key in ms) { printf "  new    %-28s %10.3f ms (no baseline)\n", key, field("ms"); next }
+        {
+            bad = ""; t = field("ms") + 0; base = ms[key] + 0
+            if (field("quotactl") + 0 > calls[key] + 0)
+                bad = bad sprintf(" quotactl %d -> %d", calls[key], field("quotactl"))
+            if (field("syncs") + 0 > syncs[key] + 0)
+                bad = bad sprintf(" syncs %d -> %d", syncs[key], field("syncs"))
+            if (pct > 0 && t > base * (1 + pct / 100) && t - base > noise)
+                bad = bad sprintf(" time +%.0f%%", base > 0 ? (t / base - 1) * 100 : 100)
+            printf "  %-6s %-28s %10.3f ms (baseline %.3f)%s\n", bad == "" ? "ok" : "FAIL:", \
+                key, t, base, bad
+            if (bad != "") failed++
+        }
+        END { exit failed > 0 }' "$baseline" "$result"
+}
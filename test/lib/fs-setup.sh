@@ -4,13 +4,14 @@
 # Runs inside the VM.
 #
 # Public API:
-#   fs_create_ext4 PATH SIZE   — create ext4 loopback with quotas at PATH
+#   fs_create_ext4 PATH SIZE [FMT] — create ext4 loopback with quotas at PATH
 #   fs_create_xfs  PATH SIZE   — create XFS loopback with quotas at PATH
 #   fs_teardown    PATH        — tear down a previously created filesystem
 #   fs_teardown_all            — tear down all tracked filesystems
 #
 # PATH = mount point (e.g. /mnt/test-ext4)
 # SIZE = image size understood by truncate (e.g. 100M, 1G)
+# FMT  = quota file format (vfsv0, vfsv1), default: the kernel's choice
 #
 # The library tracks all created filesystems and registers an EXIT trap
 # to clean up on unexpected exit. Sourcing this file is safe — nothing
@@ -107,6 +108,8 @@ _fs_is_mounted() {
 # Args:
 #   $1  Mount point path (will be created if missing)
 #   $2  Image size (truncate format: 100M, 1G, etc.)
+#   $3  Optional quota format for quotacheck/quotaon -F (vfsv0, vfsv1).
+#       Forces the legacy path: -O quota always means vfsv1.
 #
 # Flow:
 #   1. Create sparse image file
@@ -122,10 +125,11 @@ _fs_is_mounted() {
 fs_create_ext4() {
     local mnt="$1"
     local size="$2"
+    local fmt="${3:-}"
     local img="${mnt}.img"
     local loop=""
 
-    _fs_log "creating ext4 filesystem: mount=$mnt size=$size"
+    _fs_log "creating ext4 filesystem: mount=$mnt size=$size${fmt:+ format=$fmt}"
 
     # Partial-state tracking for cleanup on failure
     local _cleanup_img="" _cleanup_loop="" _cleanup_mnt=""
@@ -180,6 +184,10 @@ fs_create_ext4() {
         force_legacy=1
         _fs_log "  kernel $kver_major.$kver_minor < 4.5: forcing legacy quota path"
     fi
+    if [[ -n "$fmt" ]]; then
+        force_legacy=1
+        _fs_log "  quota format $fmt: forcing legacy quota path"
+    fi
 
     if [[ "$force_legacy" -eq 0 ]] && mkfs.ext4 -q -O quota "$loop" >/dev/null 2>&1; then
         mkfs_ok=1
@@ -232,12 +240,12 @@ fs_create_ext4() {
         _fs_log "  quotas enabled via -O quota (built-in)"
     else
         # Legacy path: quotacheck to create accounting files, then quotaon
-        if ! quotacheck -ugm "$mnt" 2>/dev/null; then
+        if ! quotacheck ${fmt:+-F "$fmt"} -ugm "$mnt" 2>/dev/null; then
             _fs_err "quotacheck failed on $mnt"
             _fs_ext4_cleanup_on_error
             return 1
         fi
-        if ! quotaon "$mnt" 2>/dev/null; then
+        if ! quotaon ${fmt:+-F "$fmt"} "$mnt" 2>/dev/null; then
             _fs_err "quotaon failed on $mnt"
             _fs_ext4_cleanup_on_error
             return 1
@@ -66,9 +66,9 @@ _check "-r without -b/-i" \
     1 "Must specify either block (-b) or inode (-i) before -r" \
     -u :99999 -r /
 
-_check "both -u and -g" \
-    1 "Only one quota (user or group) can be set" \
-    -u :1 -g :1 -b -l 100 /
+_check "-u twice" \
+    1 "Only one user quota can be set" \
+    -u :1 -g :1 -u :2 -b -l 100 /
 
 _check "no filesystem argument" \
     1 "No filesystem specified" \
@@ -90,11 +90,160 @@ _check "unknown option -Z" \
     1 "Unrecognized option" \
     -u :99999 -b -Z /
 
+_check "-D with an id" \
+    1 "Wrong options for -D" \
+    -u :99999 -D /
+
+_check "-D with limits" \
+    1 "Wrong options for -D" \
+    -u -D -b -l 100 /
+
+_check "--batch without file" \
+    1 "Option '--batch' requires an argument" \
+    --batch
+
+_check "--batch mixed with -u" \
+    1 "Wrong options for --batch" \
+    -u :99999 --batch -
+
+_check "-a with a filesystem" \
+    1 "Wrong options for -a" \
+    -u :99999 -b -l 100 -a /
+
+_check "-a in --batch" \
+    1 "Wrong options for --batch" \
+    -a --batch -
+
+_check "--serve mixed with -u" \
+    1 "Wrong options for --serve" \
+    -u :99999 --serve /tmp/quotatool-test.sock
+
+_check "--serve with --batch" \
+    1 "Wrong options for --batch" \
+    --serve /tmp/quotatool-test.sock --batch -
+
+_check "--serve-group without --serve" \
+    1 "--serve-group needs --serve" \
+    --serve-group root
+
+_check "--reconcile with an id" \
+    1 "Wrong options for --reconcile" \
+    -u root --reconcile /dev/null /
+
+_check "--reconcile with limits" \
+    1 "Wrong options for --reconcile" \
+    -u -b -l 1M --reconcile /dev/null /
+
+_check "--reconcile with --batch" \
+    1 "Wrong options for --batch" \
+    --batch - --reconcile /dev/null
+
+_check "-D with both -u and -p" \
+    1 "Wrong options for several quota types" \
+    -u -p -D /
+
+_check "--tag-tree with -u" \
+    1 "Wrong options for --tag-tree" \
+    -u :1 --tag-tree /tmp
+
+_check "--tag-tree with limits" \
+    1 "Wrong options for --tag-tree" \
+    -p :1 -b -l 100 --tag-tree /tmp
+
+_check "--du with a project id" \
+    1 "Wrong options for --du" \
+    -p :1 --du /
+
+_check "--du with -u" \
+    1 "Wrong options for --du" \
+    -u --du /
+
+_check "--metrics with an id" \
+    1 "Wrong options for --metrics" \
+    -u :1 --metrics /tmp/quota.prom /
+
+_check "--metrics-port out of range" \
+    1 "Bad port '70000' for --metrics-port" \
+    --metrics-port 70000 /
+
+_check "--output with an unknown format" \
+    1 "Unknown output format 'xml'" \
+    --output xml -u -D /
+
+# a record can't change how the whole run syncs
+_check "--no-sync in a --batch record" \
+    1 "Option '--no-sync' is only for the command line" \
+    --batch <(echo "--no-sync -d -u :99999 /")
+
+_check "--stats in a --batch record" \
+    1 "Option '--stats' is only for the command line" \
+    --batch <(echo "--stats -d -u :99999 /")
+
+_check "--format in a --batch record" \
+    1 "Option '--format' is only for the command line" \
+    --batch <(echo "--format vfsv0 -d -u :99999 /")
+
 # ERR_ARG (exit 2) — valid syntax but bad values
 _check "nonexistent user" \
     2 "does not exist" \
     -u nonexistent_user_xyzzy_42 -b -l 100 /
 
+_check "nonexistent project" \
+    2 "does not exist in /etc/projid" \
+    -p nonexistent_project_xyzzy_42 -b -l 100 /
+
+_check "--tag-tree on a missing directory" \
+    2 "Cannot stat" \
+    -p :1 --tag-tree /nonexistent/tree
+
+_check "id range ending before it starts" \
+    2 "Bad uid range ':5000-4999'" \
+    -u :1,:5000-4999 -d /
+
+_check "empty id in a list" \
+    2 "Empty gid in ':1,,:2'" \
+    -g :1,,:2 -d /
+
+_check "--tag-tree with a project range" \
+    2 "--tag-tree takes a single project" \
+    -p :1-10 --tag-tree /
+
+_check "--top with an id" \
+    1 "Wrong options for --top" \
+    -u :1 --top 10 /
+
+_check "--by without --top" \
+    1 "--by needs --top" \
+    -u --by inodes -D /
+
+_check "--probe-timeout without -a" \
+    1 "--probe-timeout needs -a" \
+    -u -D --probe-timeout 3 /
+
+_check "--batch with missing file" \
+    2 "Failed opening" \
+    --batch /nonexistent/batch-file
+
+_check "--reconcile with missing file" \
+    2 "Failed opening" \
+    -u --reconcile /nonexistent/desired-file /
+
+_check "--reconcile with a bad limit" \
+    2 "line 2: bad block hard limit" \
+    -u --reconcile <(printf '# comment\n:5 1M x 0 0\n') /
+
+_check "--reconcile with an id given twice" \
+    2 "uid 5 already given on line 1" \
+    -u --reconcile <(printf ':5 1M 2M 0 0\n:5 - - 1 1\n') /
+
+_check "--stats summary after a failed lookup" \
+    2 "quotatool: total " \
+    --stats -u nonexistent_user_xyzzy_42 -b -l 100 /
+
+_check "--serve-group with missing group" \
+    2 "does not exist" \
+    --serve /tmp/quotatool-test.sock --serve-group nonexistent_group_xyzzy_42
+
 echo ""
 echo "Results: $PASS passed, $FAIL failed"
 [[ $FAIL -eq 0 ]]
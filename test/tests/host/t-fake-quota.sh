@@ -0,0 +1,211 @@
+#!/bin/bash
+# t-fake-quota.sh — quota calls against the fake backend (no root, no VM)
+#
+# QUOTATOOL_FAKE points quotatool at an in-memory quotactl() seeded from
+# a file, one mount per kernel interface (generic, vfsv0, old, xfs).
+# Checks that limits, grace times and -D come out the same on each.
+# Skips unless quotatool was configured with --enable-fake-quota.
+#
+# Usage: t-fake-quota.sh [path-to-quotatool]
+
+set -uo pipefail
+
+QUOTATOOL="${1:-$(cd "$(dirname "$0")/../../.." && pwd)/quotatool}"
+[[ -x "$QUOTATOOL" ]] || { echo "FATAL: quotatool not found at $QUOTATOOL" >&2; exit 99; }
+
+PASS=0
+FAIL=0
+
+_check() {
+    local desc="$1" expected="$2" got="$3"
+    if [[ "$got" == "$expected" ]]; then
+        echo "  ok - $desc"
+        PASS=$((PASS + 1))
+    else
+        echo "  FAIL - $desc: got '$got', expected '$expected'"
+        FAIL=$((FAIL + 1))
+    fi
+}
+
+echo "--- t-fake-quota (no root, no VM) ---"
+
+SEED=$(mktemp)
+CACHE=$(mktemp -d)
+trap 'rm -f "$SEED"; rm -rf "$CACHE"' EXIT
+
+cat > "$SEED" <<'SEED_EOF'
+# one mount per kernel interface
+mount /fake/vfsv1 ext4 vfsv1 rw,usrquota,grpquota
+mount /fake/vfsv0 ext3 v0
+mount /fake/old   ext2 old
+mount /fake/xfs   xfs  xfs rw,uquota,pquota /dev/fakexfs
+grace user /fake/vfsv1 3600 7200
+# type id filesystem blocks quota limit grace files quota limit grace
+user 1000 /fake/vfsv1 500 1000 2000 0 10 100 200 0
+user,1001,/fake/vfsv1,1500,1000,2000,0,10,100,200,0
+user 1000 /fake/vfsv0 500 1000 2000 0 10 100 200 0
+user 1000 /fake/old   500 1000 2000 0 10 100 200 0
+user 1002 /fake/old   3 0 0 0 1 0 0 0
+user 1000 /fake/xfs   500 1000 2000 0 10 100 200 0
+project 42 /dev/fakexfs 3000 0 10000 0 5 0 0 0
+SEED_EOF
+export QUOTATOOL_FAKE="$SEED"
+
+if ! "$QUOTATOOL" -d -u :1000 /fake/vfsv1 >/dev/null 2>&1; then
+    echo "  skip - quotatool built without --enable-fake-quota"
+    exit 0
+fi
+
+for fs in /fake/vfsv1 /fake/vfsv0 /fake/old /fake/xfs; do
+    _check "$fs: seeded quota" \
+        "1000 $fs 500 1000 2000 0 10 100 200 0" \
+        "$("$QUOTATOOL" -d -u :1000 "$fs" 2>&1)"
+
+    # each run starts from the seed, so set and read back in one batch;
+    # going over the soft limit starts the timer with the grace then
+    got=$(printf '%s\n' \
+        "-u -b -t 2days $fs" \
+        "-u :1000 -b -q 100 -l 5M $fs" \
+        "-u :1000 -i -q 50 $fs" \
+        "-d -u :1000 $fs" \
+        "-u :2000 -b -l 20M $fs" \
+        "-d -u :2000 $fs" | "$QUOTATOOL" --batch - 2>/dev/null)
+    _check "$fs: set limits and grace" \
+        "1000 $fs 500 100 5120 172800 10 50 200 0
+2000 $fs 0 0 20480 0 0 0 0 0" \
+        "$got"
+done
+
+# the old interface counts usage in 1K blocks (dqb_curblocks), quota_t
+# in bytes: 3K used must read back as 3, and stay 3 after a set
+got=$(printf '%s\n' \
+    "-d -u :1002 /fake/old" \
+    "-u :1002 -b -l 10M /fake/old" \
+    "-d -u :1002 /fake/old" | "$QUOTATOOL" --batch - 2>/dev/null)
+_check "old interface: usage in 1K blocks" \
+    "1002 /fake/old 3 0 0 0 1 0 0 0
+1002 /fake/old 3 0 10240 0 1 0 0 0" \
+    "$got"
+
+_check "-D lists ids with Q_GETNEXTQUOTA" \
+    "1000 /fake/vfsv1 500 1000 2000 0 10 100 200 0
+1001 /fake/vfsv1 1500 1000 2000 3600 10 100 200 0" \
+    "$("$QUOTATOOL" -u -D /fake/vfsv1 2>&1)"
+
+_check "-D on a project quota, by device" \
+    "42 /dev/fakexfs 3000 0 10000 0 5 0 0 0" \
+    "$("$QUOTATOOL" -p -D /dev/fakexfs 2>&1)"
+
+_check "a list of ids" \
+    "1001 /fake/vfsv1 1500 1000 2000 3600 10 100 200 0
+42 /fake/vfsv1 0 0 0 0 0 0 0 0
+1000 /fake/vfsv1 500 1000 2000 0 10 100 200 0" \
+    "$("$QUOTATOOL" -d -u :1001,:42,:1000 /fake/vfsv1 2>&1)"
+
+# only ids with a quota record, found with Q_GETNEXTQUOTA
+got=$(printf '%s\n' \
+    "-u :900-1000000 -b -l +1M /fake/vfsv1" \
+    "-d -u :1-1000 /fake/vfsv1" | "$QUOTATOOL" --batch - 2>/dev/null)
+_check "a range of ids" \
+    "1000 /fake/vfsv1 500 1000 3024 0 10 100 200 0" \
+    "$got"
+
+# limits after -u are the user's, after -g the group's
+got=$(printf '%s\n' \
+    "-u :1000 -b -l 3M -g :1000 -i -l 50 /fake/vfsv1" \
+    "-d -u :1000 -g :1000 /fake/vfsv1" | "$QUOTATOOL" --batch - 2>/dev/null)
+_check "user and group limits in one run" \
+    "1000 /fake/vfsv1 500 1000 3072 0 10 100 200 0
+1000 /fake/vfsv1 0 0 0 0 0 0 50 0" \
+    "$got"
+
+_check "--top 1 by percent" \
+    "1001 /fake/vfsv1 1500 1000 2000 3600 10 100 200 0" \
+    "$("$QUOTATOOL" -u --top 1 --by percent /fake/vfsv1 2>&1)"
+
+_check "--over" \
+    "1001 /fake/vfsv1 1500 1000 2000 3600 10 100 200 0" \
+    "$("$QUOTATOOL" -u --over /fake/vfsv1 2>&1)"
+
+# size is 0, /fake/... can't be statvfs()ed; 1000 is 25% of its
+# hard limit, 1001 75%, and the quantiles are within 12.5%
+_check "--summary of two filesystems and the total" \
+    "/fake/vfsv1 0 2 0 2000 4000 0 20 400 26 75 75 75
+/fake/xfs 0 1 0 500 2000 0 10 200 25 25 25 25
+total 0 3 0 2500 6000 0 30 600 26 75 75 75" \
+    "$("$QUOTATOOL" -u --summary /fake/vfsv1 /fake/xfs 2>&1)"
+
+_check "--all-filesystems leaves out those without the quota type" \
+    "42 /fake/xfs 3000 0 10000 0 5 0 0 0" \
+    "$("$QUOTATOOL" -p42 -d --all-filesystems 2>/dev/null)"
+
+# quotactl() hangs on the generic mounts: they are left out in time
+{ cat "$SEED"; echo "latency 3000000 Q_GETQUOTA"; } > "$CACHE/slow"
+start=$SECONDS
+got=$(QUOTATOOL_FAKE="$CACHE/slow" "$QUOTATOOL" -p42 -d --all-filesystems --probe-timeout 1 2>/dev/null)
+(( SECONDS - start < 3 )) || got="after $((SECONDS - start))s: $got"
+_check "--probe-timeout covers quotactl()" \
+    "42 /fake/xfs 3000 0 10000 0 5 0 0 0" \
+    "$got"
+
+"$QUOTATOOL" -p -D /fake/vfsv1 >/dev/null 2>&1
+_check "quota type not in the mount options" "3" "$?"
+
+# the second run takes the format from the cache: no "probe" phase
+export QUOTATOOL_FORMAT_CACHE="$CACHE/formats"
+"$QUOTATOOL" -d -u :1000 /fake/vfsv0 >/dev/null 2>&1
+_check "format cache written" "1" "$(grep -c ' 2 2$' "$CACHE/formats" 2>&1)"
+got=$("$QUOTATOOL" --stats -d -u :1000 /fake/vfsv0 2>&1)
+[[ "$got" == *"1000 /fake/vfsv0 500 "* && "$got" != *"probe"* ]] && got=cached
+_check "format cache used" "cached" "$got"
+unset QUOTATOOL_FORMAT_CACHE
+
+got=$("$QUOTATOOL" --stats --format xfs -d -u :1000 /fake/xfs 2>&1)
+[[ "$got" == *"1000 /fake/xfs 500 "* && "$got" != *"probe"* ]] && got=forced
+_check "--format skips detection" "forced" "$got"
+
+"$QUOTATOOL" --format vfsv2 -d -u :1000 /fake/vfsv1 >/dev/null 2>&1
+_check "--format with an unknown format" "1" "$?"
+
+# --serve: a client that stops reading a long -D holds up only itself
+if command -v python3 >/dev/null; then
+    SOCK="$CACHE/serve.sock"
+    { cat "$SEED"
+      awk 'BEGIN { for (i = 2000; i < 32000; i++) print "user", i, "/fake/vfsv1 1 0 0 0 1 0 0 0" }'
+    } > "$CACHE/seed"
+    QUOTATOOL_FAKE="$CACHE/seed" "$QUOTATOOL" --serve "$SOCK" --serve-group "$(id -gn)" 2>/dev/null &
+    SERVER=$!
+    for _ in $(seq 50); do [[ -S "$SOCK" ]] && break; sleep 0.1; done
+    got=$(timeout 10 python3 -c 'import socket, sys, time
+def ask(line):
+    s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1])
+    s.sendall(line.encode())
+    return s
+stalled = ask("-u -D /fake/vfsv1\n")
+time.sleep(0.5)
+s = ask("-d -u :1000 /fake/vfsv1\n-u :1000 -b -l 3M /fake/vfsv1\n-d -u :1000 /fake/vfsv1\n")
+s.shutdown(socket.SHUT_WR)
+answer = b""
+while True:
+    d = s.recv(65536)
+    if not d: break
+    answer += d
+sys.stdout.write(answer.decode())' "$SOCK" 2>&1)
+    kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null
+    _check "--serve answers while another client doesn't read" \
+        "1000 /fake/vfsv1 500 1000 2000 0 10 100 200 0
+OK
+OK
+1000 /fake/vfsv1 500 1000 3072 0 10 100 200 0
+OK" \
+        "$got"
+fi
+
+err=$(QUOTATOOL_FAKE=/nonexistent/seed "$QUOTATOOL" -d -u :1000 / 2>&1)
+rc=$?
+[[ "$err" == *"Failed opening /nonexistent/seed"* ]] || rc="$rc: $err"
+_check "missing seed file" "2" "$rc"
+
+echo ""
+echo "Results: $PASS passed, $FAIL failed"
+[[ $FAIL -eq 0 ]]
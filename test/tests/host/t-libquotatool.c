@@ -0,0 +1,134 @@
+/*
+ * t-libquotatool.c — libquotatool's API against the fake backend
+ *
+ * Built and run by t-libquotatool.sh, with QUOTATOOL_FAKE pointing at
+ * its seed file. Prints "ok - ..." / "FAIL - ..." per check like the
+ * shell tests, and nothing on stderr: the library must not print.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libquotatool.h"
+
+static int pass, fail;
+
+static void check (const char *desc, int ok, const qt_error *err) {
+  if ( ok ) {
+    printf ("  ok - %s\n", desc);
+    pass++;
+  }
+  else {
+    printf ("  FAIL - %s (code %d: %s)\n", desc, err ? err->code : 0, err ? err->message : "");
+    fail++;
+  }
+}
+
+/* many qt_get()s on one filesystem, one thread per filesystem */
+static void *reader (void *arg) {
+  qt_fs *fs = (qt_fs *) arg;
+  qt_quota q;
+  int i;
+
+  for (i = 0; i < 2000; i++) {
+    if ( qt_get(fs, QT_USER, 1000, &q, NULL) != QT_OK || q.block_used != 500 ) {
+      return (void *) 1;
+    }
+  }
+  return NULL;
+}
+
+int main (void) {
+  qt_fs *fs, *fs2, *v0, *xfs;
+  qt_error err;
+  qt_quota q;
+  unsigned long long value;
+  long long block_grace, inode_grace, seconds;
+  unsigned int id, ids[4];
+  int n, rc;
+  pthread_t t1, t2;
+  void *r1, *r2;
+
+  rc = qt_fs_open ("/fake/none", &fs, &err);
+  check ("no such filesystem", rc == QT_ERR_NOFS && err.code == rc && err.message[0], &err);
+
+  rc = qt_fs_open ("/fake/vfsv1", &fs, &err);
+  check ("open", rc == QT_OK && ! strcmp(qt_fs_mount_point(fs), "/fake/vfsv1"), &err);
+  if ( rc != QT_OK ) {
+    return 1;
+  }
+  rc = qt_fs_open ("/fake/vfsv1", &fs2, &err);
+  check ("open again, same handle", rc == QT_OK && fs2 == fs, &err);
+  qt_fs_close (fs2, NULL);
+
+  rc = qt_get (fs, QT_USER, 1000, &q, &err);
+  check ("get", rc == QT_OK && q.block_used == 500 && q.block_soft == 1000
+	 && q.block_hard == 2000 && q.inode_used == 10 && q.inode_hard == 200, &err);
+
+  rc = qt_get (fs, QT_USER, 4242, &q, &err);
+  check ("get an id without a quota", rc == QT_OK && ! q.block_hard && ! q.inode_used, &err);
+
+  memset (&q, 0, sizeof(q));
+  q.block_soft = 100;
+  q.block_hard = 5120;
+  rc = qt_set (fs, QT_USER, 1000, &q, QT_BLOCKS, &err);
+  if ( rc == QT_OK ) {
+    rc = qt_get (fs, QT_USER, 1000, &q, &err);
+  }
+  check ("set block limits, inode limits kept", rc == QT_OK && q.block_soft == 100
+	 && q.block_hard == 5120 && q.inode_soft == 100, &err);
+
+  n = 0;
+  for (id = 0; n < 4 && (rc = qt_next(fs, QT_USER, &id, &q, &err)) == QT_OK; id++) {
+    ids[n++] = id;
+  }
+  check ("enumerate ids", rc == QT_END && n == 2 && ids[0] == 1000 && ids[1] == 1001, &err);
+
+  rc = qt_get_grace (fs, QT_USER, &block_grace, &inode_grace, &err);
+  check ("grace periods", rc == QT_OK && block_grace == 3600 && inode_grace == 7200, &err);
+
+  rc = qt_reset_grace (fs, QT_USER, 1001, QT_BLOCKS, &err);
+  if ( rc == QT_OK ) {
+    rc = qt_get (fs, QT_USER, 1001, &q, &err);
+  }
+  check ("reset grace", rc == QT_OK && q.block_expires > time(NULL) + 3500
+	 && q.block_expires <= time(NULL) + 3600, &err);
+
+  rc = qt_get (fs, QT_PROJECT, 1, &q, &err);
+  check ("quota type not enabled", rc != QT_OK && rc != QT_ERR_ARG && err.message[0], &err);
+  rc = qt_get (fs, 9, 1, &q, &err);
+  check ("unknown quota type", rc == QT_ERR_ARG, &err);
+
+  rc = qt_sync (fs, &err);
+  check ("sync", rc == QT_OK, &err);
+  rc = qt_fs_close (fs, &err);
+  check ("close", rc == QT_OK, &err);
+
+  rc = qt_parse_limit ("10M", QT_BLOCKS, 0, &value, &err);
+  check ("parse 10M", rc == QT_OK && value == 10240, &err);
+  rc = qt_parse_limit ("+1k", QT_INODES, 500, &value, &err);
+  check ("parse +1k inodes", rc == QT_OK && value == 1500, &err);
+  rc = qt_parse_limit ("--5", QT_BLOCKS, 0, &value, &err);
+  check ("parse a negative size", rc == QT_ERR_ARG, &err);
+  rc = qt_parse_time ("2days", 0, &seconds, &err);
+  check ("parse 2days", rc == QT_OK && seconds == 172800, &err);
+
+  /* two filesystems from two threads at once */
+  if ( qt_fs_open("/fake/vfsv0", &v0, &err) != QT_OK || qt_fs_open("/fake/xfs", &xfs, &err) != QT_OK ) {
+    check ("open for threads", 0, &err);
+    return 1;
+  }
+  pthread_create (&t1, NULL, reader, v0);
+  pthread_create (&t2, NULL, reader, xfs);
+  pthread_join (t1, &r1);
+  pthread_join (t2, &r2);
+  check ("concurrent gets on two filesystems", ! r1 && ! r2, NULL);
+  qt_fs_close (v0, NULL);
+  qt_fs_close (xfs, NULL);
+
+  check ("version", ! strncmp(qt_version(), "1.", 2), NULL);
+
+  printf ("\nResults: %d passed, %d failed\n", pass, fail);
+  return fail != 0;
+}
@@ -0,0 +1,60 @@
+#!/bin/bash
+# t-libquotatool.sh — the library API against the fake backend (no root, no VM)
+#
+# Builds t-libquotatool.c against libquotatool.a from the build tree
+# and runs it on fake mounts. Anything the library prints on stderr
+# is a failure. Skips without a C compiler or the fake backend.
+#
+# Usage: t-libquotatool.sh [path-to-quotatool]
+
+set -uo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="${1:-$SCRIPT_DIR/../../../quotatool}"
+BUILD_DIR="$(cd "$(dirname "$QUOTATOOL")" && pwd)"
+CC="${CC:-cc}"
+
+echo "--- t-libquotatool (no root, no VM) ---"
+
+if [[ ! -f "$BUILD_DIR/libquotatool.a" ]]; then
+    echo "  FAIL - $BUILD_DIR/libquotatool.a not found"
+    exit 1
+fi
+if ! command -v "$CC" >/dev/null 2>&1; then
+    echo "  skip - no C compiler ($CC)"
+    exit 0
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+cat > "$WORK/seed" <<'SEED_EOF'
+mount /fake/vfsv1 ext4 vfsv1 rw,usrquota,grpquota
+mount /fake/vfsv0 ext3 v0
+mount /fake/xfs   xfs  xfs rw,uquota,pquota
+grace user /fake/vfsv1 3600 7200
+user 1000 /fake/vfsv1 500 1000 2000 0 10 100 200 0
+user 1001 /fake/vfsv1 1500 1000 2000 0 10 100 200 0
+user 1000 /fake/vfsv0 500 1000 2000 0 10 100 200 0
+user 1000 /fake/xfs   500 1000 2000 0 10 100 200 0
+SEED_EOF
+
+if ! QUOTATOOL_FAKE="$WORK/seed" "$QUOTATOOL" -d -u :1000 /fake/vfsv1 >/dev/null 2>&1; then
+    echo "  skip - quotatool built without --enable-fake-quota"
+    exit 0
+fi
+
+if ! "$CC" -Wall -I"$BUILD_DIR/src" -o "$WORK/t-libquotatool" "$SCRIPT_DIR/t-libquotatool.c" \
+        "$BUILD_DIR/libquotatool.a" -lpthread; then
+    echo "  FAIL - t-libquotatool.c does not build against libquotatool.a"
+    exit 1
+fi
+
+QUOTATOOL_FAKE="$WORK/seed" "$WORK/t-libquotatool" 2>"$WORK/stderr"
+rc=$?
+if [[ -s "$WORK/stderr" ]]; then
+    echo "  FAIL - the library printed on stderr:"
+    sed 's/^/    /' "$WORK/stderr"
+    rc=1
+fi
+exit $rc
@@ -0,0 +1,60 @@
+#!/bin/bash
+# t-dump-all.sh — -D lists every id with usage or limits, -d columns
+# Usage: t-dump-all.sh <fstype> <mountpoint>
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+# Two ids with limits, one of them has no passwd entry
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 10M -l 20M "$MNT" || fail "set $TEST_USER_UID failed"
+"$QUOTATOOL" -u ":$TEST_NOEXIST_UID" -i -q 30 -l 40 "$MNT" || fail "set $TEST_NOEXIST_UID failed"
+
+# -D needs Q_GETNEXTQUOTA (linux 4.6+), skip on older kernels
+if ! dump=$("$QUOTATOOL" -u -D "$MNT" 2>&1 >/dev/null); then
+    if [[ "$dump" == *"needs 4.6+"* ]]; then
+        echo "SKIP ($FSTYPE): kernel has no Q_GETNEXTQUOTA"
+        exit 0
+    fi
+fi
+dump=$("$QUOTATOOL" -u -D "$MNT") || fail "quotatool -D failed"
+echo "$dump"
+
+line=$(echo "$dump" | awk -v id="$TEST_USER_UID" '$1 == id')
+[[ -n "$line" ]] || fail "uid $TEST_USER_UID missing from -D"
+[[ $(echo "$line" | awk '{print NF}') -eq 10 ]] || fail "-D line has wrong field count: $line"
+[[ $(echo "$line" | awk '{print $5}') -eq 20480 ]] || fail "uid $TEST_USER_UID block hard: $line"
+
+# must be identical to the -d line for the same id (ignoring grace countdown)
+single=$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT")
+[[ $(echo "$line" | cut -d' ' -f1-5) == $(echo "$single" | cut -d' ' -f1-5) ]] \
+    || fail "-D and -d differ: '$line' vs '$single'"
+
+line=$(echo "$dump" | awk -v id="$TEST_NOEXIST_UID" '$1 == id')
+[[ -n "$line" ]] || fail "uid $TEST_NOEXIST_UID (no passwd entry) missing from -D"
+[[ $(echo "$line" | awk '{print $9}') -eq 40 ]] || fail "uid $TEST_NOEXIST_UID inode hard: $line"
+
+# ids are listed in ascending order, without duplicates
+sorted=$(echo "$dump" | awk '{print $1}' | sort -n -u)
+[[ "$(echo "$dump" | awk '{print $1}')" == "$sorted" ]] || fail "-D ids not ascending/unique"
+
+# Same records as CSV and NDJSON, with stable field names
+csv=$("$QUOTATOOL" -u -D --output csv "$MNT") || fail "-D --output csv failed"
+[[ $(echo "$csv" | head -1) == "type,id,filesystem,block_used_kb,block_soft_kb,block_hard_kb,block_grace_s,inode_used,inode_soft,inode_hard,inode_grace_s" ]] \
+    || fail "CSV header: $(echo "$csv" | head -1)"
+[[ $(echo "$csv" | wc -l) -eq $(( $(echo "$dump" | wc -l) + 1 )) ]] || fail "CSV has a different number of records"
+echo "$csv" | grep -q "^user,$TEST_USER_UID,$MNT,[0-9]*,10240,20480," || fail "CSV record for $TEST_USER_UID: $csv"
+json=$("$QUOTATOOL" -u -D --output ndjson "$MNT") || fail "-D --output ndjson failed"
+echo "$json" | grep -q "^{\"type\":\"user\",\"id\":$TEST_NOEXIST_UID,\"filesystem\":\"$MNT\",.*\"inode_hard\":40," \
+    || fail "NDJSON record for $TEST_NOEXIST_UID: $json"
+if command -v python3 >/dev/null; then
+    echo "$json" | python3 -c 'import json,sys; [json.loads(l) for l in sys.stdin]' || fail "NDJSON does not parse"
+fi
+
+# Clean up
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 0 -l 0 "$MNT" || true
+"$QUOTATOOL" -u ":$TEST_NOEXIST_UID" -i -q 0 -l 0 "$MNT" || true
+echo "PASS ($FSTYPE): -D listed all ids with limits in -d format"
@@ -103,3 +103,15 @@ grace_i=$(echo "$dump_i" | awk '{print $10}')
     || fail "inode grace=$grace_i, expected ~$GRACE"
 
 echo "PASS ($FSTYPE): inode grace set ($grace_i)"
+
+# --- Grace periods are only fetched when -t or -r needs them ---
+out=$("$QUOTATOOL" -v -d -u "$TEST_USER_NAME" "$MNT" 2>&1 >/dev/null) || fail "verbose -d failed"
+echo "$out" | grep -q "grace info: 0 quotactl calls made" \
+    || fail "-d fetched grace info: $(echo "$out" | grep 'grace info')"
+out=$("$QUOTATOOL" -v -u -i -t "${GRACE} seconds" "$MNT" 2>&1) || fail "verbose -t failed"
+echo "$out" | grep -q "grace info: 1 quotactl calls made" \
+    || fail "-t did not fetch grace info once: $(echo "$out" | grep 'grace info')"
+
+"$QUOTATOOL" -u "$TEST_USER_NAME" -i -q 0 -l 0 "$MNT" 2>/dev/null || true
+rm -rf "$MNT/grace-test"
+echo "PASS ($FSTYPE): grace info fetched only for -t"
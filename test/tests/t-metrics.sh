@@ -0,0 +1,61 @@
+#!/bin/bash
+# t-metrics.sh — --metrics textfile and --metrics-port scrapes
+# Usage: t-metrics.sh <fstype> <mountpoint>
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+DIR=$(mktemp -d)
+PID=""
+cleanup() { [[ -n "$PID" ]] && kill "$PID" 2>/dev/null || true; rm -rf "$DIR"; }
+trap cleanup EXIT
+
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 10M -l 20M "$MNT" || fail "set user limits failed"
+"$QUOTATOOL" -g ":$TEST_NOEXIST_GID" -i -q 30 -l 40 "$MNT" || fail "set group limits failed"
+
+# -D needs Q_GETNEXTQUOTA (linux 4.6+), so do metrics
+if ! "$QUOTATOOL" -u -D "$MNT" >/dev/null 2>&1; then
+    echo "SKIP ($FSTYPE): kernel has no Q_GETNEXTQUOTA"
+    exit 0
+fi
+
+"$QUOTATOOL" --metrics "$DIR/quota.prom" "$MNT" || fail "--metrics failed"
+[[ $(ls "$DIR") == "quota.prom" ]] || fail "temporary file left behind: $(ls "$DIR")"
+prom=$(cat "$DIR/quota.prom")
+
+grep -qx "quotatool_block_hard_limit_bytes{filesystem=\"$MNT\",type=\"user\",id=\"$TEST_USER_UID\"} 20971520" <<< "$prom" \
+    || fail "user block hard limit missing: $(grep "id=\"$TEST_USER_UID\"" <<< "$prom")"
+grep -qx "quotatool_inode_hard_limit{filesystem=\"$MNT\",type=\"group\",id=\"$TEST_NOEXIST_GID\"} 40" <<< "$prom" \
+    || fail "group inode hard limit missing: $(grep "id=\"$TEST_NOEXIST_GID\"" <<< "$prom")"
+
+# every metric once, its samples right after its TYPE line
+[[ $(grep -c '^# TYPE ' <<< "$prom") -eq 8 ]] || fail "expected 8 metrics"
+families=$(grep -v '^#' <<< "$prom" | sed 's/{.*//' | uniq | wc -l)
+[[ $families -eq 8 ]] || fail "samples of a metric are not together ($families runs)"
+
+# -u: users only
+"$QUOTATOOL" -u --metrics - "$MNT" | grep -q 'type="group"' && fail "-u --metrics listed groups"
+
+# the same over HTTP
+if command -v curl >/dev/null; then
+    PORT=$((20000 + RANDOM % 10000))
+    "$QUOTATOOL" --metrics-port "$PORT" "$MNT" 2>/dev/null &
+    PID=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        scrape=$(curl -sf "http://127.0.0.1:$PORT/metrics" 2>/dev/null) && break
+        sleep 0.2
+    done
+    [[ -n "${scrape:-}" ]] || fail "no answer on port $PORT"
+    grep -q "type=\"user\",id=\"$TEST_USER_UID\"} 20971520" <<< "$scrape" || fail "scrape lacks user limit"
+    kill "$PID"; wait "$PID" || fail "--metrics-port did not stop cleanly"
+    PID=""
+fi
+
+# Clean up
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 0 -l 0 "$MNT" || true
+"$QUOTATOOL" -g ":$TEST_NOEXIST_GID" -i -q 0 -l 0 "$MNT" || true
+echo "PASS ($FSTYPE): metrics written atomically and scraped"
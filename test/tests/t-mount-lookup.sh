@@ -0,0 +1,34 @@
+#!/bin/bash
+# t-mount-lookup.sh — any path on a filesystem resolves to its mount
+# Usage: t-mount-lookup.sh <fstype> <mountpoint>
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+mkdir -p "$MNT/lookup/deeper"
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 10M -l 20M "$MNT" || fail "set via mount point failed"
+
+# a directory below the mount point finds the same device
+by_mnt=$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT")
+by_dir=$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT/lookup/deeper")
+[[ "$by_mnt" == "$by_dir" ]] || fail "subdirectory lookup differs: '$by_mnt' vs '$by_dir'"
+
+# so does the device node itself, and a trailing slash
+dev=$(echo "$by_mnt" | awk '{print $2}')
+by_dev=$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$dev")
+[[ "$by_mnt" == "$by_dev" ]] || fail "device lookup differs: '$by_mnt' vs '$by_dev'"
+"$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT/" >/dev/null || fail "trailing slash lookup failed"
+
+# and limits can be set through the subdirectory
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -l 30M "$MNT/lookup" || fail "set via subdirectory failed"
+[[ $("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT" | awk '{print $5}') -eq 30720 ]] \
+    || fail "limit set via subdirectory not applied"
+
+# Clean up
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 0 -l 0 "$MNT" || true
+rm -rf "$MNT/lookup"
+echo "PASS ($FSTYPE): mount resolved from mount point, device and subdirectories"
@@ -0,0 +1,38 @@
+#!/bin/bash
+# t-multi-fs.sh — several filesystem args, each reported, any failure fails the run
+# Usage: t-multi-fs.sh <fstype> <mountpoint>
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+mkdir -p "$MNT/multi"
+
+# the same filesystem under two names is only worked on once
+out=$("$QUOTATOOL" -v -u ":$TEST_USER_UID" -b -l 20M "$MNT" "$MNT/multi" 2>&1) \
+    || fail "two names for one filesystem failed: $out"
+echo "$out" | grep -q "$MNT/multi is the same filesystem as $MNT" || fail "duplicate not detected: $out"
+echo "$out" | grep -q "2 filesystems, 2 ok, 0 failed" || fail "missing summary: $out"
+[[ $("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT" | awk '{print $5}') -eq 20480 ]] \
+    || fail "limit not applied"
+
+# one bad filesystem fails the run, the good one is still done
+rc=0
+out=$("$QUOTATOOL" -u ":$TEST_USER_UID" -b -l 30M /nonexistent-mnt "$MNT" 2>&1) || rc=$?
+[[ $rc -ne 0 ]] || fail "run with a bad filesystem returned 0"
+echo "$out" | grep -q "/nonexistent-mnt: failed" || fail "bad filesystem not reported: $out"
+echo "$out" | grep -q "2 filesystems, 1 ok, 1 failed" || fail "wrong summary: $out"
+[[ $("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT" | awk '{print $5}') -eq 30720 ]] \
+    || fail "good filesystem not done next to a bad one"
+
+# -d prints one line per filesystem
+[[ $("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT" "$MNT" | wc -l) -eq 1 ]] \
+    || fail "-d on a duplicate filesystem printed twice"
+
+# Clean up
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 0 -l 0 "$MNT" || true
+rm -rf "$MNT/multi"
+echo "PASS ($FSTYPE): several filesystems in one run, failures reported per filesystem"
@@ -0,0 +1,80 @@
+#!/bin/bash
+# t-project.sh — project quotas (-p) and --tag-tree
+# Usage: t-project.sh <fstype> <mountpoint>
+#
+# Project quotas need their own mkfs/mount options, so this test makes
+# its own small filesystem of the same type instead of using <mountpoint>.
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+P="${MNT}-prj"
+IMG="${P}.img"
+LOOP=""
+PROJECTS_SAVED=""
+cleanup() {
+    if [[ "$PROJECTS_SAVED" == yes ]]; then mv /etc/projects.t-project /etc/projects
+    elif [[ "$PROJECTS_SAVED" == no ]]; then rm -f /etc/projects; fi
+    umount "$P" 2>/dev/null || true
+    [[ -n "$LOOP" ]] && losetup -d "$LOOP" 2>/dev/null || true
+    rm -f "$IMG"; rmdir "$P" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+truncate -s 300M "$IMG"
+LOOP=$(losetup --find --show "$IMG") || fail "losetup failed"
+mkdir -p "$P"
+if [[ "$FSTYPE" == "xfs" ]]; then
+    mkfs.xfs -f -q "$LOOP" >/dev/null 2>&1 && mount -o pquota "$LOOP" "$P" 2>/dev/null \
+        || { echo "SKIP ($FSTYPE): cannot mount XFS with pquota"; exit 0; }
+else
+    mkfs.ext4 -q -O quota,project "$LOOP" >/dev/null 2>&1 && mount -o prjquota "$LOOP" "$P" 2>/dev/null \
+        || { echo "SKIP ($FSTYPE): kernel has no ext4 project quotas (needs 4.5+)"; exit 0; }
+fi
+
+# A tree made before it was in any project
+mkdir -p "$P/tree/a/b" "$P/other"
+for f in "$P/tree/f1" "$P/tree/a/f2" "$P/tree/a/b/f3"; do
+    dd if=/dev/zero of="$f" bs=1M count=2 2>/dev/null
+done
+ln -s /etc "$P/tree/link"
+dd if=/dev/zero of="$P/other/big" bs=1M count=5 2>/dev/null
+
+out=$("$QUOTATOOL" -p :42 -n --tag-tree "$P/tree" 2>&1) || fail "--tag-tree -n failed: $out"
+[[ "$out" == *"6 inodes would be put into project 42"* ]] || fail "--tag-tree -n count: $out"
+[[ "$out" == *"1 skipped"* ]] || fail "symlink not skipped: $out"
+
+"$QUOTATOOL" -p :42 --tag-tree "$P/tree" || fail "--tag-tree failed"
+out=$("$QUOTATOOL" -p :42 --tag-tree "$P/tree" 2>&1) || fail "second --tag-tree failed: $out"
+[[ "$out" == *"0 inodes put into project 42, 6 already were"* ]] || fail "second --tag-tree: $out"
+
+# Usage counts the tree, not the rest of the filesystem
+"$QUOTATOOL" -p :42 -b -l 10M "$P" || fail "set project limit failed"
+dump=$("$QUOTATOOL" -d -p :42 "$P") || fail "quotatool -d -p failed"
+used=$(echo "$dump" | awk '{print $3}')
+[[ $used -ge 6144 && $used -lt 8192 ]] || fail "project 42 block usage not ~6M: $dump"
+[[ $(echo "$dump" | awk '{print $5}') -eq 10240 ]] || fail "project 42 block hard not 10240: $dump"
+
+# --du: usage per directory in /etc/projects, without walking the tree
+if [[ -f /etc/projects ]]; then cp /etc/projects /etc/projects.t-project; PROJECTS_SAVED=yes; else PROJECTS_SAVED=no; fi
+mkdir -p "$P/empty"
+printf '42:%s\n43:%s\n' "$P/tree" "$P/empty" > /etc/projects
+du=$("$QUOTATOOL" -p --du "$P") || fail "quotatool --du failed"
+echo "$du"
+[[ $(echo "$du" | wc -l) -eq 2 ]] || fail "--du should list 2 directories: $du"
+line=$(echo "$du" | awk -v d="$P/tree" '$2 == d')
+[[ $(echo "$line" | awk '{print $1, $3}') == "42 $used" ]] || fail "--du line for tree: $line (-d said $used)"
+line=$(echo "$du" | awk -v d="$P/empty" '$2 == d')
+[[ $(echo "$line" | awk '{print $1, $3, $7}') == "43 0 0" ]] || fail "--du line for untagged dir: $line"
+
+# New files inherit the project, and the limit is enforced
+chmod -R 777 "$P/tree"
+if runuser -u "$TEST_USER_NAME" -- sh -c "dd if=/dev/zero of=$P/tree/a/new bs=1M count=8 2>/dev/null"; then
+    fail "wrote 8M more into a project at 6M of 10M"
+fi
+
+echo "PASS ($FSTYPE): project quotas set, tree tagged and enforced"
@@ -0,0 +1,54 @@
+#!/bin/bash
+# t-reconcile.sh — --reconcile sets only ids whose limits differ, -n prints the plan
+# Usage: t-reconcile.sh <fstype> <mountpoint>
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+DESIRED=$(mktemp)
+trap 'rm -f "$DESIRED"' EXIT
+
+# Current state: user already right, noexist uid different
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 10M -l 20M "$MNT" || fail "set $TEST_USER_UID failed"
+"$QUOTATOOL" -u ":$TEST_USER_UID" -i -q 0 -l 0 "$MNT" || fail "set $TEST_USER_UID failed"
+"$QUOTATOOL" -u ":$TEST_NOEXIST_UID" -b -q 1M -l 2M "$MNT" || fail "set $TEST_NOEXIST_UID failed"
+
+cat > "$DESIRED" <<DESIRED_EOF
+# id  block-soft block-hard inode-soft inode-hard
+$TEST_USER_NAME 10M 20M 0 0
+:$TEST_NOEXIST_UID 5M 6M - 70
+DESIRED_EOF
+
+# -n: one plan line, for the id that differs, and nothing changed
+plan=$("$QUOTATOOL" -u -n --reconcile "$DESIRED" "$MNT") || fail "reconcile -n failed"
+echo "plan: $plan"
+[[ $(echo "$plan" | wc -l) -eq 1 ]] || fail "plan should have one line: $plan"
+[[ $(echo "$plan" | awk '{print $1}') -eq $TEST_NOEXIST_UID ]] || fail "wrong id in plan: $plan"
+[[ $(echo "$plan" | awk '{print NF}') -eq 10 ]] || fail "plan line has wrong field count: $plan"
+[[ "$(echo "$plan" | cut -d' ' -f3-)" == "1024 5120 2048 6144 0 0 0 70" ]] \
+    || fail "plan values wrong: $plan"
+dump=$("$QUOTATOOL" -d -u ":$TEST_NOEXIST_UID" "$MNT")
+[[ $(echo "$dump" | awk '{print $4}') -eq 1024 ]] || fail "-n changed limits: $dump"
+
+# for real: one id changed, one left alone
+out=$("$QUOTATOOL" -u --reconcile "$DESIRED" "$MNT" 2>&1) || fail "reconcile failed: $out"
+echo "$out"
+[[ "$out" == *"2 ids, 1 unchanged, 1 changed, 0 failed"* ]] || fail "wrong summary: $out"
+dump=$("$QUOTATOOL" -d -u ":$TEST_NOEXIST_UID" "$MNT")
+[[ $(echo "$dump" | awk '{print $4}') -eq 5120 ]] || fail "block soft not 5120: $dump"
+[[ $(echo "$dump" | awk '{print $5}') -eq 6144 ]] || fail "block hard not 6144: $dump"
+[[ $(echo "$dump" | awk '{print $9}') -eq 70 ]] || fail "inode hard not 70: $dump"
+
+# a second run has nothing to do
+plan=$("$QUOTATOOL" -u -n --reconcile "$DESIRED" "$MNT") || fail "second reconcile -n failed"
+[[ -z "$plan" ]] || fail "second run still has a plan: $plan"
+
+# Clean up
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 0 -l 0 "$MNT" || true
+"$QUOTATOOL" -u ":$TEST_NOEXIST_UID" -b -q 0 -l 0 "$MNT" || true
+"$QUOTATOOL" -u ":$TEST_NOEXIST_UID" -i -q 0 -l 0 "$MNT" || true
+echo "PASS ($FSTYPE): --reconcile set only the differing id"
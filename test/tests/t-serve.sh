@@ -0,0 +1,82 @@
+#!/bin/bash
+# t-serve.sh — --serve answers get/set/dump requests on a unix socket
+# Usage: t-serve.sh <fstype> <mountpoint>
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+# a unix socket client: send stdin, print the answers
+if command -v socat >/dev/null; then
+    client() { socat -t 5 - "UNIX-CONNECT:$SOCK"; }
+elif command -v python3 >/dev/null; then
+    client() {
+        python3 -c 'import socket,sys
+s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1])
+s.sendall(sys.stdin.buffer.read()); s.shutdown(socket.SHUT_WR)
+while True:
+    d = s.recv(65536)
+    if not d: break
+    sys.stdout.buffer.write(d)' "$SOCK"
+    }
+else
+    echo "SKIP ($FSTYPE): no socat or python3 for a socket client"
+    exit 0
+fi
+
+SOCK=$(mktemp -u /tmp/quotatool-XXXXXX.sock)
+"$QUOTATOOL" --serve "$SOCK" 2>/dev/null &
+PID=$!
+trap 'kill $PID 2>/dev/null || true' EXIT
+for _ in $(seq 50); do [[ -S "$SOCK" ]] && break; sleep 0.1; done
+[[ -S "$SOCK" ]] || fail "socket not created"
+[[ $(stat -c %a "$SOCK") == 600 ]] || fail "socket mode not 600 without --serve-group"
+
+# set, then get on the same connection
+out=$(printf '%s\n' "-u :$TEST_USER_UID -b -q 10M -l 20M $MNT" \
+                    "-d -u :$TEST_USER_UID $MNT" | client)
+echo "$out"
+[[ $(echo "$out" | grep -c '^OK$') -eq 2 ]] || fail "expected two OK answers: $out"
+line=$(echo "$out" | grep "^$TEST_USER_UID ")
+[[ $(echo "$line" | awk '{print $5}') -eq 20480 ]] || fail "get after set: $line"
+[[ "$line" == "$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$MNT")" ]] \
+    || fail "answer differs from -d: $line"
+
+# errors are answered, the server keeps running
+out=$(printf '%s\n' "-u :$TEST_USER_UID -b -l 20M /nonexistent-mnt" "-h" | client)
+echo "$out" | grep -q '^ERR 3$' || fail "bad filesystem not answered with ERR 3: $out"
+echo "$out" | grep -q '^ERR 1$' || fail "-h not refused: $out"
+kill -0 $PID || fail "server died"
+
+# only get/set/reset/dump options: nothing that writes files or listens
+VICTIM=$(mktemp -u /tmp/quotatool-victim-XXXXXX)
+out=$(printf '%s\n' "--serve $VICTIM" "--batch $VICTIM" \
+                    "-u --reconcile $VICTIM $MNT" "--tag-tree -p 1 $MNT" \
+                    "--metrics $VICTIM $MNT" "--metrics-port 9917 $MNT" | client)
+[[ $(echo "$out" | grep -c '^ERR 1$') -eq 6 ]] || fail "global options not refused: $out"
+[[ ! -e "$VICTIM" ]] || { rm -f "$VICTIM"; fail "request created $VICTIM"; }
+kill -0 $PID || fail "server died"
+
+# reset grace and dump
+out=$(printf '%s\n' "-u :$TEST_USER_UID -b -r $MNT" | client)
+echo "$out" | grep -q '^OK$' || fail "reset grace failed: $out"
+if "$QUOTATOOL" -u -D "$MNT" >/dev/null 2>&1; then
+    out=$(printf '%s\n' "-u -D $MNT" | client)
+    echo "$out" | grep -q "^$TEST_USER_UID " || fail "dump misses uid $TEST_USER_UID: $out"
+fi
+
+# nothing stays open on the filesystem between requests, umount would fail
+for fd in /proc/$PID/fd/*; do
+    [[ "$(readlink "$fd")" == "$MNT"* ]] && fail "server keeps $MNT open: $fd"
+done
+
+# SIGTERM removes the socket
+kill $PID; wait $PID || true
+[[ ! -e "$SOCK" ]] || fail "socket left behind"
+
+# Clean up
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -q 0 -l 0 "$MNT" || true
+echo "PASS ($FSTYPE): --serve answered set, get, reset and dump requests"
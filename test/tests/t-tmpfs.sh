@@ -0,0 +1,52 @@
+#!/bin/bash
+# t-tmpfs.sh — quotas on tmpfs, which has no device (quotactl_fd, linux 6.6+)
+# Usage: t-tmpfs.sh <fstype> <mountpoint>
+#
+# Mounts its own tmpfs, so it only runs in the ext4 pass.
+
+set -euo pipefail
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+QUOTATOOL="$SCRIPT_DIR/../../quotatool"
+FSTYPE="$1"; MNT="$2"
+fail() { echo "FAIL ($FSTYPE): $*" >&2; exit 1; }
+[[ -x "$QUOTATOOL" ]] || fail "quotatool not found"
+
+if [[ "$FSTYPE" != "ext4" ]]; then
+    echo "SKIP ($FSTYPE): tmpfs test runs in the ext4 pass only"
+    exit 0
+fi
+
+T1=$(mktemp -d); T2=$(mktemp -d)
+cleanup() { umount "$T1" 2>/dev/null || true; umount "$T2" 2>/dev/null || true; rmdir "$T1" "$T2"; }
+trap cleanup EXIT
+
+if ! mount -t tmpfs -o usrquota,size=32M tmpfs "$T1" 2>/dev/null; then
+    echo "SKIP ($FSTYPE): kernel has no tmpfs quotas (needs 6.6+)"
+    exit 0
+fi
+mount -t tmpfs -o usrquota,size=32M tmpfs "$T2" || fail "second tmpfs mount failed"
+
+# Different limits on two tmpfs mounts: both are called "tmpfs",
+# they must not be taken for the same filesystem
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -l 10M "$T1" || fail "set on $T1 failed"
+"$QUOTATOOL" -u ":$TEST_USER_UID" -b -l 20M "$T2" || fail "set on $T2 failed"
+
+dump=$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$T1") || fail "quotatool -d failed on $T1"
+[[ $(echo "$dump" | awk '{print $5}') -eq 10240 ]] || fail "block hard on $T1 not 10240: $dump"
+dump=$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$T2") || fail "quotatool -d failed on $T2"
+[[ $(echo "$dump" | awk '{print $5}') -eq 20480 ]] || fail "block hard on $T2 not 20480: $dump"
+
+# Both at once, in one process
+"$QUOTATOOL" -u ":$TEST_USER_UID" -i -l 100 "$T1" "$T2" || fail "multi-fs set failed"
+for t in "$T1" "$T2"; do
+    dump=$("$QUOTATOOL" -d -u ":$TEST_USER_UID" "$t")
+    [[ $(echo "$dump" | awk '{print $9}') -eq 100 ]] || fail "inode hard on $t not 100: $dump"
+done
+
+# Enforced by the kernel
+chmod 777 "$T1"
+if runuser -u "$TEST_USER_NAME" -- sh -c "dd if=/dev/zero of=$T1/big bs=1M count=20 2>/dev/null"; then
+    fail "wrote 20M past a 10M hard limit on tmpfs"
+fi
+
+echo "PASS ($FSTYPE): tmpfs quotas set and read through quotactl_fd"